@@ -0,0 +1,15 @@
+#include <iostream>
+#include "matrix_apply_application.hpp"
+
+int main(int argc, char* argv[])
+{
+    auto args = MatrixApplyApplication::parseArguments(argc, argv);
+    if (!args.has_value()) {
+        MatrixApplyApplication app;
+        app.printUsage(argv[0]);
+        return -1;
+    }
+    
+    MatrixApplyApplication app;
+    return app.run(args.value());
+}
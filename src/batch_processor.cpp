@@ -0,0 +1,350 @@
+#include "batch_processor.hpp"
+#include "bounded_queue.hpp"
+#include "image_file_handler.hpp"
+#include "stage_profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Frame {
+    size_t jobIndex;
+    ImageData image;
+    ImageData mappedOutput; // The output file's pixels when it can be written through a mapping
+};
+
+struct FramePair {
+    size_t jobIndex;
+    ImageData start;
+    ImageData target;
+};
+
+// Stage busy time shared by that stage's threads
+class StageClock {
+public:
+    void add(const Stopwatch& stopwatch) {
+        nanoseconds_ += static_cast<uint64_t>(stopwatch.seconds() * 1e9);
+    }
+
+    double seconds() const { return nanoseconds_ / 1e9; }
+
+private:
+    std::atomic<uint64_t> nanoseconds_{ 0 };
+};
+
+// Counting semaphore bounding the number of frames between decode and encode
+class FrameBudget {
+public:
+    explicit FrameBudget(size_t frames) : available_(std::max<size_t>(1, frames)) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this]() { return available_ > 0; });
+        --available_;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++available_;
+        released_.notify_one();
+    }
+
+private:
+    size_t available_;
+    std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+// Output path for an input without an explicit destination, in a format that keeps the input's precision
+std::string defaultOutputPath(const fs::path& input, const fs::path& outputDirectory) {
+    fs::path output = outputDirectory / input.filename();
+    output.replace_extension(ImageFileHandler::outputExtension(input.string()));
+    return output.string();
+}
+
+} // namespace
+
+BatchProcessor::BatchProcessor(ThreadPool& applyPool, const BatchOptions& options)
+    : applyPool_(applyPool), options_(options) {}
+
+std::optional<std::vector<BatchJob>> BatchProcessor::collectJobs(const std::string& source,
+                                                                 const std::optional<std::string>& outputDirectory) {
+    std::vector<BatchJob> jobs;
+    std::error_code error;
+    
+    if (fs::is_directory(source, error)) {
+        if (!outputDirectory) {
+            std::cerr << "Error: An output directory is required when processing the directory '" << source << "'" << std::endl;
+            return std::nullopt;
+        }
+        
+        std::vector<fs::path> inputs;
+        for (const auto& entry : fs::directory_iterator(source, error)) {
+            if (entry.is_regular_file() && ImageFileHandler::canLoad(entry.path().string())) {
+                inputs.push_back(entry.path());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+        
+        for (const fs::path& input : inputs) {
+            jobs.push_back({ input.string(), defaultOutputPath(input, *outputDirectory) });
+        }
+    } else {
+        std::ifstream manifest(source);
+        if (!manifest) {
+            std::cerr << "Error: Failed to open batch manifest '" << source << "'" << std::endl;
+            return std::nullopt;
+        }
+        
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(manifest, line)) {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            
+            std::istringstream fields(line);
+            BatchJob job;
+            if (!(fields >> job.inputPath)) {
+                continue;
+            }
+            if (!(fields >> job.outputPath)) {
+                if (!outputDirectory) {
+                    std::cerr << "Error: Manifest line " << lineNumber << " has no output path and no output directory was given" << std::endl;
+                    return std::nullopt;
+                }
+                job.outputPath = defaultOutputPath(job.inputPath, *outputDirectory);
+            }
+            jobs.push_back(std::move(job));
+        }
+    }
+    
+    if (outputDirectory) {
+        fs::create_directories(*outputDirectory, error);
+        if (error) {
+            std::cerr << "Error: Failed to create output directory '" << *outputDirectory << "': " << error.message() << std::endl;
+            return std::nullopt;
+        }
+    }
+    
+    return jobs;
+}
+
+BatchResult BatchProcessor::run(const std::vector<BatchJob>& jobs, const ColorCorrectionMatrix& matrix) {
+    return run(jobs, [&matrix](const ImageData& frame, ImageData& output, ThreadPool& threadPool) {
+        ColorCorrectionMatrixSolver::ApplyMatrixInto(frame, output, matrix, &threadPool);
+    });
+}
+
+BatchResult BatchProcessor::run(const std::vector<BatchJob>& jobs, const FrameTransform& transform) {
+    const auto startTime = std::chrono::steady_clock::now();
+    
+    FrameBudget budget(options_.maxFramesInFlight);
+    BoundedQueue<Frame> decoded(options_.maxFramesInFlight);
+    BoundedQueue<Frame> corrected(options_.maxFramesInFlight);
+    std::atomic<size_t> nextJob(0);
+    std::atomic<size_t> succeeded(0);
+    std::atomic<size_t> failed(0);
+    std::atomic<size_t> pixels(0);
+    StageClock decodeClock, applyClock, encodeClock;
+    
+    auto decodeStage = [&]() {
+        for (size_t index = nextJob++; index < jobs.size(); index = nextJob++) {
+            budget.acquire();
+            Stopwatch stopwatch;
+            ImageData image = ImageFileHandler::loadImage(jobs[index].inputPath);
+            decodeClock.add(stopwatch);
+            if (!image.isValid()) {
+                ++failed;
+                budget.release();
+                continue;
+            }
+            // Creating the output mapping is encode work done ahead, so it counts toward encode
+            Stopwatch mapStopwatch;
+            ImageData mappedOutput = ImageFileHandler::createMappedImage(jobs[index].outputPath, image);
+            encodeClock.add(mapStopwatch);
+            decoded.push(Frame{ index, std::move(image), std::move(mappedOutput) });
+        }
+    };
+    
+    auto applyStage = [&]() {
+        while (auto frame = decoded.pop()) {
+            try {
+                Stopwatch stopwatch;
+                transform(frame->image, frame->mappedOutput.isValid() ? frame->mappedOutput : frame->image, applyPool_);
+                applyClock.add(stopwatch);
+                pixels += static_cast<size_t>(frame->image.width) * frame->image.height;
+                corrected.push(std::move(*frame));
+            } catch (const std::exception& e) {
+                std::cerr << "Error applying color correction to '" << jobs[frame->jobIndex].inputPath << "': " << e.what() << std::endl;
+                if (frame->mappedOutput.isValid()) {
+                    // Drop the output file rather than leave a frame of unwritten pixels behind
+                    frame->mappedOutput = ImageData();
+                    std::error_code error;
+                    fs::remove(jobs[frame->jobIndex].outputPath, error);
+                }
+                ++failed;
+                budget.release();
+            }
+        }
+    };
+    
+    auto encodeStage = [&]() {
+        while (auto frame = corrected.pop()) {
+            Stopwatch stopwatch;
+            if (frame->mappedOutput.isValid()) {
+                frame->mappedOutput = ImageData(); // Unmaps, completing the file
+                std::cout << "Successfully saved image to: " << jobs[frame->jobIndex].outputPath << std::endl;
+                ++succeeded;
+            } else if (ImageFileHandler::saveImage(frame->image, jobs[frame->jobIndex].outputPath)) {
+                ++succeeded;
+            } else {
+                ++failed;
+            }
+            encodeClock.add(stopwatch);
+            frame->image = ImageData();
+            budget.release();
+        }
+    };
+    
+    std::vector<std::thread> decoders, encoders;
+    for (unsigned int i = 0; i < std::max(1u, options_.decodeThreads); ++i) {
+        decoders.emplace_back(decodeStage);
+    }
+    std::thread applier(applyStage);
+    for (unsigned int i = 0; i < std::max(1u, options_.encodeThreads); ++i) {
+        encoders.emplace_back(encodeStage);
+    }
+    
+    // Shut the stages down in pipeline order so every frame drains through
+    for (std::thread& decoder : decoders) {
+        decoder.join();
+    }
+    decoded.close();
+    applier.join();
+    corrected.close();
+    for (std::thread& encoder : encoders) {
+        encoder.join();
+    }
+    
+    BatchResult result;
+    result.succeeded = succeeded;
+    result.failed = failed;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.decodeSeconds = decodeClock.seconds();
+    result.applySeconds = applyClock.seconds();
+    result.encodeSeconds = encodeClock.seconds();
+    result.pixels = pixels;
+    return result;
+}
+
+
+std::optional<std::vector<PairJob>> BatchProcessor::collectPairs(const std::string& manifest) {
+    std::ifstream input(manifest);
+    if (!input) {
+        std::cerr << "Error: Failed to open pair manifest '" << manifest << "'" << std::endl;
+        return std::nullopt;
+    }
+    
+    std::vector<PairJob> jobs;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        
+        std::istringstream fields(line);
+        PairJob job;
+        if (!(fields >> job.startPath)) {
+            continue;
+        }
+        if (!(fields >> job.targetPath)) {
+            std::cerr << "Error: Manifest line " << lineNumber << " has no target image" << std::endl;
+            return std::nullopt;
+        }
+        jobs.push_back(std::move(job));
+    }
+    
+    if (jobs.empty()) {
+        std::cerr << "Error: Pair manifest '" << manifest << "' lists no image pairs" << std::endl;
+        return std::nullopt;
+    }
+    return jobs;
+}
+
+BatchResult BatchProcessor::run(const std::vector<PairJob>& jobs, const PairVisitor& visit) {
+    const auto startTime = std::chrono::steady_clock::now();
+    
+    FrameBudget budget(options_.maxFramesInFlight);
+    BoundedQueue<FramePair> decoded(options_.maxFramesInFlight);
+    std::atomic<size_t> nextJob(0);
+    std::atomic<size_t> succeeded(0);
+    std::atomic<size_t> failed(0);
+    std::atomic<size_t> pixels(0);
+    StageClock decodeClock, visitClock;
+    
+    auto decodeStage = [&]() {
+        for (size_t index = nextJob++; index < jobs.size(); index = nextJob++) {
+            budget.acquire();
+            Stopwatch stopwatch;
+            ImageData start = ImageFileHandler::loadImage(jobs[index].startPath);
+            ImageData target = start.isValid() ? ImageFileHandler::loadImage(jobs[index].targetPath) : ImageData();
+            decodeClock.add(stopwatch);
+            if (!target.isValid()) {
+                ++failed;
+                budget.release();
+                continue;
+            }
+            decoded.push(FramePair{ index, std::move(start), std::move(target) });
+        }
+    };
+    
+    auto visitStage = [&]() {
+        while (auto pair = decoded.pop()) {
+            try {
+                Stopwatch stopwatch;
+                visit(pair->start, pair->target, applyPool_);
+                visitClock.add(stopwatch);
+                pixels += static_cast<size_t>(pair->start.width) * pair->start.height;
+                ++succeeded;
+            } catch (const std::exception& e) {
+                std::cerr << "Error processing '" << jobs[pair->jobIndex].startPath << "' and '"
+                          << jobs[pair->jobIndex].targetPath << "': " << e.what() << std::endl;
+                ++failed;
+            }
+            pair.reset();
+            budget.release();
+        }
+    };
+    
+    std::vector<std::thread> decoders;
+    for (unsigned int i = 0; i < std::max(1u, options_.decodeThreads); ++i) {
+        decoders.emplace_back(decodeStage);
+    }
+    std::thread visitor(visitStage);
+    
+    for (std::thread& decoder : decoders) {
+        decoder.join();
+    }
+    decoded.close();
+    visitor.join();
+    
+    BatchResult result;
+    result.succeeded = succeeded;
+    result.failed = failed;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.decodeSeconds = decodeClock.seconds();
+    result.applySeconds = visitClock.seconds();
+    result.pixels = pixels;
+    return result;
+}
\ No newline at end of file
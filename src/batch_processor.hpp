@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include "color_correction_matrix_solver.hpp"
+#include "thread_pool.hpp"
+
+// One frame to correct: read from inputPath, written to outputPath
+struct BatchJob {
+    std::string inputPath;
+    std::string outputPath;
+};
+
+// One start/target pair of a joint fit
+struct PairJob {
+    std::string startPath;
+    std::string targetPath;
+};
+
+struct BatchOptions {
+    size_t maxFramesInFlight = 4;  // Frames decoded but not yet encoded; caps memory use
+    unsigned int decodeThreads = 1;
+    unsigned int encodeThreads = 1;
+};
+
+struct BatchResult {
+    size_t succeeded = 0;
+    size_t failed = 0;
+    double seconds = 0.0;
+    
+    // Busy time of each stage summed over its threads, and the pixels that went through apply
+    // (for image pairs, apply is the pair visitor and pixels counts each pair once)
+    double decodeSeconds = 0.0;
+    double applySeconds = 0.0;
+    double encodeSeconds = 0.0;
+    size_t pixels = 0;
+};
+
+// Streams frames through concurrent decode -> apply -> encode stages.
+// Decode and encode run on their own worker threads, apply splits each frame across the
+// shared thread pool, and a frame budget blocks decoding while too many frames are in flight.
+class BatchProcessor {
+public:
+    BatchProcessor(ThreadPool& applyPool, const BatchOptions& options);
+
+    // Jobs from a manifest file (one "<input> [output]" per line, '#' starts a comment)
+    // or from every image in a directory. Outputs without an explicit path go to outputDirectory.
+    static std::optional<std::vector<BatchJob>> collectJobs(const std::string& source,
+                                                            const std::optional<std::string>& outputDirectory);
+
+    // Correct every frame with the matrix via ApplyMatrixInto
+    BatchResult run(const std::vector<BatchJob>& jobs, const ColorCorrectionMatrix& matrix);
+
+    // Correct every frame with an arbitrary transform, e.g. a baked LUT. Outputs that can be memory-mapped
+    // (see ImageFileHandler::createMappedImage) are created when their frame is decoded and the transform
+    // writes straight into them, leaving encode nothing to do; otherwise output is the decoded frame itself,
+    // corrected in place so apply stays free of allocations, and encode saves it.
+    using FrameTransform = std::function<void(const ImageData& frame, ImageData& output, ThreadPool& threadPool)>;
+    BatchResult run(const std::vector<BatchJob>& jobs, const FrameTransform& transform);
+
+    // Pairs from a manifest file (one "<start> <target>" per line, '#' starts a comment)
+    static std::optional<std::vector<PairJob>> collectPairs(const std::string& manifest);
+
+    // Decode image pairs on the decode threads and hand each to visit, which can split it across the
+    // shared thread pool. Later pairs decode while earlier ones are visited, and the frame budget counts
+    // pairs. Pairs that fail to load or whose visit throws count as failed.
+    using PairVisitor = std::function<void(const ImageData& startImage, const ImageData& targetImage, ThreadPool& threadPool)>;
+    BatchResult run(const std::vector<PairJob>& jobs, const PairVisitor& visit);
+
+private:
+    ThreadPool& applyPool_;
+    BatchOptions options_;
+};
@@ -0,0 +1,15 @@
+#include <iostream>
+#include "solver_benchmark.hpp"
+
+int main(int argc, char* argv[])
+{
+    auto args = SolverBenchmark::parseArguments(argc, argv);
+    if (!args.has_value()) {
+        SolverBenchmark benchmark;
+        benchmark.printUsage(argv[0]);
+        return -1;
+    }
+    
+    SolverBenchmark benchmark;
+    return benchmark.run(args.value());
+}
@@ -0,0 +1,137 @@
+#include "buffer_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+// Sits just before every payload
+struct alignas(BufferPool::kAlignment) BlockHeader {
+    BufferPool* pool;  // nullptr for blocks too small to cache
+    size_t capacity;
+};
+
+static_assert(sizeof(BlockHeader) == BufferPool::kAlignment, "Header must keep the payload aligned");
+
+BlockHeader* newBlock(size_t capacity) {
+    return static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + capacity, std::align_val_t(BufferPool::kAlignment)));
+}
+
+void deleteBlock(void* raw) {
+    ::operator delete(raw, std::align_val_t(BufferPool::kAlignment));
+}
+
+}
+
+BufferPool::BufferPool(size_t maxCachedBytes) : maxCachedBytes_(maxCachedBytes) {}
+
+BufferPool::~BufferPool() {
+    for (auto& entry : freeBlocks_) {
+        for (void* header : entry.second) {
+            deleteBlock(header);
+        }
+    }
+}
+
+BufferPool& BufferPool::shared() {
+    // Leaked on purpose: buffers may still be released during static destruction
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+size_t BufferPool::sizeClass(size_t bytes) {
+    if (bytes < kMinPooledBytes) {
+        return bytes;
+    }
+    
+    // Four classes per power of two, so a block wastes at most a quarter of its size
+    size_t octave = kMinPooledBytes;
+    while (octave * 2 <= bytes) {
+        octave *= 2;
+    }
+    const size_t step = octave / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+void* BufferPool::allocate(size_t bytes) {
+    const size_t capacity = sizeClass(std::max<size_t>(bytes, 1));
+    
+    if (capacity >= kMinPooledBytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = freeBlocks_.find(capacity);
+        if (found != freeBlocks_.end() && !found->second.empty()) {
+            BlockHeader* header = static_cast<BlockHeader*>(found->second.back());
+            found->second.pop_back();
+            cachedBytes_ -= capacity;
+            return header + 1;
+        }
+    }
+    
+    BlockHeader* header = newBlock(capacity);
+    header->pool = capacity >= kMinPooledBytes ? this : nullptr;
+    header->capacity = capacity;
+    return header + 1;
+}
+
+void BufferPool::release(void* block) {
+    if (!block) {
+        return;
+    }
+    
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    if (header->pool) {
+        header->pool->recycle(header, header->capacity);
+    } else {
+        deleteBlock(header);
+    }
+}
+
+void BufferPool::recycle(void* header, size_t capacity) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cachedBytes_ + capacity <= maxCachedBytes_) {
+            freeBlocks_[capacity].push_back(header);
+            cachedBytes_ += capacity;
+            return;
+        }
+    }
+    deleteBlock(header);
+}
+
+void* BufferPool::reallocate(void* block, size_t bytes) {
+    if (!block) {
+        return shared().allocate(bytes);
+    }
+    
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    if (bytes <= header->capacity) {
+        return block;
+    }
+    
+    BufferPool& owner = header->pool ? *header->pool : shared();
+    void* grown = owner.allocate(bytes);
+    std::memcpy(grown, block, header->capacity);
+    release(block);
+    return grown;
+}
+
+ImageData BufferPool::allocateImage(int width, int height, int channels, SampleType sampleType) {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive");
+    }
+    
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.sampleType = sampleType;
+    image.data = std::unique_ptr<unsigned char, void(*)(void*)>(
+        static_cast<unsigned char*>(allocate(image.byteCount())), &BufferPool::release);
+    return image;
+}
+
+size_t BufferPool::cachedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cachedBytes_;
+}
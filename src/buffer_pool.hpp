@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "image_data.hpp"
+
+// Size-class cache of large pixel buffers so per-frame processing reuses memory that is
+// already mapped instead of allocating (and page-faulting) a fresh multi-megabyte block.
+// Each block carries a small header naming its pool, so release() fits the plain function
+// pointer deleter of ImageData. A pool must outlive every buffer it hands out.
+class BufferPool {
+public:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kMinPooledBytes = 64 * 1024; // Smaller blocks bypass the cache
+
+    explicit BufferPool(size_t maxCachedBytes = size_t(512) << 20);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Process-wide pool used by ApplyMatrix, the LUT and image decoding; never destroyed
+    static BufferPool& shared();
+
+    // 64-byte aligned block of at least bytes; return it with release()
+    void* allocate(size_t bytes);
+
+    // Return a block from any pool to its owner; nullptr is ignored
+    static void release(void* block);
+
+    // Grow or shrink a block, keeping its contents; reuses the block when it is large enough
+    static void* reallocate(void* block, size_t bytes);
+
+    // Uninitialized image whose storage comes from this pool
+    ImageData allocateImage(int width, int height, int channels, SampleType sampleType = SampleType::U8);
+
+    // Bytes currently cached for reuse
+    size_t cachedBytes() const;
+
+private:
+    static size_t sizeClass(size_t bytes);
+    void recycle(void* header, size_t capacity);
+
+    size_t maxCachedBytes_;
+    size_t cachedBytes_ = 0;
+    mutable std::mutex mutex_;
+    // Free blocks (header addresses) keyed by capacity
+    std::unordered_map<size_t, std::vector<void*>> freeBlocks_;
+};
@@ -0,0 +1,107 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "command_line.hpp"
+#include "line_channel.hpp"
+#include "stage_profiler.hpp"
+
+// Small client for trying the daemon locally: sends each request (from the arguments, or one per
+// line of stdin) over the daemon's socket and prints the responses as they arrive
+namespace {
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " --socket PATH [request...]" << std::endl;
+    std::cerr << "Sends each JSON request argument, or each line of stdin when there are none, and prints one" << std::endl;
+    std::cerr << "response line per request. Exits with 1 if any request failed." << std::endl;
+}
+
+int connectTo(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path '" << path << "' is too long" << std::endl;
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Error: Cannot connect to '" << path << "': " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::optional<std::string> socketPath;
+    std::vector<std::string> requests;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket") {
+            socketPath = CommandLine::optionValue(argc, argv, i);
+            if (!socketPath) {
+                printUsage(argv[0]);
+                return -1;
+            }
+        } else {
+            requests.push_back(arg);
+        }
+    }
+    if (!socketPath) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    const int fd = connectTo(*socketPath);
+    if (fd < 0) {
+        return -1;
+    }
+    LineChannel channel(fd, fd, true);
+
+    const Stopwatch stopwatch;
+    size_t sent = 0;
+    auto sendRequest = [&](const std::string& request) {
+        if (!request.empty() && channel.send(request)) {
+            ++sent;
+        }
+    };
+    if (requests.empty()) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            sendRequest(line);
+        }
+    } else {
+        for (const std::string& request : requests) {
+            sendRequest(request);
+        }
+    }
+    // The daemon answers what is queued and closes the connection once the last response is out
+    shutdown(fd, SHUT_WR);
+
+    size_t received = 0, failed = 0;
+    channel.receive([&](const std::string& response) {
+        ++received;
+        if (response.find("\"ok\":false") != std::string::npos) {
+            ++failed;
+        }
+        std::cout << response << std::endl;
+    });
+
+    std::cerr << received << " of " << sent << " responses, " << failed << " failed, in "
+              << stopwatch.seconds() * 1000.0 << " ms" << std::endl;
+    return received == sent && failed == 0 ? 0 : 1;
+}
\ No newline at end of file
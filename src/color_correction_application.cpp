@@ -1,39 +1,409 @@
 #include "color_correction_application.hpp"
+#include "batch_processor.hpp"
+#include "color_correction_kernels.hpp"
+#include "color_correction_matrix_io.hpp"
+#include "command_line.hpp"
+#include "matrix_apply_application.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <vector>
+
+namespace {
+
+std::optional<SolverMode> parseSolverMode(const std::string& value) {
+    auto mode = ParseSolverMode(value);
+    if (!mode) {
+        std::cerr << "Error: Unknown solver mode '" << value << "' (expected 'normal' or 'ceres')" << std::endl;
+    }
+    return mode;
+}
+
+std::optional<SamplingMode> parseSamplingMode(const std::string& value) {
+    auto mode = ParseSamplingMode(value);
+    if (!mode) {
+        std::cerr << "Error: Unknown sampling mode '" << value << "' (expected 'none', 'stride', 'random' or 'stratified')" << std::endl;
+    }
+    return mode;
+}
+
+std::optional<RobustLoss> parseRobustLoss(const std::string& value) {
+    auto loss = ParseRobustLoss(value);
+    if (!loss) {
+        std::cerr << "Error: Unknown robust loss '" << value << "' (expected 'none', 'huber' or 'cauchy')" << std::endl;
+    }
+    return loss;
+}
+
+// "<columns>x<rows>", e.g. 8x6
+bool parseTileGrid(const std::string& value, TileOptions& tiles) {
+    int columns = 0, rows = 0, consumed = 0;
+    if (std::sscanf(value.c_str(), "%dx%d%n", &columns, &rows, &consumed) != 2 || consumed != static_cast<int>(value.size()) ||
+        columns < 1 || rows < 1) {
+        std::cerr << "Error: Invalid tile grid '" << value << "' (expected COLUMNSxROWS, e.g. 8x6)" << std::endl;
+        return false;
+    }
+    tiles.columns = columns;
+    tiles.rows = rows;
+    return true;
+}
+
+void printTiledCorrection(const TiledCorrection& correction) {
+    std::cout << "Tile matrices (" << correction.columns << "x" << correction.rows << " grid"
+              << (correction.space == WorkingSpace::Linear ? ", linear light" : "") << "), row-major:" << std::endl;
+    const Eigen::IOFormat oneLine(Eigen::StreamPrecision, Eigen::DontAlignCols, " ", "  ");
+    for (int r = 0; r < correction.rows; ++r) {
+        for (int c = 0; c < correction.columns; ++c) {
+            std::cout << "  (" << c << ", " << r << "): " << correction.tile(c, r).format(oneLine) << std::endl;
+        }
+    }
+}
+
+void printCorrection(const ColorCorrectionMatrix& matrix) {
+    std::cout << (matrix.space == WorkingSpace::Linear ? "Matrix (linear light):" : "Matrix:") << std::endl;
+    std::cout << matrix.matrix << std::endl;
+    if (matrix.terms.cols() > 0) {
+        std::cout << "Terms (" << CorrectionModelName(matrix.model) << " model):" << std::endl;
+        std::cout << matrix.terms << std::endl;
+    }
+}
+
+} // namespace
 
 std::optional<ColorCorrectionApplication::Arguments> 
 ColorCorrectionApplication::parseArguments(int argc, char* argv[]) {
-    if (argc != 3 && argc != 4) {
+    Arguments args;
+    std::vector<std::string> positional;
+    bool samplingModeSet = false;
+    bool seedSet = false;
+    bool pyramidSet = false;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--solver") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto mode = value ? parseSolverMode(*value) : std::nullopt;
+            if (!mode) {
+                return std::nullopt;
+            }
+            args.solverOptions.mode = *mode;
+        } else if (arg == "--threads") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parseCount(*value, "thread count", UINT_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.threadCount = static_cast<unsigned int>(*count);
+        } else if (arg == "--sampling") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto mode = value ? parseSamplingMode(*value) : std::nullopt;
+            if (!mode) {
+                return std::nullopt;
+            }
+            args.solverOptions.sampling.mode = *mode;
+            samplingModeSet = true;
+        } else if (arg == "--max-samples") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parseCount(*value, "sample count", SIZE_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.solverOptions.sampling.maxSamples = static_cast<size_t>(*count);
+        } else if (arg == "--seed") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto seed = value ? CommandLine::parseCount(*value, "seed", UINT32_MAX) : std::nullopt;
+            if (!seed) {
+                return std::nullopt;
+            }
+            args.solverOptions.sampling.seed = static_cast<uint32_t>(*seed);
+            seedSet = true;
+        } else if (arg == "--robust") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto loss = value ? parseRobustLoss(*value) : std::nullopt;
+            if (!loss) {
+                return std::nullopt;
+            }
+            args.solverOptions.robust.loss = *loss;
+        } else if (arg == "--robust-scale") {
+            // Given in 8-bit code values; the solver works on the 0..1 scale of its working space
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto scale = value ? CommandLine::parsePositive(*value, "robust scale") : std::nullopt;
+            if (!scale) {
+                return std::nullopt;
+            }
+            args.solverOptions.robust.scale = *scale / 255.0;
+        } else if (arg == "--robust-iterations") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parsePositiveCount(*value, "iteration count", INT_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.solverOptions.robust.maxIterations = static_cast<int>(*count);
+        } else if (arg == "--pyramid-levels") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parsePositiveCount(*value, "pyramid level count", INT_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.solverOptions.pyramidLevels = static_cast<int>(*count);
+            pyramidSet = true;
+        } else if (arg == "--pyramid-iterations") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parsePositiveCount(*value, "iteration count", INT_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.solverOptions.pyramidIterations = static_cast<int>(*count);
+            pyramidSet = true;
+        } else if (arg == "--initial-matrix") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto guess = value ? ColorCorrectionMatrixIO::load(*value) : std::nullopt;
+            if (!guess) {
+                return std::nullopt;
+            }
+            args.solverOptions.initialGuess = *guess;
+        } else if (arg == "--model") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto model = value ? ParseCorrectionModel(*value) : std::nullopt;
+            if (!model) {
+                if (value) {
+                    std::cerr << "Error: Unknown correction model '" << *value << "' (expected 'linear', 'affine', 'rp2' or 'rp3')" << std::endl;
+                }
+                return std::nullopt;
+            }
+            args.solverOptions.model = *model;
+        } else if (arg == "--space") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto space = value ? ParseWorkingSpace(*value) : std::nullopt;
+            if (!space) {
+                if (value) {
+                    std::cerr << "Error: Unknown working space '" << *value << "' (expected 'linear' or 'encoded')" << std::endl;
+                }
+                return std::nullopt;
+            }
+            args.solverOptions.space = *space;
+        } else if (arg == "--tiles") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value || !parseTileGrid(*value, args.solverOptions.tiles)) {
+                return std::nullopt;
+            }
+        } else if (arg == "--tile-smoothing") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto smoothing = value ? CommandLine::parseNonNegative(*value, "tile smoothing") : std::nullopt;
+            if (!smoothing) {
+                return std::nullopt;
+            }
+            args.solverOptions.tiles.smoothing = *smoothing;
+        } else if (arg == "--mask-saturated") {
+            args.solverOptions.robust.maskSaturated = true;
+        } else if (arg == "--no-color-pairs") {
+            args.solverOptions.compressColorPairs = false;
+        } else if (arg == "--batch") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.batchSource = *value;
+        } else if (arg == "--pairs") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.pairsManifest = *value;
+        } else if (arg == "--output-dir") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.outputDirectory = *value;
+        } else if (arg == "--matrix") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.matrixPath = *value;
+        } else if (arg == "--save-matrix") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.saveMatrixPath = *value;
+        } else if (arg == "--export-cube") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.cubePath = *value;
+        } else if (arg == "--cube-size") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto size = value ? MatrixApplyApplication::parseLutSize(*value) : std::nullopt;
+            if (!size) {
+                return std::nullopt;
+            }
+            args.cubeSize = *size;
+        } else if (arg == "--frames-in-flight") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parsePositiveCount(*value, "frame count", SIZE_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.maxFramesInFlight = static_cast<size_t>(*count);
+        } else if (arg == "--stream") {
+            args.stream = true;
+        } else if (arg == "--strip-rows") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            auto count = value ? CommandLine::parsePositiveCount(*value, "strip height", INT_MAX) : std::nullopt;
+            if (!count) {
+                return std::nullopt;
+            }
+            args.stripRows = static_cast<int>(*count);
+        } else if (arg == "--profile") {
+            args.profile = true;
+        } else if (arg == "--profile-json") {
+            auto value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+            args.profile = true;
+            args.profileJsonPath = *value;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown option '" << arg << "'" << std::endl;
+            return std::nullopt;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    
+    if (args.batchSource.has_value()) {
+        // The batch matrix is loaded, solved from a start/target pair, or solved jointly over --pairs
+        const int sources = (args.matrixPath.has_value() ? 1 : 0) + (args.pairsManifest.has_value() ? 1 : 0);
+        bool validSource = sources == 1 ? positional.empty() : sources == 0 && positional.size() == 2;
+        if (!validSource) {
+            std::cerr << "Error: Batch mode needs either --matrix, --pairs or a start and target image" << std::endl;
+            return std::nullopt;
+        }
+    } else if (args.pairsManifest.has_value()) {
+        if (!positional.empty() || args.matrixPath.has_value() || args.outputDirectory.has_value()) {
+            std::cerr << "Error: --pairs takes no image paths; use --batch to correct frames with the joint matrix" << std::endl;
+            return std::nullopt;
+        }
+    } else if (args.matrixPath.has_value() || args.outputDirectory.has_value()) {
+        std::cerr << "Error: --matrix and --output-dir are only valid with --batch" << std::endl;
+        return std::nullopt;
+    } else if (positional.size() != 2 && positional.size() != 3) {
         return std::nullopt;
     }
     
-    Arguments args;
-    args.startImagePath = argv[1];
-    args.targetImagePath = argv[2];
-    if (argc == 4) {
-        args.outputImagePath = argv[3];
+    if (args.solverOptions.model != CorrectionModel::Linear && args.solverOptions.mode == SolverMode::Ceres) {
+        std::cerr << "Error: --solver ceres fits only the linear model" << std::endl;
+        return std::nullopt;
+    }
+    
+    // A sample budget on its own implies random sampling; a sampling mode on its own gets a default budget
+    SamplingOptions& sampling = args.solverOptions.sampling;
+    if (!samplingModeSet && sampling.maxSamples > 0) {
+        sampling.mode = SamplingMode::Random;
+    }
+    if (sampling.mode != SamplingMode::None && sampling.maxSamples == 0) {
+        sampling.maxSamples = SamplingOptions::kDefaultMaxSamples;
+    }
+    
+    if (args.stream && (args.batchSource.has_value() || args.pairsManifest.has_value() || args.solverOptions.mode != SolverMode::NormalEquations ||
+                        args.solverOptions.model != CorrectionModel::Linear ||
+                        sampling.mode != SamplingMode::None || seedSet || args.solverOptions.robust.loss != RobustLoss::None ||
+                        args.solverOptions.robust.maskSaturated || pyramidSet || args.solverOptions.initialGuess.has_value())) {
+        std::cerr << "Error: --stream supports only single-image runs with the plain normal-equations solver, the linear model and no sampling,"
+                  << " pyramid or initial matrix" << std::endl;
+        return std::nullopt;
+    }
+    
+    const TileOptions& tiles = args.solverOptions.tiles;
+    if ((tiles.columns > 1 || tiles.rows > 1) &&
+        (args.batchSource.has_value() || args.pairsManifest.has_value() || args.stream || args.saveMatrixPath.has_value() ||
+         args.cubePath.has_value() || args.solverOptions.mode != SolverMode::NormalEquations ||
+         args.solverOptions.model != CorrectionModel::Linear || sampling.mode != SamplingMode::None ||
+         sampling.maxSamples > 0 || args.solverOptions.robust.loss != RobustLoss::None)) {
+        std::cerr << "Error: --tiles supports only single-image runs with the plain normal-equations solver, the linear model and no sampling;"
+                  << " tiled corrections cannot be saved or exported" << std::endl;
+        return std::nullopt;
+    }
+    
+    if (positional.size() >= 2) {
+        args.startImagePath = positional[0];
+        args.targetImagePath = positional[1];
+    }
+    if (positional.size() == 3) {
+        args.outputImagePath = positional[2];
     }
     
     return args;
 }
 
 int ColorCorrectionApplication::run(const Arguments& args) {
+    profiler_.setEnabled(args.profile);
+    
+    int status;
+    if (args.batchSource.has_value()) {
+        status = runBatch(args);
+    } else if (args.pairsManifest.has_value()) {
+        status = runPairs(args);
+    } else if (args.stream) {
+        status = runStreaming(args);
+    } else {
+        status = runSingle(args);
+    }
+    
+    if (!profiler_.report(args.profileJsonPath)) {
+        return -1;
+    }
+    return status;
+}
+
+int ColorCorrectionApplication::runSingle(const Arguments& args) {
     ImageData startImage, targetImage;
     if (!loadAndValidateImages(args, startImage, targetImage)) {
         return -1;
     }
     
+    ThreadPool threadPool(args.threadCount);
+    const TileOptions& tiles = args.solverOptions.tiles;
+    if (tiles.columns > 1 || tiles.rows > 1) {
+        TiledCorrection correction;
+        if (!solveTiledCorrection(startImage, targetImage, args.solverOptions, threadPool, correction)) {
+            return -1;
+        }
+        std::cout << "Tiled color correction solved successfully!" << std::endl;
+        printTiledCorrection(correction);
+        if (!args.outputImagePath.has_value()) {
+            std::cout << "\nNo output path specified. Tiled correction solved but not applied." << std::endl;
+            return 0;
+        }
+        const std::string description = std::to_string(tiles.columns) + "x" + std::to_string(tiles.rows) + " tiled correction";
+        return correctAndSave(startImage, description, args.outputImagePath.value(), threadPool,
+                              [&](const ImageData& input, ImageData& output) {
+                                  ColorCorrectionMatrixSolver::ApplyTiledInto(input, output, correction, &threadPool);
+                              }) ? 0 : -1;
+    }
+    
     ColorCorrectionMatrix matrix;
-    if (!solveColorCorrectionMatrix(startImage, targetImage, matrix)) {
+    if (!solveColorCorrectionMatrix(startImage, targetImage, args.solverOptions, threadPool, matrix)) {
         return -1;
     }
     
     std::cout << "Color correction matrix solved successfully!" << std::endl;
-    std::cout << "Matrix:" << std::endl;
-    std::cout << matrix.matrix << std::endl;
+    printCorrection(matrix);
+    
+    if (args.saveMatrixPath.has_value() && !saveMatrix(matrix, args.saveMatrixPath.value())) {
+        return -1;
+    }
+    if (args.cubePath.has_value() && !MatrixApplyApplication::exportCube(matrix, args.cubeSize, args.cubePath.value())) {
+        return -1;
+    }
     
     if (args.outputImagePath.has_value()) {
-        if (!applyCorrectionAndSave(startImage, matrix, args.outputImagePath.value())) {
+        if (!applyCorrectionAndSave(startImage, matrix, args.outputImagePath.value(), threadPool)) {
             return -1;
         }
     } else {
@@ -43,21 +413,175 @@ int ColorCorrectionApplication::run(const Arguments& args) {
     return 0;
 }
 
+int ColorCorrectionApplication::runBatch(const Arguments& args) {
+    ColorCorrectionMatrix matrix;
+    if (args.matrixPath.has_value()) {
+        auto loaded = ColorCorrectionMatrixIO::load(args.matrixPath.value());
+        if (!loaded.has_value()) {
+            return -1;
+        }
+        matrix = loaded.value();
+        std::cout << "Loaded color correction matrix from: " << args.matrixPath.value() << std::endl;
+    } else if (args.pairsManifest.has_value()) {
+        ThreadPool threadPool(args.threadCount);
+        if (!solveJointMatrix(args, threadPool, matrix)) {
+            return -1;
+        }
+        if (args.saveMatrixPath.has_value() && !saveMatrix(matrix, args.saveMatrixPath.value())) {
+            return -1;
+        }
+    } else {
+        // Solve once and reuse the matrix for every frame
+        ImageData startImage, targetImage;
+        ThreadPool threadPool(args.threadCount);
+        if (!loadAndValidateImages(args, startImage, targetImage) ||
+            !solveColorCorrectionMatrix(startImage, targetImage, args.solverOptions, threadPool, matrix)) {
+            return -1;
+        }
+        if (args.saveMatrixPath.has_value() && !saveMatrix(matrix, args.saveMatrixPath.value())) {
+            return -1;
+        }
+    }
+    if (args.cubePath.has_value() && !MatrixApplyApplication::exportCube(matrix, args.cubeSize, args.cubePath.value())) {
+        return -1;
+    }
+    printCorrection(matrix);
+    
+    return MatrixApplyApplication::runBatch(matrix, args.batchSource.value(), args.outputDirectory,
+                                            args.threadCount, args.maxFramesInFlight, LutOptions(), &profiler_);
+}
+
+int ColorCorrectionApplication::runStreaming(const Arguments& args) {
+    ColorCorrectionMatrix matrix;
+    
+    try {
+        // Pass 1: accumulate the normal equations strip by strip
+        auto startReader = ImageFileHandler::openReader(args.startImagePath);
+        auto targetReader = ImageFileHandler::openReader(args.targetImagePath);
+        if (!startReader || !targetReader) {
+            return -1;
+        }
+        
+        std::cout << "Streaming " << startReader->width() << "x" << startReader->height() << " images in strips of "
+                  << args.stripRows << " rows..." << std::endl;
+        auto scope = profiler_.measure("stream.solve", static_cast<size_t>(startReader->width()) * startReader->height());
+        const WorkingSpace space = args.solverOptions.space;
+        matrix = ColorCorrectionMatrixSolver::AccumulateNormalEquations(*startReader, *targetReader, args.stripRows, space).solve();
+        matrix.space = space;
+    } catch (const std::exception& e) {
+        std::cerr << "Error solving color correction matrix: " << e.what() << std::endl;
+        return -1;
+    }
+    
+    std::cout << "Color correction matrix solved successfully!" << std::endl;
+    printCorrection(matrix);
+    
+    if (args.saveMatrixPath.has_value() && !saveMatrix(matrix, args.saveMatrixPath.value())) {
+        return -1;
+    }
+    if (args.cubePath.has_value() && !MatrixApplyApplication::exportCube(matrix, args.cubeSize, args.cubePath.value())) {
+        return -1;
+    }
+    if (!args.outputImagePath.has_value()) {
+        return 0;
+    }
+    
+    // Pass 2: re-read the start image and correct it strip by strip
+    return MatrixApplyApplication::applyStreaming(matrix, LutOptions(), args.startImagePath, args.outputImagePath.value(),
+                                                  args.stripRows, args.threadCount, &profiler_);
+}
+
+int ColorCorrectionApplication::runPairs(const Arguments& args) {
+    ThreadPool threadPool(args.threadCount);
+    ColorCorrectionMatrix matrix;
+    if (!solveJointMatrix(args, threadPool, matrix)) {
+        return -1;
+    }
+    
+    std::cout << "Color correction matrix solved successfully!" << std::endl;
+    printCorrection(matrix);
+    
+    if (args.saveMatrixPath.has_value() && !saveMatrix(matrix, args.saveMatrixPath.value())) {
+        return -1;
+    }
+    if (args.cubePath.has_value() && !MatrixApplyApplication::exportCube(matrix, args.cubeSize, args.cubePath.value())) {
+        return -1;
+    }
+    if (!args.saveMatrixPath.has_value() && !args.cubePath.has_value()) {
+        std::cout << "\nNo --save-matrix or --export-cube given. Matrix solved but not stored." << std::endl;
+    }
+    return 0;
+}
+
+bool ColorCorrectionApplication::solveJointMatrix(const Arguments& args, ThreadPool& threadPool, ColorCorrectionMatrix& matrix) {
+    auto jobs = BatchProcessor::collectPairs(args.pairsManifest.value());
+    if (!jobs.has_value()) {
+        return false;
+    }
+    
+    // Decoding dominates, so decoders get half the cores while the rest accumulate the decoded pairs
+    BatchOptions options;
+    options.maxFramesInFlight = args.maxFramesInFlight;
+    options.decodeThreads = std::max(1u, threadPool.threadCount() / 2);
+    
+    std::cout << "\nAccumulating " << jobs->size() << " image pairs for a joint fit..." << std::endl;
+    try {
+        ColorCorrectionMatrixSolver solver(args.solverOptions);
+        BatchProcessor processor(threadPool, options);
+        BatchResult result = processor.run(*jobs, [&solver](const ImageData& startImage, const ImageData& targetImage, ThreadPool& pool) {
+            solver.AddPair(startImage, targetImage, &pool);
+        });
+        
+        profiler_.record("pairs.decode (busy)", result.decodeSeconds, 2 * result.pixels);
+        profiler_.record("pairs.accumulate (busy)", result.applySeconds, result.pixels);
+        profiler_.record("pairs.total", result.seconds, result.pixels);
+        if (result.failed > 0) {
+            // A calibration silently missing shots is worse than none
+            std::cerr << "Error: " << result.failed << " of " << jobs->size() << " image pairs could not be used" << std::endl;
+            return false;
+        }
+        
+        matrix = solver.SolvePairs(&threadPool);
+        std::cout << "Fitted " << result.succeeded << " pairs in " << result.seconds << " s" << std::endl;
+        
+        const SolveReport& report = solver.GetReport();
+        profiler_.record("solve.setup", report.setupSeconds, result.pixels);
+        profiler_.record("solve.minimize", report.minimizeSeconds);
+        printSolveReport(report, args.solverOptions);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error solving color correction matrix: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool ColorCorrectionApplication::saveMatrix(const ColorCorrectionMatrix& matrix, const std::string& path) {
+    if (!ColorCorrectionMatrixIO::save(matrix, path)) {
+        return false;
+    }
+    std::cout << "Saved color correction matrix to: " << path << std::endl;
+    return true;
+}
+
 bool ColorCorrectionApplication::loadAndValidateImages(const Arguments& args, 
                                                       ImageData& startImage, 
                                                       ImageData& targetImage) {
     // Load start image
+    Stopwatch decodeStart;
     startImage = ImageFileHandler::loadImage(args.startImagePath);
     if (!startImage.isValid()) {
         return false;
     }
+    profiler_.record("decode.start", decodeStart.seconds(), static_cast<size_t>(startImage.width) * startImage.height);
     ImageFileHandler::printImageInfo(startImage, args.startImagePath);
     
     // Load target image
+    Stopwatch decodeTarget;
     targetImage = ImageFileHandler::loadImage(args.targetImagePath);
     if (!targetImage.isValid()) {
         return false;
     }
+    profiler_.record("decode.target", decodeTarget.seconds(), static_cast<size_t>(targetImage.width) * targetImage.height);
     ImageFileHandler::printImageInfo(targetImage, args.targetImagePath);
     
     // Validate dimensions
@@ -71,12 +595,26 @@ bool ColorCorrectionApplication::loadAndValidateImages(const Arguments& args,
 
 bool ColorCorrectionApplication::solveColorCorrectionMatrix(const ImageData& startImage, 
                                                           const ImageData& targetImage, 
+                                                          const SolverOptions& options,
+                                                          ThreadPool& threadPool,
                                                           ColorCorrectionMatrix& matrix) {
     std::cout << "\nSolving color correction matrix..." << std::endl;
     
     try {
-        ColorCorrectionMatrixSolver solver;
-        matrix = solver.Solve(startImage, targetImage);
+        ColorCorrectionMatrixSolver solver(options);
+        matrix = solver.Solve(startImage, targetImage, &threadPool);
+        
+        const SolveReport& report = solver.GetReport();
+        const size_t totalPixels = static_cast<size_t>(startImage.width) * startImage.height;
+        if (report.pyramidLevels > 0) {
+            profiler_.record("solve.pyramid", report.pyramidSeconds, totalPixels);
+        }
+        profiler_.record("solve.setup", report.setupSeconds, totalPixels);
+        profiler_.record("solve.minimize", report.minimizeSeconds);
+        if (report.heldOutPixels > 0) {
+            profiler_.record("solve.evaluate", report.evaluationSeconds, report.heldOutPixels);
+        }
+        printSolveReport(report, options);
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error solving color correction matrix: " << e.what() << std::endl;
@@ -84,15 +622,87 @@ bool ColorCorrectionApplication::solveColorCorrectionMatrix(const ImageData& sta
     }
 }
 
-bool ColorCorrectionApplication::applyCorrectionAndSave(const ImageData& startImage, 
+bool ColorCorrectionApplication::solveTiledCorrection(const ImageData& startImage, const ImageData& targetImage,
+                                                      const SolverOptions& options, ThreadPool& threadPool,
+                                                      TiledCorrection& correction) {
+    std::cout << "\nSolving " << options.tiles.columns << "x" << options.tiles.rows << " tile matrices (smoothing "
+              << options.tiles.smoothing << ")..." << std::endl;
+    
+    try {
+        ColorCorrectionMatrixSolver solver(options);
+        correction = solver.SolveTiled(startImage, targetImage, &threadPool);
+        
+        const SolveReport& report = solver.GetReport();
+        profiler_.record("solve.setup", report.setupSeconds, static_cast<size_t>(startImage.width) * startImage.height);
+        profiler_.record("solve.minimize", report.minimizeSeconds);
+        printSolveReport(report, options);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error solving tiled color correction: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void ColorCorrectionApplication::printSolveReport(const SolveReport& report, const SolverOptions& options) {
+    if (report.maskedPixels > 0) {
+        std::cout << "Left out " << report.maskedPixels << " saturated pixels" << std::endl;
+    }
+    if (report.colorPairs > 0) {
+        std::cout << "Compressed " << report.pixelsUsed << " pixels to " << report.colorPairs
+                  << " distinct color pairs" << std::endl;
+    }
+    if (options.robust.loss != RobustLoss::None) {
+        std::cout << "Robust fit: " << report.inlierFraction * 100.0 << "% of " << report.pixelsUsed
+                  << " pixels within " << options.robust.scale * 255.0 << " code values";
+        if (report.robustIterations > 0) {
+            std::cout << " after " << report.robustIterations << " reweighting passes";
+        }
+        std::cout << std::endl;
+    }
+    if (report.pyramidLevels > 0) {
+        std::cout << "Warm-started from " << report.pyramidLevels << " coarser levels solved in "
+                  << report.pyramidSeconds << " s" << std::endl;
+    }
+    if (report.heldOutPixels > 0) {
+        std::cout << "Fitted on " << report.pixelsUsed << " sampled pixels; held-out RMS error over "
+                  << report.heldOutPixels << " pixels: " << report.heldOutRmse << " (8-bit code values)" << std::endl;
+    }
+}
+
+bool ColorCorrectionApplication::applyCorrectionAndSave(ImageData& startImage, 
                                                        const ColorCorrectionMatrix& matrix, 
-                                                       const std::string& outputPath) {
-    std::cout << "\nApplying color correction matrix to start image..." << std::endl;
+                                                       const std::string& outputPath,
+                                                       ThreadPool& threadPool) {
+    return correctAndSave(startImage, "color correction matrix", outputPath, threadPool, [&](const ImageData& input, ImageData& output) {
+        ColorCorrectionMatrixSolver::ApplyMatrixInto(input, output, matrix, &threadPool);
+    });
+}
+
+bool ColorCorrectionApplication::correctAndSave(ImageData& startImage, const std::string& description, const std::string& outputPath,
+                                               ThreadPool& threadPool, const std::function<void(const ImageData&, ImageData&)>& apply) {
+    std::cout << "\nApplying " << description << " to start image ("
+              << ApplyKernelName(SelectApplyKernel()) << " kernel, " << threadPool.threadCount() << " threads)..." << std::endl;
     
     try {
-        ImageData correctedImage = ColorCorrectionMatrixSolver::ApplyMatrix(startImage, matrix);
+        const size_t pixels = static_cast<size_t>(startImage.width) * startImage.height;
+        // PPM and raw outputs are mapped and corrected into directly; otherwise the start image, which
+        // is not needed after solving, is corrected in place and encoded
+        ImageData outputImage = ImageFileHandler::createMappedImage(outputPath, startImage);
+        {
+            auto scope = profiler_.measure("apply", pixels);
+            apply(startImage, outputImage.isValid() ? outputImage : startImage);
+        }
         
-        if (ImageFileHandler::saveImage(correctedImage, outputPath)) {
+        bool saved = true;
+        {
+            auto scope = profiler_.measure("encode", pixels);
+            if (outputImage.isValid()) {
+                outputImage = ImageData(); // Unmaps, completing the file
+            } else {
+                saved = ImageFileHandler::saveImage(startImage, outputPath);
+            }
+        }
+        if (saved) {
             std::cout << "Color-corrected image saved as: " << outputPath << std::endl;
             return true;
         } else {
@@ -106,6 +716,38 @@ bool ColorCorrectionApplication::applyCorrectionAndSave(const ImageData& startIm
 }
 
 void ColorCorrectionApplication::printUsage(const char* programName) {
-    std::cerr << "Usage: " << programName << " <start_image_path> <target_image_path> [output_image_path]" << std::endl;
+    std::cerr << "Usage: " << programName << " [options] <start_image_path> <target_image_path> [output_image_path]" << std::endl;
+    std::cerr << "       " << programName << " [options] --batch <manifest|directory> [--output-dir <dir>] (--matrix <file> | --pairs <manifest> | <start_image_path> <target_image_path>)" << std::endl;
+    std::cerr << "       " << programName << " [options] --pairs <manifest> [--save-matrix <file>] [--export-cube <file>]" << std::endl;
     std::cerr << "  If output_image_path is provided, the corrected image will be saved to that path." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --solver normal|ceres   Closed-form normal equations (default) or per-pixel Ceres problem" << std::endl;
+    std::cerr << "  --model MODEL           linear|affine|rp2|rp3 correction: 3x3, 3x4 with offset, or root-polynomial (default: linear)" << std::endl;
+    std::cerr << "  --space SPACE           linear|encoded: fit in linear light or on the stored sRGB values (default: linear)" << std::endl;
+    std::cerr << "  --threads N             Worker threads for solving and applying (default: all cores)" << std::endl;
+    std::cerr << "  --sampling MODE         none|stride|random|stratified pixel sampling before solving (default: none)" << std::endl;
+    std::cerr << "  --max-samples N         Sample budget for the solver (default with --sampling: " << SamplingOptions::kDefaultMaxSamples << ")" << std::endl;
+    std::cerr << "  --seed N                Seed for random and stratified sampling (default: 0)" << std::endl;
+    std::cerr << "  --robust LOSS           none|huber|cauchy loss to down-weight outliers (default: none)" << std::endl;
+    std::cerr << "  --robust-scale N        Residual in 8-bit steps of the working scale where the robust loss takes over (default: 5.1)" << std::endl;
+    std::cerr << "  --robust-iterations N   Maximum reweighting passes of the normal-equations solver (default: 10)" << std::endl;
+    std::cerr << "  --pyramid-levels N      Solve 2x-downsampled levels first, each warm-starting the next (robust and Ceres fits; default: 1)" << std::endl;
+    std::cerr << "  --pyramid-iterations N  Reweighting passes or Ceres iterations per warm-started finer level (default: 3)" << std::endl;
+    std::cerr << "  --initial-matrix FILE   Start robust and Ceres fits from a saved matrix, e.g. the previous frame's" << std::endl;
+    std::cerr << "  --tiles CxR             Fit a matrix per tile of a C x R grid, blended per pixel (single-image runs; default: 1x1)" << std::endl;
+    std::cerr << "  --tile-smoothing S      Pull of each tile toward its neighbors relative to its own pixels; 0 fits tiles independently (default: 0.1)" << std::endl;
+    std::cerr << "  --mask-saturated        Leave out pixels with a channel at either end of its range in either image" << std::endl;
+    std::cerr << "  --no-color-pairs        Reweight over every pixel instead of distinct color pairs" << std::endl;
+    std::cerr << "  --batch SOURCE          Correct every frame in a manifest (\"<input> [output]\" per line) or directory" << std::endl;
+    std::cerr << "  --pairs MANIFEST        Fit one matrix jointly over every \"<start> <target>\" pair in a manifest" << std::endl;
+    std::cerr << "  --output-dir DIR        Destination for batch frames without an explicit output path" << std::endl;
+    std::cerr << "  --matrix FILE           Batch with a stored matrix instead of solving" << std::endl;
+    std::cerr << "  --save-matrix FILE      Save the solved matrix (.ccmb for binary, text otherwise)" << std::endl;
+    std::cerr << "  --export-cube FILE      Write the solved correction as a .cube LUT" << std::endl;
+    std::cerr << "  --cube-size N           Lattice size of the exported .cube (default: 33)" << std::endl;
+    std::cerr << "  --frames-in-flight N    Maximum frames (or --pairs pairs) held in memory by the pipeline (default: 4)" << std::endl;
+    std::cerr << "  --stream                Solve and apply from row strips (PPM streams from disk; other formats decode once)" << std::endl;
+    std::cerr << "  --strip-rows N          Rows per strip in streaming mode (default: 64)" << std::endl;
+    std::cerr << "  --profile               Report wall time, MP/s and peak RSS per stage" << std::endl;
+    std::cerr << "  --profile-json FILE     Also write the stage report as JSON" << std::endl;
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <optional>
 #include "image_file_handler.hpp"
 #include "color_correction_matrix_solver.hpp"
+#include "stage_profiler.hpp"
+#include "thread_pool.hpp"
 
 class ColorCorrectionApplication {
 public:
@@ -11,6 +14,28 @@ public:
         std::string startImagePath;
         std::string targetImagePath;
         std::optional<std::string> outputImagePath;
+        SolverOptions solverOptions;
+        unsigned int threadCount = 0; // 0 uses every hardware thread
+        
+        // Batch mode: correct every frame listed in a manifest or found in a directory
+        std::optional<std::string> batchSource;
+        std::optional<std::string> outputDirectory;
+        std::optional<std::string> matrixPath; // Use a stored matrix instead of solving
+        
+        // Joint fit: one matrix over every "<start> <target>" pair in a manifest
+        std::optional<std::string> pairsManifest;
+        std::optional<std::string> saveMatrixPath;
+        std::optional<std::string> cubePath; // Export the solved correction as a .cube LUT
+        int cubeSize = 33;
+        size_t maxFramesInFlight = 4;
+        
+        // Streaming mode: process row strips so memory does not scale with the frame size
+        bool stream = false;
+        int stripRows = 64;
+        
+        // Report per-stage timings, optionally as JSON
+        bool profile = false;
+        std::optional<std::string> profileJsonPath;
     };
 
     // Parse command line arguments
@@ -23,7 +48,22 @@ public:
     void printUsage(const char* programName);
 
 private:
+    int runSingle(const Arguments& args);
+    int runBatch(const Arguments& args);
+    int runStreaming(const Arguments& args);
+    int runPairs(const Arguments& args);
+    bool saveMatrix(const ColorCorrectionMatrix& matrix, const std::string& path);
     bool loadAndValidateImages(const Arguments& args, ImageData& startImage, ImageData& targetImage);
-    bool solveColorCorrectionMatrix(const ImageData& startImage, const ImageData& targetImage, ColorCorrectionMatrix& matrix);
-    bool applyCorrectionAndSave(const ImageData& startImage, const ColorCorrectionMatrix& matrix, const std::string& outputPath);
+    bool solveColorCorrectionMatrix(const ImageData& startImage, const ImageData& targetImage, const SolverOptions& options, ThreadPool& threadPool,
+                                    ColorCorrectionMatrix& matrix);
+    bool solveJointMatrix(const Arguments& args, ThreadPool& threadPool, ColorCorrectionMatrix& matrix);
+    bool solveTiledCorrection(const ImageData& startImage, const ImageData& targetImage, const SolverOptions& options, ThreadPool& threadPool,
+                              TiledCorrection& correction);
+    void printSolveReport(const SolveReport& report, const SolverOptions& options);
+    bool applyCorrectionAndSave(ImageData& startImage, const ColorCorrectionMatrix& matrix, const std::string& outputPath, ThreadPool& threadPool);
+    // Correct the start image with apply(input, output) into the mapped output file, or in place and then encoded
+    bool correctAndSave(ImageData& startImage, const std::string& description, const std::string& outputPath, ThreadPool& threadPool,
+                        const std::function<void(const ImageData&, ImageData&)>& apply);
+
+    StageProfiler profiler_;
 };
\ No newline at end of file
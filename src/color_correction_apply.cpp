@@ -0,0 +1,173 @@
+#include "color_correction_matrix_solver.hpp"
+#include "buffer_pool.hpp"
+#include "color_correction_kernels.hpp"
+#include "image_stream.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void ValidateApplyImages(const ImageData& inputImage, const ImageData& outputImage) {
+    if (!inputImage.isValid()) {
+        throw std::invalid_argument("Input image is not valid");
+    }
+    
+    if (inputImage.channels != 3) {
+        throw std::invalid_argument("Image must be RGB (3 channels), but has " + std::to_string(inputImage.channels) + " channels");
+    }
+    
+    if (!outputImage.isValid() || outputImage.width != inputImage.width || outputImage.height != inputImage.height ||
+        outputImage.channels != inputImage.channels || outputImage.sampleType != inputImage.sampleType ||
+        outputImage.transfer != inputImage.transfer) {
+        throw std::invalid_argument("Output image must be allocated with the input image's dimensions and sample format");
+    }
+}
+
+// The 8-bit kernels cover stored codes and sRGB in linear light; everything else decodes to floats
+bool UsesRgb8Kernels(const ImageData& image, WorkingSpace space) {
+    return image.sampleType == SampleType::U8 && (space == WorkingSpace::Encoded || image.transfer == TransferFunction::Srgb);
+}
+
+} // namespace
+
+ImageData ColorCorrectionMatrixSolver::ApplyMatrix(const ImageData& inputImage, const ColorCorrectionMatrix& correctionMatrix, ThreadPool* threadPool) {
+    // Validate input image
+    if (!inputImage.isValid()) {
+        throw std::invalid_argument("Input image is not valid");
+    }
+    
+    // Output storage comes from the shared pool, so repeated frames reuse mapped memory
+    ImageData outputImage = BufferPool::shared().allocateImage(inputImage.width, inputImage.height, inputImage.channels,
+                                                               inputImage.sampleType);
+    outputImage.transfer = inputImage.transfer;
+    ApplyMatrixInto(inputImage, outputImage, correctionMatrix, threadPool);
+    return outputImage;
+}
+
+void ColorCorrectionMatrixSolver::ApplyMatrixInto(const ImageData& inputImage, ImageData& outputImage,
+                                                  const ColorCorrectionMatrix& correctionMatrix, ThreadPool* threadPool) {
+    ValidateApplyImages(inputImage, outputImage);
+    
+    const unsigned char* inputData = inputImage.data.get();
+    unsigned char* outputData = outputImage.data.get();
+    const size_t rowBytes = inputImage.rowBytes();
+    const ApplyKernel kernel = SelectApplyKernel();
+    const bool rgb8 = UsesRgb8Kernels(inputImage, correctionMatrix.space);
+    auto applyRows = [&](size_t beginRow, size_t endRow) {
+        const size_t pixelCount = (endRow - beginRow) * inputImage.width;
+        if (rgb8) {
+            ApplyCorrectionRgb8(inputData + beginRow * rowBytes, outputData + beginRow * rowBytes, pixelCount, correctionMatrix, kernel);
+        } else {
+            ApplyCorrectionSamples(inputImage, outputImage, beginRow * inputImage.width, pixelCount, correctionMatrix);
+        }
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(inputImage.height, applyRows);
+    } else {
+        applyRows(0, inputImage.height);
+    }
+}
+
+void ColorCorrectionMatrixSolver::ApplyMatrixInPlace(ImageData& image, const ColorCorrectionMatrix& correctionMatrix, ThreadPool* threadPool) {
+    // The kernels read each pixel before writing it, so input and output may share storage
+    ApplyMatrixInto(image, image, correctionMatrix, threadPool);
+}
+
+void ColorCorrectionMatrixSolver::ApplyTiledInto(const ImageData& inputImage, ImageData& outputImage, const TiledCorrection& correction,
+                                                 ThreadPool* threadPool) {
+    ValidateApplyImages(inputImage, outputImage);
+    const int columns = correction.columns;
+    if (columns < 1 || correction.rows < 1 || correction.matrices.size() != static_cast<size_t>(columns) * correction.rows) {
+        throw std::invalid_argument("A tiled correction needs one matrix per tile of its grid");
+    }
+    
+    const int width = inputImage.width;
+    const int height = inputImage.height;
+    const ApplyKernel kernel = SelectApplyKernel();
+    const bool rgb8 = UsesRgb8Kernels(inputImage, correction.space);
+    
+    // Along a row the blended matrix is constant up to the first tile center, linear in x between two
+    // neighboring centers and constant again past the last one; spanStart[i] is the first pixel at or
+    // past center i
+    std::vector<int> spanStart(columns);
+    for (int i = 0; i < columns; ++i) {
+        const double center = (i + 0.5) * width / columns - 0.5;
+        spanStart[i] = std::clamp(static_cast<int>(std::ceil(center)), 0, width);
+    }
+    const double unitsPerPixel = static_cast<double>(columns) / width;
+    
+    auto applyRows = [&](size_t beginRow, size_t endRow) {
+        std::vector<Eigen::Matrix3d> rowMatrices(columns);
+        auto applySpan = [&](size_t y, int begin, int end, const Eigen::Matrix3d& matrix, const Eigen::Matrix3d& step) {
+            if (begin >= end) {
+                return;
+            }
+            const size_t first = y * width + begin;
+            if (rgb8) {
+                ApplyMatrixRampRgb8(inputImage.data.get() + first * 3, outputImage.data.get() + first * 3, end - begin,
+                                    matrix, step, correction.space, kernel);
+            } else {
+                ApplyMatrixRampSamples(inputImage, outputImage, first, end - begin, matrix, step, correction.space);
+            }
+        };
+        
+        for (size_t y = beginRow; y < endRow; ++y) {
+            // Blend the two tile rows around this pixel row once; the row then interpolates between columns
+            const double v = TiledCorrection::gridCoordinate(static_cast<double>(y), correction.rows, height);
+            const int r0 = static_cast<int>(v);
+            const int r1 = std::min(r0 + 1, correction.rows - 1);
+            const double fv = v - r0;
+            for (int c = 0; c < columns; ++c) {
+                rowMatrices[c] = (1.0 - fv) * correction.tile(c, r0) + fv * correction.tile(c, r1);
+            }
+            
+            const Eigen::Matrix3d flat = Eigen::Matrix3d::Zero();
+            applySpan(y, 0, spanStart[0], rowMatrices[0], flat);
+            for (int c = 0; c + 1 < columns; ++c) {
+                const Eigen::Matrix3d difference = rowMatrices[c + 1] - rowMatrices[c];
+                const double u = (spanStart[c] + 0.5) * unitsPerPixel - 0.5 - c;
+                applySpan(y, spanStart[c], spanStart[c + 1], rowMatrices[c] + u * difference, difference * unitsPerPixel);
+            }
+            applySpan(y, spanStart[columns - 1], width, rowMatrices[columns - 1], flat);
+        }
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(height, applyRows);
+    } else {
+        applyRows(0, height);
+    }
+}
+
+void ColorCorrectionMatrixSolver::ApplyMatrix(ImageReader& reader, ImageWriter& writer, const ColorCorrectionMatrix& correctionMatrix,
+                                              int stripRows, ThreadPool* threadPool) {
+    if (reader.channels() != 3) {
+        throw std::invalid_argument("Image must be RGB (3 channels), but has " + std::to_string(reader.channels()) + " channels");
+    }
+    
+    const size_t rowBytes = reader.rowBytes();
+    const ApplyKernel kernel = SelectApplyKernel();
+    
+    // Each strip is corrected in place before it is written out
+    bool streamed = StreamRows(reader, writer, stripRows, [&](unsigned char* rows, int rowCount) {
+        auto applyRows = [&](size_t beginRow, size_t endRow) {
+            unsigned char* band = rows + beginRow * rowBytes;
+            ApplyCorrectionRgb8(band, band, (endRow - beginRow) * reader.width(), correctionMatrix, kernel);
+        };
+        
+        if (threadPool) {
+            threadPool->parallelFor(rowCount, applyRows);
+        } else {
+            applyRows(0, rowCount);
+        }
+    });
+    
+    if (!streamed) {
+        throw std::runtime_error("Failed to stream the image through the color correction");
+    }
+}
@@ -0,0 +1,557 @@
+#include "color_correction_kernels.hpp"
+#include "transfer_function.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CCM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CCM_TARGET_SSE41
+#define CCM_TARGET_AVX2
+#else
+#define CCM_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CCM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+void applyScalar(const unsigned char* input, unsigned char* output, size_t pixelCount, const Eigen::Matrix3d& m,
+                 const Eigen::Vector3d& offset) {
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        unsigned char* out = output + i * 3;
+        
+        // Same arithmetic as ColorCorrectionMatrix::apply on normalized values
+        double r = in[0] / 255.0;
+        double g = in[1] / 255.0;
+        double b = in[2] / 255.0;
+        
+        for (int c = 0; c < 3; ++c) {
+            double value = m(c, 0) * r + m(c, 1) * g + m(c, 2) * b + offset[c];
+            value = std::max(0.0, std::min(1.0, value));
+            out[c] = static_cast<unsigned char>(std::round(value * 255.0));
+        }
+    }
+}
+
+// Single-precision variant on stored codes with the offset in code values: the arithmetic of the SIMD
+// kernels, so the tail they leave gives the same value for a color as the body
+void applyCodesScalar(const unsigned char* input, unsigned char* output, size_t pixelCount, const float* k) {
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        unsigned char* out = output + i * 3;
+        const float r = in[0], g = in[1], b = in[2];
+        
+        for (int c = 0; c < 3; ++c) {
+            float value = k[c * 3] * r + k[c * 3 + 1] * g + k[c * 3 + 2] * b + k[9 + c];
+            value = value > 0.0f ? std::min(value, 255.0f) : 0.0f;
+            out[c] = static_cast<unsigned char>(value + 0.5f);
+        }
+    }
+}
+
+// Linear-light variant: sRGB codes decode through a table, the result encodes through the piecewise curve.
+// Evaluated in single precision like the SIMD kernels, whose results it matches.
+void applyLinearLightScalar(const unsigned char* input, unsigned char* output, size_t pixelCount, const float* k) {
+    const float* decode = SrgbCurve::decodeTable8();
+    const PiecewiseCurve& encoder = SrgbCurve::encoder();
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        unsigned char* out = output + i * 3;
+        const float r = decode[in[0]], g = decode[in[1]], b = decode[in[2]];
+        
+        for (int c = 0; c < 3; ++c) {
+            float value = k[c * 3] * r + k[c * 3 + 1] * g + k[c * 3 + 2] * b + k[9 + c];
+            value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+            out[c] = static_cast<unsigned char>(encoder.evaluate(value) * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Matrix ramp, pixel i corrected with k + (first + i) * dk; the arithmetic of the SIMD ramps, so spans
+// split between them and this tail give the same values
+template <bool LinearLight>
+void applyRampScalar(const unsigned char* input, unsigned char* output, size_t pixelCount, const float* k, const float* dk,
+                     size_t first) {
+    const float* decode = SrgbCurve::decodeTable8();
+    const PiecewiseCurve& encoder = SrgbCurve::encoder();
+    const float maxValue = LinearLight ? 1.0f : 255.0f;
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        unsigned char* out = output + i * 3;
+        const float position = static_cast<float>(first + i);
+        float m[12];
+        for (int j = 0; j < 12; ++j) {
+            m[j] = k[j] + dk[j] * position;
+        }
+        const float r = LinearLight ? decode[in[0]] : in[0];
+        const float g = LinearLight ? decode[in[1]] : in[1];
+        const float b = LinearLight ? decode[in[2]] : in[2];
+        
+        for (int c = 0; c < 3; ++c) {
+            float value = m[c * 3] * r + m[c * 3 + 1] * g + m[c * 3 + 2] * b + m[9 + c];
+            value = value > 0.0f ? std::min(value, maxValue) : 0.0f;
+            out[c] = static_cast<unsigned char>((LinearLight ? encoder.evaluate(value) * 255.0f : value) + 0.5f);
+        }
+    }
+}
+
+// Row-major single-precision copy of the matrix followed by the offset multiplied by offsetScale
+void toFloatCoefficients(const Eigen::Matrix3d& m, const Eigen::Vector3d& offset, double offsetScale, float coefficients[12]) {
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            coefficients[r * 3 + c] = static_cast<float>(m(r, c));
+        }
+        coefficients[9 + r] = static_cast<float>(offset[r] * offsetScale);
+    }
+}
+
+#ifdef CCM_X86
+
+bool cpuSupportsSse41() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+bool cpuSupportsAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // AVX state must also be enabled by the OS
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Returns the number of pixels processed; the caller finishes the tail. With Ramp, pixel i is corrected
+// with k + (first + i) * dk instead of k.
+template <bool Ramp = false>
+CCM_TARGET_SSE41
+size_t applySse41(const unsigned char* input, unsigned char* output, size_t pixelCount, const float* k,
+                  const float* dk = nullptr, size_t first = 0) {
+    const __m128i deinterleave = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+    const __m128i interleave = _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxValue = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    
+    __m128 m[12], step[12];
+    for (int i = 0; i < 12; ++i) {
+        m[i] = _mm_set1_ps(k[i]);
+        step[i] = _mm_set1_ps(Ramp ? dk[i] : 0.0f);
+    }
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    
+    size_t i = 0;
+    // Each step loads 16 bytes for 4 pixels, so keep the load inside the range
+    for (; i + 6 <= pixelCount; i += 4) {
+        if constexpr (Ramp) {
+            const __m128 position = _mm_add_ps(_mm_set1_ps(static_cast<float>(first + i)), lanes);
+            for (int j = 0; j < 12; ++j) {
+                m[j] = _mm_add_ps(_mm_set1_ps(k[j]), _mm_mul_ps(step[j], position));
+            }
+        }
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 3)), deinterleave);
+        __m128 r = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+        __m128 g = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+        __m128 b = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+        
+        __m128i channels[3];
+        for (int c = 0; c < 3; ++c) {
+            __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[c * 3], r), _mm_mul_ps(m[c * 3 + 1], g)), _mm_mul_ps(m[c * 3 + 2], b));
+            value = _mm_add_ps(value, m[9 + c]);
+            value = _mm_min_ps(_mm_max_ps(value, zero), maxValue);
+            // Values are non-negative, so truncating x + 0.5 matches std::round
+            channels[c] = _mm_cvttps_epi32(_mm_add_ps(value, half));
+        }
+        
+        __m128i rg = _mm_packus_epi32(channels[0], channels[1]);
+        __m128i bb = _mm_packus_epi32(channels[2], channels[2]);
+        __m128i rgb = _mm_shuffle_epi8(_mm_packus_epi16(rg, bb), interleave);
+        
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i * 3), rgb);
+        uint32_t last = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(rgb, 8)));
+        std::memcpy(output + i * 3 + 8, &last, sizeof(last));
+    }
+    return i;
+}
+
+// On stored codes, with the offset in code values; or in linear light, decoding the codes with gathers
+// from the sRGB table and encoding the result with gathers from the piecewise curve. Ramp as applySse41.
+template <bool LinearLight, bool Ramp = false>
+CCM_TARGET_AVX2
+size_t applyAvx2(const unsigned char* input, unsigned char* output, size_t pixelCount, const float* k,
+                 const float* dk = nullptr, size_t first = 0) {
+    const __m128i deinterleave = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+    // Shuffles that rebuild 24 interleaved bytes from [R0-7 G0-7] and [B0-7]
+    const __m128i rgLow = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m128i bLow = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i rgHigh = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bHigh = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxValue = _mm256_set1_ps(LinearLight ? 1.0f : 255.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 codeScale = _mm256_set1_ps(255.0f);
+    
+    const float* decode = SrgbCurve::decodeTable8();
+    const PiecewiseCurve& encoder = SrgbCurve::encoder();
+    const __m256i firstBits = _mm256_set1_epi32(static_cast<int>(encoder.firstBits));
+    const __m256 linearSlope = _mm256_set1_ps(encoder.linearSlope);
+    
+    __m256 m[12], step[12];
+    for (int i = 0; i < 12; ++i) {
+        m[i] = _mm256_set1_ps(k[i]);
+        step[i] = _mm256_set1_ps(Ramp ? dk[i] : 0.0f);
+    }
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    
+    size_t i = 0;
+    // Each step loads bytes [0, 28) of its 8 pixels, so keep the loads inside the range
+    for (; i + 10 <= pixelCount; i += 8) {
+        if constexpr (Ramp) {
+            // Recomputed from the span start rather than stepped, so rounding does not build up along a row
+            const __m256 position = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(first + i)), lanes);
+            for (int j = 0; j < 12; ++j) {
+                m[j] = _mm256_add_ps(_mm256_set1_ps(k[j]), _mm256_mul_ps(step[j], position));
+            }
+        }
+        const unsigned char* in = input + i * 3;
+        __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), deinterleave);
+        __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 12)), deinterleave);
+        __m128i rgIn = _mm_unpacklo_epi32(lo, hi);
+        __m128i bIn = _mm_unpackhi_epi32(lo, hi);
+        
+        const __m256i rCodes = _mm256_cvtepu8_epi32(rgIn);
+        const __m256i gCodes = _mm256_cvtepu8_epi32(_mm_srli_si128(rgIn, 8));
+        const __m256i bCodes = _mm256_cvtepu8_epi32(bIn);
+        __m256 r, g, b;
+        if constexpr (LinearLight) {
+            r = _mm256_i32gather_ps(decode, rCodes, 4);
+            g = _mm256_i32gather_ps(decode, gCodes, 4);
+            b = _mm256_i32gather_ps(decode, bCodes, 4);
+        } else {
+            r = _mm256_cvtepi32_ps(rCodes);
+            g = _mm256_cvtepi32_ps(gCodes);
+            b = _mm256_cvtepi32_ps(bCodes);
+        }
+        
+        __m128i channels[3];
+        for (int c = 0; c < 3; ++c) {
+            __m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[c * 3], r), _mm256_mul_ps(m[c * 3 + 1], g)), _mm256_mul_ps(m[c * 3 + 2], b));
+            value = _mm256_add_ps(value, m[9 + c]);
+            // max(value, 0) puts NaN at 0 as the scalar kernels do
+            value = _mm256_min_ps(_mm256_max_ps(value, zero), maxValue);
+            if constexpr (LinearLight) {
+                // Segment index from the exponent and top mantissa bits; values below the table are linear
+                const __m256i bits = _mm256_castps_si256(value);
+                const __m256i below = _mm256_cmpgt_epi32(firstBits, bits);
+                const __m256i index = _mm256_srli_epi32(_mm256_max_epi32(_mm256_sub_epi32(bits, firstBits), _mm256_setzero_si256()),
+                                                        PiecewiseCurve::kSegmentShift);
+                const __m256 tabulated = _mm256_add_ps(_mm256_i32gather_ps(encoder.offset.data(), index, 4),
+                                                       _mm256_mul_ps(_mm256_i32gather_ps(encoder.slope.data(), index, 4), value));
+                value = _mm256_mul_ps(_mm256_blendv_ps(tabulated, _mm256_mul_ps(value, linearSlope), _mm256_castsi256_ps(below)), codeScale);
+            }
+            __m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(value, half));
+            channels[c] = _mm_packus_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+        }
+        
+        __m128i rg = _mm_packus_epi16(channels[0], channels[1]);
+        __m128i bb = _mm_packus_epi16(channels[2], channels[2]);
+        __m128i first = _mm_or_si128(_mm_shuffle_epi8(rg, rgLow), _mm_shuffle_epi8(bb, bLow));
+        __m128i second = _mm_or_si128(_mm_shuffle_epi8(rg, rgHigh), _mm_shuffle_epi8(bb, bHigh));
+        
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 3), first);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i * 3 + 16), second);
+    }
+    return i;
+}
+
+#endif // CCM_X86
+
+// Linear or affine apply through the selected kernel. The SIMD kernels leave their tail to the
+// single-precision scalar loop, so a pixel's result does not depend on where it falls in a span.
+void applyAffine(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                 const Eigen::Matrix3d& matrix, const Eigen::Vector3d& offset, ApplyKernel kernel) {
+#ifdef CCM_X86
+    if (kernel != ApplyKernel::Scalar) {
+        float coefficients[12];
+        toFloatCoefficients(matrix, offset, 255.0, coefficients);
+        
+        size_t processed = 0;
+        if (kernel == ApplyKernel::AVX2) {
+            processed = applyAvx2<false>(input, output, pixelCount, coefficients);
+        }
+        processed += applySse41(input + processed * 3, output + processed * 3, pixelCount - processed, coefficients);
+        applyCodesScalar(input + processed * 3, output + processed * 3, pixelCount - processed, coefficients);
+        return;
+    }
+#else
+    (void)kernel;
+#endif
+    
+    applyScalar(input, output, pixelCount, matrix, offset);
+}
+
+// Linear or affine apply in linear light. Without AVX2 gathers the tables are read one value at a time.
+void applyAffineLinearLight(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                            const Eigen::Matrix3d& matrix, const Eigen::Vector3d& offset, ApplyKernel kernel) {
+    float coefficients[12];
+    toFloatCoefficients(matrix, offset, 1.0, coefficients);
+    size_t processed = 0;
+    
+#ifdef CCM_X86
+    if (kernel == ApplyKernel::AVX2) {
+        processed = applyAvx2<true>(input, output, pixelCount, coefficients);
+    }
+#else
+    (void)kernel;
+#endif
+    
+    applyLinearLightScalar(input + processed * 3, output + processed * 3, pixelCount - processed, coefficients);
+}
+
+// One kernel per root-polynomial model. The term list is evaluated on blocks of pixels held as Eigen
+// arrays, so both the term products and the 3 x kCount multiply-adds run as vector operations.
+template <CorrectionModel Model>
+void applyRootPolynomial(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                         const ColorCorrectionMatrix& correction) {
+    constexpr int kCount = CorrectionModelTerms<Model>::kCount;
+    constexpr int kBlock = 64;
+    using Lanes = Eigen::Array<float, kBlock, 1>;
+    
+    // Coefficients scaled to code values, or kept on the 0..1 scale for encoding in linear light
+    const bool linearLight = correction.space == WorkingSpace::Linear;
+    const double scale = linearLight ? 1.0 : 255.0;
+    float k[3][kCount];
+    const Eigen::Matrix<double, 3, Eigen::Dynamic> coefficients = correction.coefficients();
+    for (int c = 0; c < 3; ++c) {
+        for (int t = 0; t < kCount; ++t) {
+            k[c][t] = static_cast<float>(coefficients(c, t) * scale);
+        }
+    }
+    
+    const Rgb8Roots<float>& roots = Rgb8Roots<float>::get(correction.space);
+    const PiecewiseCurve& encoder = SrgbCurve::encoder();
+    Lanes rgb[3], sqrtRgb[3], cbrtRgb[3], terms[kCount];
+    for (int c = 0; c < 3; ++c) {
+        // Lanes past the end of the last block keep earlier values and are never stored
+        rgb[c].setZero();
+        sqrtRgb[c].setZero();
+        cbrtRgb[c].setZero();
+    }
+    
+    for (size_t begin = 0; begin < pixelCount; begin += kBlock) {
+        const int count = static_cast<int>(std::min<size_t>(kBlock, pixelCount - begin));
+        const unsigned char* in = input + begin * 3;
+        unsigned char* out = output + begin * 3;
+        
+        for (int i = 0; i < count; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                const unsigned char value = in[i * 3 + c];
+                rgb[c][i] = roots.value[value];
+                sqrtRgb[c][i] = roots.sqrtValue[value];
+                cbrtRgb[c][i] = roots.cbrtValue[value];
+            }
+        }
+        CorrectionModelTerms<Model>::evaluate(rgb, sqrtRgb, cbrtRgb, terms);
+        
+        for (int c = 0; c < 3; ++c) {
+            Lanes value = k[c][0] * terms[0];
+            for (int t = 1; t < kCount; ++t) {
+                value += k[c][t] * terms[t];
+            }
+            if (linearLight) {
+                value = value.max(0.0f).min(1.0f);
+                for (int i = 0; i < count; ++i) {
+                    out[i * 3 + c] = static_cast<unsigned char>(encoder.evaluate(value[i]) * 255.0f + 0.5f);
+                }
+                continue;
+            }
+            // Values are non-negative, so truncating x + 0.5 matches std::round
+            value = value.max(0.0f).min(255.0f) + 0.5f;
+            for (int i = 0; i < count; ++i) {
+                out[i * 3 + c] = static_cast<unsigned char>(value[i]);
+            }
+        }
+    }
+}
+
+// Correct decoded values in place, evaluating the model's terms per pixel
+template <CorrectionModel Model>
+void applyDecoded(float* values, size_t pixelCount, const ColorCorrectionMatrix& correction) {
+    constexpr int kCount = CorrectionModelTerms<Model>::kCount;
+    float k[3][kCount];
+    const Eigen::Matrix<double, 3, Eigen::Dynamic> coefficients = correction.coefficients();
+    for (int c = 0; c < 3; ++c) {
+        for (int t = 0; t < kCount; ++t) {
+            k[c][t] = static_cast<float>(coefficients(c, t));
+        }
+    }
+    
+    for (size_t i = 0; i < pixelCount; ++i) {
+        float* rgb = values + i * 3;
+        float terms[kCount];
+        EvaluateCorrectionTerms<Model>(rgb, terms);
+        for (int c = 0; c < 3; ++c) {
+            float value = 0.0f;
+            for (int t = 0; t < kCount; ++t) {
+                value += k[c][t] * terms[t];
+            }
+            rgb[c] = value;
+        }
+    }
+}
+
+} // namespace
+
+ApplyKernel SelectApplyKernel() {
+    static const ApplyKernel selected = []() {
+#ifdef CCM_X86
+        if (cpuSupportsAvx2()) {
+            return ApplyKernel::AVX2;
+        }
+        if (cpuSupportsSse41()) {
+            return ApplyKernel::SSE41;
+        }
+#endif
+        return ApplyKernel::Scalar;
+    }();
+    return selected;
+}
+
+const char* ApplyKernelName(ApplyKernel kernel) {
+    switch (kernel) {
+    case ApplyKernel::AVX2:
+        return "AVX2";
+    case ApplyKernel::SSE41:
+        return "SSE4.1";
+    case ApplyKernel::Scalar:
+    default:
+        return "scalar";
+    }
+}
+
+void ApplyMatrixRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                     const Eigen::Matrix3d& matrix, ApplyKernel kernel) {
+    applyAffine(input, output, pixelCount, matrix, Eigen::Vector3d::Zero(), kernel);
+}
+
+void ApplyCorrectionRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                         const ColorCorrectionMatrix& correction, ApplyKernel kernel) {
+    if (correction.space == WorkingSpace::Linear && correction.model != CorrectionModel::RootPolynomial2 &&
+        correction.model != CorrectionModel::RootPolynomial3) {
+        const Eigen::Vector3d offset = correction.model == CorrectionModel::Affine ? Eigen::Vector3d(correction.terms.col(0))
+                                                                                   : Eigen::Vector3d::Zero();
+        applyAffineLinearLight(input, output, pixelCount, correction.matrix, offset, kernel);
+        return;
+    }
+    
+    switch (correction.model) {
+    case CorrectionModel::Affine:
+        applyAffine(input, output, pixelCount, correction.matrix, correction.terms.col(0), kernel);
+        break;
+    case CorrectionModel::RootPolynomial2:
+        applyRootPolynomial<CorrectionModel::RootPolynomial2>(input, output, pixelCount, correction);
+        break;
+    case CorrectionModel::RootPolynomial3:
+        applyRootPolynomial<CorrectionModel::RootPolynomial3>(input, output, pixelCount, correction);
+        break;
+    case CorrectionModel::Linear:
+    default:
+        applyAffine(input, output, pixelCount, correction.matrix, Eigen::Vector3d::Zero(), kernel);
+        break;
+    }
+}
+
+void ApplyCorrectionSamples(const ImageData& input, ImageData& output, size_t firstPixel, size_t pixelCount,
+                            const ColorCorrectionMatrix& correction) {
+    constexpr size_t kBlock = 256;
+    float values[kBlock * 3];
+    for (size_t begin = 0; begin < pixelCount; begin += kBlock) {
+        const size_t count = std::min(kBlock, pixelCount - begin);
+        const size_t firstSample = (firstPixel + begin) * 3;
+        DecodeSamples(input, firstSample, count * 3, correction.space, values);
+        switch (correction.model) {
+        case CorrectionModel::Affine:
+            applyDecoded<CorrectionModel::Affine>(values, count, correction);
+            break;
+        case CorrectionModel::RootPolynomial2:
+            applyDecoded<CorrectionModel::RootPolynomial2>(values, count, correction);
+            break;
+        case CorrectionModel::RootPolynomial3:
+            applyDecoded<CorrectionModel::RootPolynomial3>(values, count, correction);
+            break;
+        case CorrectionModel::Linear:
+        default:
+            applyDecoded<CorrectionModel::Linear>(values, count, correction);
+            break;
+        }
+        EncodeSamples(values, count * 3, correction.space, output, firstSample);
+    }
+}
+
+void ApplyMatrixRampRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                         const Eigen::Matrix3d& matrix, const Eigen::Matrix3d& step, WorkingSpace space, ApplyKernel kernel) {
+    float k[12], dk[12];
+    toFloatCoefficients(matrix, Eigen::Vector3d::Zero(), 1.0, k);
+    toFloatCoefficients(step, Eigen::Vector3d::Zero(), 1.0, dk);
+    const bool linearLight = space == WorkingSpace::Linear;
+    size_t processed = 0;
+    
+#ifdef CCM_X86
+    if (kernel == ApplyKernel::AVX2) {
+        processed = linearLight ? applyAvx2<true, true>(input, output, pixelCount, k, dk)
+                                : applyAvx2<false, true>(input, output, pixelCount, k, dk);
+    }
+    if (kernel != ApplyKernel::Scalar && !linearLight) {
+        processed += applySse41<true>(input + processed * 3, output + processed * 3, pixelCount - processed, k, dk, processed);
+    }
+#else
+    (void)kernel;
+#endif
+    
+    if (linearLight) {
+        applyRampScalar<true>(input + processed * 3, output + processed * 3, pixelCount - processed, k, dk, processed);
+    } else {
+        applyRampScalar<false>(input + processed * 3, output + processed * 3, pixelCount - processed, k, dk, processed);
+    }
+}
+
+void ApplyMatrixRampSamples(const ImageData& input, ImageData& output, size_t firstPixel, size_t pixelCount,
+                            const Eigen::Matrix3d& matrix, const Eigen::Matrix3d& step, WorkingSpace space) {
+    constexpr size_t kBlock = 256;
+    const Eigen::Matrix3f k = matrix.cast<float>();
+    const Eigen::Matrix3f dk = step.cast<float>();
+    float values[kBlock * 3];
+    for (size_t begin = 0; begin < pixelCount; begin += kBlock) {
+        const size_t count = std::min(kBlock, pixelCount - begin);
+        const size_t firstSample = (firstPixel + begin) * 3;
+        DecodeSamples(input, firstSample, count * 3, space, values);
+        for (size_t i = 0; i < count; ++i) {
+            Eigen::Map<Eigen::Vector3f> rgb(values + i * 3);
+            const Eigen::Matrix3f m = k + dk * static_cast<float>(begin + i);
+            rgb = m * Eigen::Vector3f(rgb);
+        }
+        EncodeSamples(values, count * 3, space, output, firstSample);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <Eigen/Dense>
+#include "color_correction_matrix.hpp"
+#include "image_data.hpp"
+
+// Implementations of the 8-bit RGB apply kernel, selected at runtime from the CPU's features
+enum class ApplyKernel {
+    Scalar, // Double precision for encoded linear and affine corrections, bit-exact with the original
+            // per-pixel Eigen loop; linear-light and ramp corrections use single-precision loops
+    SSE41,  // 4 pixels per step in single precision
+    AVX2    // 8 pixels per step in single precision
+};
+
+// Fastest kernel supported by the running CPU (detected once)
+ApplyKernel SelectApplyKernel();
+const char* ApplyKernelName(ApplyKernel kernel);
+
+// Compute out = round(clamp(matrix * in, 0, 255)) for pixelCount interleaved RGB pixels.
+// input and output may be the same buffer. The SIMD kernels evaluate matrix * in in single
+// precision, so a channel can differ from the scalar kernel by at most 1 LSB where the exact
+// value lies within float rounding error of a .5 boundary. Pixels left over after the last full
+// vector go through the same single-precision arithmetic, so with a given kernel the result for a
+// color does not depend on its position.
+void ApplyMatrixRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                     const Eigen::Matrix3d& matrix, ApplyKernel kernel = SelectApplyKernel());
+
+// Apply a correction of any model. Linear and Affine corrections run the kernels above (the offset is
+// folded into the same multiply-adds); each root-polynomial model has its own kernel, instantiated from
+// its term list, that takes the roots from 256-entry tables and evaluates in single precision.
+// Corrections in linear light take the pixels to be sRGB-encoded: codes decode through a 256-entry
+// table and results encode through SrgbCurve::encoder(), gathered 8 lanes at a time by the AVX2 kernel.
+void ApplyCorrectionRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                         const ColorCorrectionMatrix& correction, ApplyKernel kernel = SelectApplyKernel());
+
+// Apply to pixelCount RGB pixels starting at firstPixel of an image of any sample type and transfer
+// function, writing the same pixels of output (which may be input). Blocks of pixels are decoded to
+// floats, corrected and encoded again; root-polynomial terms take their roots per pixel.
+void ApplyCorrectionSamples(const ImageData& input, ImageData& output, size_t firstPixel, size_t pixelCount,
+                            const ColorCorrectionMatrix& correction);
+
+
+// Apply a matrix that changes linearly along the pixels: pixel i is corrected with matrix + i * step, on the
+// stored codes or, for WorkingSpace::Linear, on sRGB codes decoded to linear light. Spatially varying
+// corrections are linear in x between two tile centers, so each such span of a row is one call.
+void ApplyMatrixRampRgb8(const unsigned char* input, unsigned char* output, size_t pixelCount,
+                         const Eigen::Matrix3d& matrix, const Eigen::Matrix3d& step, WorkingSpace space,
+                         ApplyKernel kernel = SelectApplyKernel());
+
+// The same ramp over pixels of an image of any sample type, decoded a block at a time as ApplyCorrectionSamples
+void ApplyMatrixRampSamples(const ImageData& input, ImageData& output, size_t firstPixel, size_t pixelCount,
+                            const Eigen::Matrix3d& matrix, const Eigen::Matrix3d& step, WorkingSpace space);
\ No newline at end of file
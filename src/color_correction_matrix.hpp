@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include "correction_model.hpp"
+
+// A fitted color correction: the 3x3 matrix of the linear model, plus the coefficients of any further
+// terms of the model (see CorrectionModelTerms). All colors are on the 0..1 scale of the working space.
+struct ColorCorrectionMatrix {
+    CorrectionModel model = CorrectionModel::Linear;
+    // Encoded for stored matrices without a space, which were all fitted on the stored values
+    WorkingSpace space = WorkingSpace::Encoded;
+    Eigen::Matrix3d matrix;
+    // Coefficients of the terms after r, g, b: the offset for Affine, the root terms for the
+    // root-polynomial models; no columns for Linear
+    Eigen::Matrix<double, 3, Eigen::Dynamic> terms;
+
+    ColorCorrectionMatrix()
+        : matrix(Eigen::Matrix3d::Identity()), terms(3, 0) {}
+
+    // Affine correction m * color + o
+    ColorCorrectionMatrix(const Eigen::Matrix3d& m, const Eigen::Vector3d& o)
+        : model(CorrectionModel::Affine), matrix(m), terms(o) {}
+
+    // Identity correction in the given model
+    static ColorCorrectionMatrix identity(CorrectionModel model) {
+        ColorCorrectionMatrix correction;
+        correction.model = model;
+        correction.terms = Eigen::Matrix<double, 3, Eigen::Dynamic>::Zero(3, CorrectionModelTermCount(model) - 3);
+        return correction;
+    }
+
+    // Build from a 3 x termCount coefficient matrix, one column per term of the model
+    static ColorCorrectionMatrix fromCoefficients(CorrectionModel model, const Eigen::Ref<const Eigen::MatrixXd>& coefficients) {
+        ColorCorrectionMatrix correction;
+        correction.model = model;
+        correction.matrix = coefficients.leftCols<3>();
+        correction.terms = coefficients.rightCols(coefficients.cols() - 3);
+        return correction;
+    }
+
+    Eigen::Matrix<double, 3, Eigen::Dynamic> coefficients() const {
+        Eigen::Matrix<double, 3, Eigen::Dynamic> all(3, 3 + terms.cols());
+        all << matrix, terms;
+        return all;
+    }
+
+    // Apply the color correction to a color vector (RGB)
+    Eigen::Vector3d apply(const Eigen::Vector3d& color) const {
+        Eigen::Vector3d result = matrix * color;
+        if (model != CorrectionModel::Linear) {
+            double values[kMaxCorrectionTerms];
+            EvaluateCorrectionTerms(model, color.data(), values);
+            result += terms * Eigen::Map<const Eigen::VectorXd>(values + 3, terms.cols());
+        }
+        return result;
+    }
+
+    // Apply to a color of sRGB-encoded values, decoding it first and encoding the clamped result in linear
+    // light; as apply, clamped, otherwise. For lattices and reference paths: it takes a pow() per channel.
+    Eigen::Vector3d applyToEncoded(const Eigen::Vector3d& encoded) const {
+        if (space != WorkingSpace::Linear) {
+            return apply(encoded).cwiseMax(0.0).cwiseMin(1.0);
+        }
+        const Eigen::Vector3d corrected = apply(encoded.unaryExpr([](double value) { return SrgbCurve::decode(value); }));
+        return corrected.cwiseMax(0.0).cwiseMin(1.0).unaryExpr([](double value) { return SrgbCurve::encode(value); });
+    }
+};
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "color_correction_matrix_io.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const char kTextMagic[] = "CCM";
+const char kBinaryMagic[4] = { 'C', 'C', 'M', 'B' };
+
+void writeUint32(std::ostream& stream, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+    stream.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+bool readUint32(std::istream& stream, uint32_t& value) {
+    unsigned char bytes[4];
+    if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(bytes[i]) << (8 * i);
+    }
+    return true;
+}
+
+// Doubles are stored as their IEEE-754 bits in little-endian order regardless of the host
+void writeDouble(std::ostream& stream, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    stream.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+bool readDouble(std::istream& stream, double& value) {
+    unsigned char bytes[8];
+    if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+        return false;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+    std::memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+bool readMatrixValues(std::istream& stream, Eigen::Matrix3d& matrix) {
+    for (int i = 0; i < 9; ++i) {
+        if (!(stream >> matrix(i / 3, i % 3))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readTermValues(std::istream& stream, Eigen::Matrix<double, 3, Eigen::Dynamic>& terms) {
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < terms.cols(); ++c) {
+            if (!(stream >> terms(r, c))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+unsigned int versionFor(const ColorCorrectionMatrix& matrix) {
+    if (matrix.space == WorkingSpace::Linear) {
+        return 3;
+    }
+    return matrix.model == CorrectionModel::Linear ? 1 : 2;
+}
+
+} // namespace
+
+MatrixFileFormat ColorCorrectionMatrixIO::formatForPath(const std::string& path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == "ccmb" ? MatrixFileFormat::Binary : MatrixFileFormat::Text;
+}
+
+bool ColorCorrectionMatrixIO::save(const ColorCorrectionMatrix& matrix, const std::string& path) {
+    return save(matrix, path, formatForPath(path));
+}
+
+bool ColorCorrectionMatrixIO::save(const ColorCorrectionMatrix& matrix, const std::string& path, MatrixFileFormat format) {
+    // Written beside the target and renamed over it, so a concurrent load sees the old file or the new one,
+    // never a partly written one
+    static std::atomic<uint64_t> saveCount{ 0 };
+    const std::string temporaryPath = path + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+                                      "-" + std::to_string(saveCount++);
+    bool saved = format == MatrixFileFormat::Binary ? saveBinary(matrix, temporaryPath) : saveText(matrix, temporaryPath);
+    std::error_code error;
+    if (saved) {
+        std::filesystem::rename(temporaryPath, path, error);
+        saved = !error;
+    }
+    if (!saved) {
+        std::filesystem::remove(temporaryPath, error);
+        std::cerr << "Error: Failed to save matrix to '" << path << "'" << std::endl;
+    }
+    return saved;
+}
+
+std::optional<ColorCorrectionMatrix> ColorCorrectionMatrixIO::load(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        std::cerr << "Error: Failed to open matrix file '" << path << "'" << std::endl;
+        return std::nullopt;
+    }
+    
+    char magic[4] = {};
+    stream.read(magic, sizeof(magic));
+    bool binary = stream.gcount() == sizeof(magic) && std::equal(magic, magic + 4, kBinaryMagic);
+    stream.clear();
+    stream.seekg(binary ? sizeof(magic) : 0);
+    
+    return binary ? loadBinary(stream, path) : loadText(stream, path);
+}
+
+bool ColorCorrectionMatrixIO::saveText(const ColorCorrectionMatrix& matrix, const std::string& path) {
+    std::ofstream stream(path);
+    if (!stream) {
+        return false;
+    }
+    
+    // max_digits10 makes the text round-trip to the identical doubles
+    stream << std::setprecision(std::numeric_limits<double>::max_digits10);
+    stream << kTextMagic << " " << versionFor(matrix) << "\n";
+    if (matrix.model != CorrectionModel::Linear) {
+        stream << "model " << CorrectionModelName(matrix.model) << "\n";
+    }
+    if (matrix.space == WorkingSpace::Linear) {
+        stream << "space " << WorkingSpaceName(matrix.space) << "\n";
+    }
+    stream << "matrix\n";
+    for (int r = 0; r < 3; ++r) {
+        stream << matrix.matrix(r, 0) << " " << matrix.matrix(r, 1) << " " << matrix.matrix(r, 2) << "\n";
+    }
+    if (matrix.terms.cols() > 0) {
+        // One row per output channel, one column per term after r, g, b
+        stream << "terms\n";
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < matrix.terms.cols(); ++c) {
+                stream << (c > 0 ? " " : "") << matrix.terms(r, c);
+            }
+            stream << "\n";
+        }
+    }
+    stream.close();
+    return static_cast<bool>(stream);
+}
+
+bool ColorCorrectionMatrixIO::saveBinary(const ColorCorrectionMatrix& matrix, const std::string& path) {
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+    
+    const unsigned int version = versionFor(matrix);
+    stream.write(kBinaryMagic, sizeof(kBinaryMagic));
+    writeUint32(stream, version);
+    if (version >= 2) {
+        writeUint32(stream, static_cast<uint32_t>(matrix.model));
+    }
+    if (version >= 3) {
+        writeUint32(stream, static_cast<uint32_t>(matrix.space));
+    }
+    
+    // Row-major 3 x termCount coefficients; the first three columns are the matrix
+    const Eigen::Matrix<double, 3, Eigen::Dynamic> coefficients = matrix.coefficients();
+    writeUint32(stream, static_cast<uint32_t>(coefficients.size()));
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < coefficients.cols(); ++c) {
+            writeDouble(stream, coefficients(r, c));
+        }
+    }
+    stream.close();
+    return static_cast<bool>(stream);
+}
+
+std::optional<ColorCorrectionMatrix> ColorCorrectionMatrixIO::loadText(std::istream& stream, const std::string& path) {
+    ColorCorrectionMatrix result;
+    
+    std::string token;
+    if (!(stream >> token)) {
+        std::cerr << "Error: Matrix file '" << path << "' is empty" << std::endl;
+        return std::nullopt;
+    }
+    
+    if (token != kTextMagic) {
+        // Headerless legacy file: nine row-major values
+        stream.seekg(0);
+        if (!readMatrixValues(stream, result.matrix)) {
+            std::cerr << "Error: Matrix file '" << path << "' must contain 9 values" << std::endl;
+            return std::nullopt;
+        }
+        return result;
+    }
+    
+    unsigned int version = 0;
+    if (!(stream >> version) || version == 0 || version > kVersion) {
+        std::cerr << "Error: Unsupported matrix file version in '" << path << "'" << std::endl;
+        return std::nullopt;
+    }
+    
+    bool hasMatrix = false;
+    bool hasTerms = false;
+    WorkingSpace space = WorkingSpace::Encoded;
+    while (stream >> token) {
+        if (token == "model" && version >= 2) {
+            std::string name;
+            auto model = (stream >> name) ? ParseCorrectionModel(name) : std::nullopt;
+            if (!model.has_value()) {
+                std::cerr << "Error: Unknown correction model '" << name << "' in matrix file '" << path << "'" << std::endl;
+                return std::nullopt;
+            }
+            result = ColorCorrectionMatrix::identity(*model);
+        } else if (token == "space" && version >= 3) {
+            std::string name;
+            auto parsed = (stream >> name) ? ParseWorkingSpace(name) : std::nullopt;
+            if (!parsed.has_value()) {
+                std::cerr << "Error: Unknown working space '" << name << "' in matrix file '" << path << "'" << std::endl;
+                return std::nullopt;
+            }
+            space = *parsed;
+        } else if (token == "terms" && version >= 2) {
+            if (result.terms.cols() == 0 || !readTermValues(stream, result.terms)) {
+                std::cerr << "Error: Terms section in '" << path << "' must follow the model and contain "
+                          << 3 * result.terms.cols() << " values" << std::endl;
+                return std::nullopt;
+            }
+            hasTerms = true;
+        } else if (token == "matrix") {
+            if (!readMatrixValues(stream, result.matrix)) {
+                std::cerr << "Error: Matrix section in '" << path << "' must contain 9 values" << std::endl;
+                return std::nullopt;
+            }
+            hasMatrix = true;
+        } else {
+            std::cerr << "Error: Unknown section '" << token << "' in matrix file '" << path << "'" << std::endl;
+            return std::nullopt;
+        }
+    }
+    
+    if (!hasMatrix) {
+        std::cerr << "Error: Matrix file '" << path << "' has no matrix section" << std::endl;
+        return std::nullopt;
+    }
+    if (result.terms.cols() > 0 && !hasTerms) {
+        std::cerr << "Error: Matrix file '" << path << "' has no terms section for its " << CorrectionModelName(result.model) << " model" << std::endl;
+        return std::nullopt;
+    }
+    result.space = space;
+    return result;
+}
+
+std::optional<ColorCorrectionMatrix> ColorCorrectionMatrixIO::loadBinary(std::istream& stream, const std::string& path) {
+    uint32_t version = 0, valueCount = 0;
+    if (!readUint32(stream, version) || !readUint32(stream, valueCount)) {
+        std::cerr << "Error: Truncated matrix file '" << path << "'" << std::endl;
+        return std::nullopt;
+    }
+    if (version == 0 || version > kVersion) {
+        std::cerr << "Error: Unsupported matrix file version " << version << " in '" << path << "'" << std::endl;
+        return std::nullopt;
+    }
+    
+    CorrectionModel model = CorrectionModel::Linear;
+    if (version >= 2) {
+        // The model precedes the value count
+        uint32_t modelId = valueCount;
+        if (modelId > static_cast<uint32_t>(CorrectionModel::RootPolynomial3) || !readUint32(stream, valueCount)) {
+            std::cerr << "Error: Invalid correction model in matrix file '" << path << "'" << std::endl;
+            return std::nullopt;
+        }
+        model = static_cast<CorrectionModel>(modelId);
+    }
+    
+    WorkingSpace space = WorkingSpace::Encoded;
+    if (version >= 3) {
+        // The space follows the model, so the value count comes after it
+        uint32_t spaceId = valueCount;
+        if (spaceId > static_cast<uint32_t>(WorkingSpace::Linear) || !readUint32(stream, valueCount)) {
+            std::cerr << "Error: Invalid working space in matrix file '" << path << "'" << std::endl;
+            return std::nullopt;
+        }
+        space = static_cast<WorkingSpace>(spaceId);
+    }
+    
+    const int termCount = CorrectionModelTermCount(model);
+    if (valueCount != static_cast<uint32_t>(3 * termCount)) {
+        std::cerr << "Error: Matrix file '" << path << "' has " << valueCount << " values, expected " << 3 * termCount << std::endl;
+        return std::nullopt;
+    }
+    
+    Eigen::MatrixXd coefficients(3, termCount);
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < termCount; ++c) {
+            if (!readDouble(stream, coefficients(r, c))) {
+                std::cerr << "Error: Truncated matrix file '" << path << "'" << std::endl;
+                return std::nullopt;
+            }
+        }
+    }
+    ColorCorrectionMatrix result = ColorCorrectionMatrix::fromCoefficients(model, coefficients);
+    result.space = space;
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include "color_correction_matrix.hpp"
+
+enum class MatrixFileFormat {
+    Text,   // "CCM <version>" header followed by keyed sections; human-editable
+    Binary  // "CCMB" magic, version, model (version 2), working space (version 3), value count and little-endian float64 values
+};
+
+// Versioned on-disk format for solved matrices, so they can be reused without re-solving.
+// Version 2 adds the correction model and its extra terms, version 3 the working space of corrections
+// fitted in linear light. Each file is written with the oldest version that can hold it, so linear
+// matrices on stored values stay readable by older builds.
+class ColorCorrectionMatrixIO {
+public:
+    static constexpr unsigned int kVersion = 3;
+
+    // Files ending in .ccmb are written as binary, everything else as text
+    static MatrixFileFormat formatForPath(const std::string& path);
+
+    static bool save(const ColorCorrectionMatrix& matrix, const std::string& path);
+    static bool save(const ColorCorrectionMatrix& matrix, const std::string& path, MatrixFileFormat format);
+
+    // Detects the format from the file contents. Text files without a header are read as
+    // nine row-major values, the format used by earlier batch runs.
+    static std::optional<ColorCorrectionMatrix> load(const std::string& path);
+
+private:
+    static bool saveText(const ColorCorrectionMatrix& matrix, const std::string& path);
+    static bool saveBinary(const ColorCorrectionMatrix& matrix, const std::string& path);
+    static std::optional<ColorCorrectionMatrix> loadText(std::istream& stream, const std::string& path);
+    static std::optional<ColorCorrectionMatrix> loadBinary(std::istream& stream, const std::string& path);
+};
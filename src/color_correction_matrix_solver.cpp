@@ -1,9 +1,760 @@
 #include "color_correction_matrix_solver.hpp"
+#include "color_pair_histogram.hpp"
+#include "image_pyramid.hpp"
+#include "image_stream.hpp"
+#include "stage_profiler.hpp"
+#include "thread_pool.hpp"
+#include <ceres/ceres.h>
+#include <Eigen/Sparse>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Exact integer sums of the 8-bit products behind NormalEquations.
+// 64-bit sums cannot overflow below ~2.8e14 pixels.
+struct IntegerNormalEquations {
+	uint64_t sourceSource[3][3] = {};
+	uint64_t sourceTarget[3][3] = {};
+	size_t count = 0;
+
+	void add(const unsigned char* s, const unsigned char* t, uint64_t pixels = 1) {
+		for (int r = 0; r < 3; ++r) {
+			for (int c = r; c < 3; ++c) {
+				sourceSource[r][c] += static_cast<uint64_t>(s[r]) * s[c] * pixels;
+			}
+			for (int c = 0; c < 3; ++c) {
+				sourceTarget[r][c] += static_cast<uint64_t>(s[r]) * t[c] * pixels;
+			}
+		}
+		count += pixels;
+	}
+
+	// Normalize to the [0, 1] range used by the Ceres path
+	NormalEquations toNormalEquations() const {
+		const double scale = 1.0 / (255.0 * 255.0);
+		NormalEquations equations;
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				equations.sourceSource(r, c) = (c >= r ? sourceSource[r][c] : sourceSource[c][r]) * scale;
+				equations.sourceTarget(r, c) = sourceTarget[r][c] * scale;
+			}
+		}
+		equations.totalWeight = static_cast<double>(count);
+		return equations;
+	}
+
+	void merge(const IntegerNormalEquations& other) {
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				sourceSource[r][c] += other.sourceSource[r][c];
+				sourceTarget[r][c] += other.sourceTarget[r][c];
+			}
+		}
+		count += other.count;
+	}
+};
+
+// The pixels of a pair a fit runs over: the whole image or a list of flat indices, optionally without saturated pixels
+struct FitSelection {
+	const std::vector<size_t>* indices;
+	size_t totalPixels;
+	bool skipSaturated;
+
+	size_t size() const { return indices ? indices->size() : totalPixels; }
+	size_t index(size_t position) const { return indices ? (*indices)[position] : position; }
+};
+
+// Scale of the 8-bit codes of an image in a working space: images with a linear transfer are linear light already
+WorkingSpace CodeSpace(const ImageData& image, WorkingSpace space) {
+	return image.transfer == TransferFunction::Srgb ? space : WorkingSpace::Encoded;
+}
+
+// Fit sets of 8-bit colors, whose values and root terms come from tables on the working scale.
+// Only on the stored codes do the exact integer sums apply.
+struct Rgb8Samples {
+	const Rgb8Roots<double>* roots;
+	bool exact;
+
+	explicit Rgb8Samples(WorkingSpace space)
+		: roots(&Rgb8Roots<double>::get(space)), exact(space == WorkingSpace::Encoded) {}
+
+	Eigen::Vector3d color(const unsigned char* rgb) const {
+		return Eigen::Vector3d(roots->value[rgb[0]], roots->value[rgb[1]], roots->value[rgb[2]]);
+	}
+
+	template <CorrectionModel Model>
+	void terms(const unsigned char* rgb, double* values) const {
+		EvaluateCorrectionTermsRgb8<Model>(rgb, values, *roots);
+	}
+};
+
+// The selected pixels of two 8-bit images
+struct FitPixels : Rgb8Samples {
+	FitSelection selection;
+	const unsigned char* startData;
+	const unsigned char* targetData;
+
+	FitPixels(const ImageData& startImage, const ImageData& targetImage, const FitSelection& selection, WorkingSpace space)
+		: Rgb8Samples(CodeSpace(startImage, space)), selection(selection), startData(startImage.data.get()),
+		  targetData(targetImage.data.get()) {}
+
+	size_t size() const { return selection.size(); }
+
+	// Call visit(source, target, pixelCount) for the fitted pixels among positions [begin, end)
+	template <typename Visit>
+	void visit(size_t begin, size_t end, Visit&& visitPixel) const {
+		for (size_t i = begin; i < end; ++i) {
+			const size_t index = selection.index(i);
+			const unsigned char* s = startData + index * 3;
+			const unsigned char* t = targetData + index * 3;
+			if (selection.skipSaturated && ColorCorrectionMatrixSolver::IsSaturated(s, t)) {
+				continue;
+			}
+			visitPixel(s, t, uint64_t(1));
+		}
+	}
+};
+
+// The same fit compressed to distinct color pairs, each standing for count pixels
+struct FitHistogram : Rgb8Samples {
+	const std::vector<ColorPairHistogram::Entry>& entries;
+
+	FitHistogram(const ColorPairHistogram& histogram, WorkingSpace codeSpace)
+		: Rgb8Samples(codeSpace), entries(histogram.entries()) {}
+
+	size_t size() const { return entries.size(); }
+
+	template <typename Visit>
+	void visit(size_t begin, size_t end, Visit&& visitPair) const {
+		for (size_t i = begin; i < end; ++i) {
+			const ColorPairHistogram::Entry& entry = entries[i];
+			const unsigned char s[3] = { entry.source(0), entry.source(1), entry.source(2) };
+			const unsigned char t[3] = { entry.target(0), entry.target(1), entry.target(2) };
+			visitPair(s, t, entry.count);
+		}
+	}
+};
+
+// True when a channel of either pixel sits at an end of its range: 0 or the integer maximum, or outside
+// [0, 1] for float samples
+bool IsSaturatedPixel(const ImageData& startImage, const ImageData& targetImage, size_t index) {
+	float values[6];
+	DecodeSamples(startImage, index * 3, 3, WorkingSpace::Encoded, values);
+	DecodeSamples(targetImage, index * 3, 3, WorkingSpace::Encoded, values + 3);
+	for (float value : values) {
+		if (!(value > 0.0f && value < 1.0f)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The selected pixels of two 16-bit or float images, decoded to the working scale a block at a time
+struct FitDecodedPixels {
+	static constexpr size_t kBlock = 256;
+
+	FitSelection selection;
+	const ImageData& startImage;
+	const ImageData& targetImage;
+	WorkingSpace space;
+
+	size_t size() const { return selection.size(); }
+
+	Eigen::Vector3d color(const float* rgb) const { return Eigen::Vector3d(rgb[0], rgb[1], rgb[2]); }
+
+	template <CorrectionModel Model>
+	void terms(const float* rgb, double* values) const {
+		const double color[3] = { rgb[0], rgb[1], rgb[2] };
+		EvaluateCorrectionTerms<Model>(color, values);
+	}
+
+	template <typename Visit>
+	void visit(size_t begin, size_t end, Visit&& visitPixel) const {
+		float s[kBlock * 3], t[kBlock * 3];
+		for (size_t first = begin; first < end; first += kBlock) {
+			const size_t count = std::min(kBlock, end - first);
+			if (selection.indices) {
+				for (size_t i = 0; i < count; ++i) {
+					const size_t index = selection.index(first + i);
+					DecodeSamples(startImage, index * 3, 3, space, s + i * 3);
+					DecodeSamples(targetImage, index * 3, 3, space, t + i * 3);
+				}
+			} else {
+				DecodeSamples(startImage, first * 3, count * 3, space, s);
+				DecodeSamples(targetImage, first * 3, count * 3, space, t);
+			}
+			for (size_t i = 0; i < count; ++i) {
+				if (selection.skipSaturated && IsSaturatedPixel(startImage, targetImage, selection.index(first + i))) {
+					continue;
+				}
+				visitPixel(s + i * 3, t + i * 3, uint64_t(1));
+			}
+		}
+	}
+};
+
+// Run accumulate(begin, end) on bands of [0, count) and merge the per-band results in band order,
+// so the sum does not depend on which thread finished first
+template <typename Result, typename Accumulate>
+Result ReduceBands(size_t count, ThreadPool* threadPool, Accumulate&& accumulate) {
+	if (!threadPool) {
+		return accumulate(size_t(0), count);
+	}
+
+	std::mutex mutex;
+	std::vector<std::pair<size_t, Result>> bands;
+	threadPool->parallelFor(count, [&](size_t begin, size_t end) {
+		Result band = accumulate(begin, end);
+		std::lock_guard<std::mutex> lock(mutex);
+		bands.emplace_back(begin, band);
+	});
+
+	std::sort(bands.begin(), bands.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	Result total;
+	for (const auto& band : bands) {
+		total.merge(band.second);
+	}
+	return total;
+}
+
+// Exact least-squares statistics of an 8-bit fit set on its stored codes
+template <typename Samples>
+IntegerNormalEquations AccumulateExact(const Samples& samples, ThreadPool* threadPool) {
+	return ReduceBands<IntegerNormalEquations>(samples.size(), threadPool, [&](size_t begin, size_t end) {
+		IntegerNormalEquations band;
+		samples.visit(begin, end, [&](const unsigned char* s, const unsigned char* t, uint64_t pixels) { band.add(s, t, pixels); });
+		return band;
+	});
+}
+
+// Least-squares statistics of a fit set on its working scale, for fits the integer sums do not cover
+template <typename Samples>
+NormalEquations AccumulateDecoded(const Samples& samples, ThreadPool* threadPool) {
+	return ReduceBands<NormalEquations>(samples.size(), threadPool, [&](size_t begin, size_t end) {
+		NormalEquations band;
+		samples.visit(begin, end, [&](const auto* s, const auto* t, uint64_t pixels) {
+			band.add(samples.color(s), samples.color(t), static_cast<double>(pixels));
+		});
+		return band;
+	});
+}
+
+// Per-tile statistics of a spatially varying fit, merged tile by tile
+template <typename Sums>
+struct TileSums {
+	std::vector<Sums> tiles;
+
+	void merge(const TileSums& other) {
+		if (tiles.empty()) {
+			tiles = other.tiles;
+			return;
+		}
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			tiles[i].merge(other.tiles[i]);
+		}
+	}
+};
+
+// Statistics of every tile of the grid over a whole-image fit set, accumulated on row bands in parallel.
+// Each row visits one contiguous run of pixels per tile column; add folds a pixel into its tile's sums.
+template <typename Sums, typename Samples, typename Add>
+std::vector<Sums> ReduceTiles(const Samples& samples, int width, int height, const TileOptions& grid, ThreadPool* threadPool,
+							  Add&& add) {
+	std::vector<size_t> columnStart(grid.columns + 1);
+	for (int c = 0; c <= grid.columns; ++c) {
+		columnStart[c] = static_cast<size_t>(TiledCorrection::tileStart(c, grid.columns, width));
+	}
+
+	return ReduceBands<TileSums<Sums>>(static_cast<size_t>(height), threadPool, [&](size_t begin, size_t end) {
+		TileSums<Sums> band;
+		band.tiles.resize(static_cast<size_t>(grid.columns) * grid.rows);
+		for (size_t y = begin; y < end; ++y) {
+			Sums* row = band.tiles.data() + static_cast<size_t>(TiledCorrection::tileOf(static_cast<int>(y), grid.rows, height)) * grid.columns;
+			const size_t rowStart = y * width;
+			for (int c = 0; c < grid.columns; ++c) {
+				samples.visit(rowStart + columnStart[c], rowStart + columnStart[c + 1],
+							  [&](const auto* s, const auto* t, uint64_t pixels) { add(row[c], s, t, pixels); });
+			}
+		}
+		return band;
+	}).tiles;
+}
+
+// Normal equations of every tile, exact on stored 8-bit codes as AccumulateExact
+template <typename Samples>
+std::vector<NormalEquations> AccumulateTiles(const Samples& samples, int width, int height, const TileOptions& grid, ThreadPool* threadPool) {
+	if constexpr (std::is_base_of_v<Rgb8Samples, Samples>) {
+		if (samples.exact) {
+			const std::vector<IntegerNormalEquations> sums = ReduceTiles<IntegerNormalEquations>(samples, width, height, grid, threadPool,
+				[](IntegerNormalEquations& tile, const unsigned char* s, const unsigned char* t, uint64_t pixels) { tile.add(s, t, pixels); });
+			std::vector<NormalEquations> equations;
+			equations.reserve(sums.size());
+			for (const IntegerNormalEquations& tile : sums) {
+				equations.push_back(tile.toNormalEquations());
+			}
+			return equations;
+		}
+	}
+	return ReduceTiles<NormalEquations>(samples, width, height, grid, threadPool,
+		[&](NormalEquations& tile, const auto* s, const auto* t, uint64_t pixels) {
+			tile.add(samples.color(s), samples.color(t), static_cast<double>(pixels));
+		});
+}
+
+// Pull of every tile toward the single-matrix fit, relative to the pixels of an average tile: far too weak to
+// matter where a tile's pixels determine its matrix, it fills in tiles without pixels, or whose colors span
+// fewer than three dimensions, when smoothing is off
+constexpr double kTileAnchorWeight = 1e-6;
+
+// Tile matrices minimizing the tiles' summed squared errors plus smoothing * ||M_a - M_b||^2 per pair of
+// neighboring tiles (and the anchor term). The normal equations of that problem couple each tile's 3x3
+// block to its four neighbors; every output channel shares the sparse system, so it is factored once.
+std::vector<Eigen::Matrix3d> SolveTileSystem(const std::vector<NormalEquations>& tiles, const NormalEquations& total,
+											 const TileOptions& grid) {
+	const Eigen::Matrix3d globalFit = total.solve().matrix.transpose();
+	const int count = static_cast<int>(tiles.size());
+	// Weights are relative to the mean per-channel sum of squares of a tile, so they do not depend on the tile size
+	const double tileScale = total.sourceSource.trace() / (3.0 * count);
+	const double neighborWeight = grid.smoothing * tileScale;
+	const double anchorWeight = kTileAnchorWeight * tileScale;
+
+	std::vector<Eigen::Triplet<double>> entries;
+	entries.reserve(static_cast<size_t>(count) * 21);
+	Eigen::MatrixXd rightHandSide(3 * count, 3);
+	for (int row = 0; row < grid.rows; ++row) {
+		for (int column = 0; column < grid.columns; ++column) {
+			const int tile = row * grid.columns + column;
+			int neighbors = 0;
+			auto couple = [&](int otherRow, int otherColumn) {
+				if (otherRow < 0 || otherRow >= grid.rows || otherColumn < 0 || otherColumn >= grid.columns) {
+					return;
+				}
+				const int other = otherRow * grid.columns + otherColumn;
+				for (int i = 0; i < 3; ++i) {
+					entries.emplace_back(3 * tile + i, 3 * other + i, -neighborWeight);
+				}
+				++neighbors;
+			};
+			couple(row - 1, column);
+			couple(row + 1, column);
+			couple(row, column - 1);
+			couple(row, column + 1);
+
+			const Eigen::Matrix3d block = tiles[tile].sourceSource +
+										  (neighbors * neighborWeight + anchorWeight) * Eigen::Matrix3d::Identity();
+			for (int r = 0; r < 3; ++r) {
+				for (int c = 0; c < 3; ++c) {
+					entries.emplace_back(3 * tile + r, 3 * tile + c, block(r, c));
+				}
+			}
+			rightHandSide.block<3, 3>(3 * tile, 0) = tiles[tile].sourceTarget + anchorWeight * globalFit;
+		}
+	}
+
+	Eigen::SparseMatrix<double> system(3 * count, 3 * count);
+	system.setFromTriplets(entries.begin(), entries.end());
+	Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt(system);
+	if (ldlt.info() != Eigen::Success) {
+		throw std::runtime_error("The tiled normal equations are singular");
+	}
+	const Eigen::MatrixXd solution = ldlt.solve(rightHandSide);
+
+	std::vector<Eigen::Matrix3d> matrices(count);
+	for (int tile = 0; tile < count; ++tile) {
+		matrices[tile] = solution.block<3, 3>(3 * tile, 0).transpose();
+	}
+	return matrices;
+}
+
+// Weighted statistics of one reweighting pass and the pixels they cover
+struct ReweightedEquations {
+	NormalEquations equations;
+	uint64_t pixels = 0;
+
+	void merge(const ReweightedEquations& other) {
+		equations.merge(other.equations);
+		pixels += other.pixels;
+	}
+};
+
+// Iteratively reweighted least squares: each pass weights every pixel by the loss at its current residual
+// and re-solves the weighted normal equations. Only the 3x3 statistics are rebuilt per pass.
+// pixels, when given, receives the number of pixels fitted.
+template <typename Samples>
+ColorCorrectionMatrix SolveReweighted(const Samples& samples, ColorCorrectionMatrix current, const RobustOptions& robust,
+									  ThreadPool* threadPool, int& iterations, uint64_t* pixels = nullptr) {
+	iterations = 0;
+	while (iterations < robust.maxIterations) {
+		const Eigen::Matrix3d matrix = current.matrix;
+		ReweightedEquations pass = ReduceBands<ReweightedEquations>(samples.size(), threadPool, [&](size_t begin, size_t end) {
+			ReweightedEquations band;
+			samples.visit(begin, end, [&](const auto* s, const auto* t, uint64_t count) {
+				const Eigen::Vector3d source = samples.color(s);
+				const Eigen::Vector3d target = samples.color(t);
+				const double residual = (matrix * source - target).norm();
+				band.equations.add(source, target, count * ColorCorrectionMatrixSolver::RobustWeight(robust.loss, residual, robust.scale));
+				band.pixels += count;
+			});
+			return band;
+		});
+		++iterations;
+		if (pixels) {
+			*pixels = pass.pixels;
+		}
+
+		ColorCorrectionMatrix next = pass.equations.solve();
+		const double change = (next.matrix - current.matrix).cwiseAbs().maxCoeff();
+		current = next;
+		if (change < 1e-7) {
+			break;
+		}
+	}
+	return current;
+}
+
+struct InlierCount {
+	uint64_t inliers = 0;
+	uint64_t pixels = 0;
+
+	void merge(const InlierCount& other) {
+		inliers += other.inliers;
+		pixels += other.pixels;
+	}
+};
+
+// Share of the fit set whose residual(samples, source, target) is within the robust scale
+template <typename Samples, typename Residual>
+double InlierFraction(const Samples& samples, const Residual& residual, double scale, ThreadPool* threadPool) {
+	InlierCount count = ReduceBands<InlierCount>(samples.size(), threadPool, [&](size_t begin, size_t end) {
+		InlierCount band;
+		samples.visit(begin, end, [&](const auto* s, const auto* t, uint64_t pixels) {
+			if (residual(samples, s, t) <= scale) {
+				band.inliers += pixels;
+			}
+			band.pixels += pixels;
+		});
+		return band;
+	});
+	return count.pixels > 0 ? static_cast<double>(count.inliers) / count.pixels : 0.0;
+}
+
+// Least-squares statistics of a model with Count terms: sum of terms * terms^T and of terms * target^T.
+// The sizes are compile-time constants, so accumulating a pixel is fully unrolled.
+template <int Count>
+struct ModelEquations {
+	using Terms = Eigen::Matrix<double, Count, 1>;
+
+	Eigen::Matrix<double, Count, Count> termsTerms = Eigen::Matrix<double, Count, Count>::Zero();
+	Eigen::Matrix<double, Count, 3> termsTarget = Eigen::Matrix<double, Count, 3>::Zero();
+	double totalWeight = 0.0;
+	uint64_t pixels = 0;
+
+	void add(const Terms& terms, const Eigen::Vector3d& target, double weight, uint64_t count) {
+		termsTerms.noalias() += weight * terms * terms.transpose();
+		termsTarget.noalias() += weight * terms * target.transpose();
+		totalWeight += weight;
+		pixels += count;
+	}
+
+	void merge(const ModelEquations& other) {
+		termsTerms += other.termsTerms;
+		termsTarget += other.termsTarget;
+		totalWeight += other.totalWeight;
+		pixels += other.pixels;
+	}
+
+	Eigen::Matrix<double, 3, Count> solve() const {
+		if (totalWeight <= 0.0) {
+			throw std::invalid_argument("Cannot solve normal equations without any samples");
+		}
+		Eigen::LDLT<Eigen::Matrix<double, Count, Count>> ldlt(termsTerms);
+		if (ldlt.info() != Eigen::Success || ldlt.rcond() < 1e-14) {
+			throw std::runtime_error("Normal equations are singular; the start image does not have enough distinct colors for the model");
+		}
+		return ldlt.solve(termsTarget).transpose();
+	}
+};
+
+struct ModelFit {
+	ColorCorrectionMatrix correction;
+	uint64_t pixels = 0; // Fitted pixels
+	int iterations = 0;  // Reweighting passes
+};
+
+// Least-squares (and with a robust loss, IRLS) fit of one model, specialized on its term list.
+// Reweighting starts at initialGuess when given instead of at the unweighted fit.
+template <CorrectionModel Model, typename Samples>
+ModelFit FitModel(const Samples& samples, const RobustOptions& robust, const ColorCorrectionMatrix* initialGuess, ThreadPool* threadPool) {
+	constexpr int kCount = CorrectionModelTerms<Model>::kCount;
+	using Equations = ModelEquations<kCount>;
+	using Coefficients = Eigen::Matrix<double, 3, kCount>;
+
+	// Unweighted when current is null, otherwise weighted by the loss at each sample's residual under it
+	auto accumulate = [&](const Coefficients* current) {
+		return ReduceBands<Equations>(samples.size(), threadPool, [&](size_t begin, size_t end) {
+			Equations band;
+			samples.visit(begin, end, [&](const auto* s, const auto* t, uint64_t pixels) {
+				typename Equations::Terms terms;
+				samples.template terms<Model>(s, terms.data());
+				const Eigen::Vector3d target = samples.color(t);
+				double weight = static_cast<double>(pixels);
+				if (current) {
+					weight *= ColorCorrectionMatrixSolver::RobustWeight(robust.loss, (*current * terms - target).norm(), robust.scale);
+				}
+				band.add(terms, target, weight, pixels);
+			});
+			return band;
+		});
+	};
+
+	ModelFit fit;
+	const bool reweighting = robust.loss != RobustLoss::None;
+	Coefficients coefficients;
+	if (reweighting && initialGuess) {
+		coefficients = initialGuess->coefficients();
+	} else {
+		const Equations unweighted = accumulate(nullptr);
+		fit.pixels = unweighted.pixels;
+		coefficients = unweighted.solve();
+	}
+	if (reweighting) {
+		while (fit.iterations < robust.maxIterations) {
+			const Equations weighted = accumulate(&coefficients);
+			fit.pixels = weighted.pixels;
+			const Coefficients next = weighted.solve();
+			++fit.iterations;
+			const double change = (next - coefficients).cwiseAbs().maxCoeff();
+			coefficients = next;
+			if (change < 1e-7) {
+				break;
+			}
+		}
+	}
+	fit.correction = ColorCorrectionMatrix::fromCoefficients(Model, coefficients);
+	return fit;
+}
+
+// Residual of one sample under a correction, specialized on the model
+template <CorrectionModel Model>
+struct ModelResidual {
+	Eigen::Matrix<double, 3, CorrectionModelTerms<Model>::kCount> coefficients;
+
+	explicit ModelResidual(const ColorCorrectionMatrix& correction)
+		: coefficients(correction.coefficients()) {}
+
+	template <typename Samples, typename Sample>
+	double operator()(const Samples& samples, const Sample* s, const Sample* t) const {
+		Eigen::Matrix<double, CorrectionModelTerms<Model>::kCount, 1> terms;
+		samples.template terms<Model>(s, terms.data());
+		return (coefficients * terms - samples.color(t)).norm();
+	}
+};
+
+// Fit the models other than Linear, whose exact integer path stays separate
+template <typename Samples>
+ModelFit FitNonlinearModel(const Samples& samples, CorrectionModel model, const RobustOptions& robust,
+						   const ColorCorrectionMatrix* initialGuess, ThreadPool* threadPool) {
+	switch (model) {
+	case CorrectionModel::Affine:
+		return FitModel<CorrectionModel::Affine>(samples, robust, initialGuess, threadPool);
+	case CorrectionModel::RootPolynomial2:
+		return FitModel<CorrectionModel::RootPolynomial2>(samples, robust, initialGuess, threadPool);
+	case CorrectionModel::RootPolynomial3:
+		return FitModel<CorrectionModel::RootPolynomial3>(samples, robust, initialGuess, threadPool);
+	case CorrectionModel::Linear:
+	default:
+		return FitModel<CorrectionModel::Linear>(samples, robust, initialGuess, threadPool);
+	}
+}
+
+// Share of the fit set within the robust scale under a correction of any model
+template <typename Samples>
+double CorrectionInlierFraction(const Samples& samples, const ColorCorrectionMatrix& correction, double scale, ThreadPool* threadPool) {
+	switch (correction.model) {
+	case CorrectionModel::Affine:
+		return InlierFraction(samples, ModelResidual<CorrectionModel::Affine>(correction), scale, threadPool);
+	case CorrectionModel::RootPolynomial2:
+		return InlierFraction(samples, ModelResidual<CorrectionModel::RootPolynomial2>(correction), scale, threadPool);
+	case CorrectionModel::RootPolynomial3:
+		return InlierFraction(samples, ModelResidual<CorrectionModel::RootPolynomial3>(correction), scale, threadPool);
+	case CorrectionModel::Linear:
+	default: {
+		const Eigen::Matrix3d matrix = correction.matrix;
+		auto residual = [&](const Samples& set, const auto* s, const auto* t) { return (matrix * set.color(s) - set.color(t)).norm(); };
+		return InlierFraction(samples, residual, scale, threadPool);
+	}
+	}
+}
+
+// The pixels of a pair to fit: all of them, or a sample stored in samples. Sampled indices are filtered
+// for saturation once (counted in maskedSamples); full-image passes skip saturated pixels as they go.
+FitSelection SelectFitPixels(const ImageData& startImage, const ImageData& targetImage, const SolverOptions& options,
+							 std::vector<size_t>& samples, size_t& maskedSamples) {
+	const size_t totalPixels = startImage.pixelCount();
+	const bool sampling = PixelSampler::isSampling(options.sampling, totalPixels);
+	if (sampling) {
+		samples = PixelSampler::selectPixels(startImage, options.sampling);
+	}
+
+	FitSelection selection{ sampling ? &samples : nullptr, totalPixels, options.robust.maskSaturated };
+	maskedSamples = 0;
+	if (sampling && options.robust.maskSaturated) {
+		const size_t sampled = samples.size();
+		samples.erase(std::remove_if(samples.begin(), samples.end(), [&](size_t index) {
+			return IsSaturatedPixel(startImage, targetImage, index);
+		}), samples.end());
+		maskedSamples = sampled - samples.size();
+		selection.skipSaturated = false;
+	}
+	return selection;
+}
+
+// Least-squares or reweighted fit of the configured model over a fit set, filling in the report's pixel
+// count, timings, reweighting passes and inlier fraction. setup has been running since the solve began.
+template <typename Samples>
+ColorCorrectionMatrix FitSamples(const Samples& samples, const SolverOptions& options, ThreadPool* threadPool,
+								 const Stopwatch& setup, SolveReport& report) {
+	const RobustOptions& robust = options.robust;
+	const ColorCorrectionMatrix* initialGuess = options.initialGuess ? &*options.initialGuess : nullptr;
+	ColorCorrectionMatrix result;
+	if (options.model != CorrectionModel::Linear) {
+		report.setupSeconds = setup.seconds();
+		Stopwatch minimize;
+		ModelFit fit = FitNonlinearModel(samples, options.model, robust, initialGuess, threadPool);
+		result = fit.correction;
+		report.pixelsUsed = fit.pixels;
+		report.robustIterations = fit.iterations;
+		report.minimizeSeconds = minimize.seconds();
+	} else if (robust.loss != RobustLoss::None && initialGuess) {
+		// Warm start: the reweighting passes begin at the guess, so the unweighted pass is skipped
+		report.setupSeconds = setup.seconds();
+		Stopwatch minimize;
+		uint64_t pixels = 0;
+		result = SolveReweighted(samples, *initialGuess, robust, threadPool, report.robustIterations, &pixels);
+		report.pixelsUsed = pixels;
+		report.minimizeSeconds = minimize.seconds();
+	} else {
+		NormalEquations equations;
+		if constexpr (std::is_base_of_v<Rgb8Samples, Samples>) {
+			equations = samples.exact ? AccumulateExact(samples, threadPool).toNormalEquations() : AccumulateDecoded(samples, threadPool);
+		} else {
+			equations = AccumulateDecoded(samples, threadPool);
+		}
+		report.pixelsUsed = static_cast<size_t>(equations.totalWeight);
+		report.setupSeconds = setup.seconds();
+
+		Stopwatch minimize;
+		result = equations.solve();
+		if (robust.loss != RobustLoss::None) {
+			result = SolveReweighted(samples, result, robust, threadPool, report.robustIterations);
+		}
+		report.minimizeSeconds = minimize.seconds();
+	}
+
+	if (robust.loss != RobustLoss::None) {
+		report.inlierFraction = CorrectionInlierFraction(samples, result, robust.scale, threadPool);
+	}
+	return result;
+}
+
+// Order-independent sum of per-pair statistics: floating-point addition is not associative, so the
+// sums are added in a fixed order however the pairs arrived
+NormalEquations SumInOrder(std::vector<NormalEquations> sums) {
+	auto key = [](const NormalEquations& equations) {
+		return std::make_tuple(equations.totalWeight, equations.sourceSource(0, 0), equations.sourceSource(1, 1),
+							   equations.sourceSource(2, 2), equations.sourceTarget(0, 0), equations.sourceTarget(1, 1));
+	};
+	std::sort(sums.begin(), sums.end(), [&](const NormalEquations& a, const NormalEquations& b) { return key(a) < key(b); });
+	NormalEquations total;
+	for (const NormalEquations& equations : sums) {
+		total.merge(equations);
+	}
+	return total;
+}
+
+// Reweighting abandons the histogram once a band finds more than this fraction of its pixels distinct:
+// building it costs several per-pixel passes, which only pay off when colors repeat
+constexpr double kMaxDistinctPairFraction = 0.5;
+
+// Ceres and reweighting iterate, so only they gain from a warm start or a coarse-to-fine solve
+bool IsIterative(const SolverOptions& options) {
+	return options.mode == SolverMode::Ceres || options.robust.loss != RobustLoss::None;
+}
+
+// Ceres and reweighting revisit every sample, so they run on distinct color pairs weighted by their pixel count
+bool UsesColorPairs(const SolverOptions& options) {
+	return options.mode == SolverMode::Ceres || (options.robust.loss != RobustLoss::None && options.compressColorPairs);
+}
+
+void ValidateOptions(const SolverOptions& options) {
+	if (options.robust.loss != RobustLoss::None && !(options.robust.scale > 0.0)) {
+		throw std::invalid_argument("Robust loss scale must be positive");
+	}
+	if (options.model != CorrectionModel::Linear && options.mode == SolverMode::Ceres) {
+		throw std::invalid_argument(std::string("The Ceres solver fits only the linear model, not ") + CorrectionModelName(options.model));
+	}
+	if (options.pyramidLevels < 1 || options.pyramidIterations < 1 || options.maxCeresIterations < 1) {
+		throw std::invalid_argument("Pyramid levels and iteration limits must be at least 1");
+	}
+	if (options.initialGuess && (options.initialGuess->model != options.model || options.initialGuess->space != options.space)) {
+		throw std::invalid_argument(std::string("The initial guess must be a ") + CorrectionModelName(options.model) + " correction fitted in the " +
+									WorkingSpaceName(options.space) + " working space");
+	}
+}
+
+} // namespace
+
+// Statistics of the pairs added for a joint fit
+struct ColorCorrectionMatrixSolver::PairStatistics {
+	std::mutex mutex;
+	IntegerNormalEquations sums;
+	std::vector<NormalEquations> decodedSums; // Per pair, summed in a fixed order by SolvePairs
+	std::vector<ColorPairHistogram> histograms;
+	size_t pairs = 0;
+	size_t maskedPixels = 0;
+	double setupSeconds = 0.0; // Summed over the threads that added pairs
+};
+
+ColorCorrectionMatrixSolver::ColorCorrectionMatrixSolver()
+	: pairs_(std::make_unique<PairStatistics>()) {}
+
+ColorCorrectionMatrixSolver::ColorCorrectionMatrixSolver(const SolverOptions& options)
+	: options_(options), pairs_(std::make_unique<PairStatistics>()) {}
+
+ColorCorrectionMatrixSolver::~ColorCorrectionMatrixSolver() = default;
+
+ColorCorrectionMatrix NormalEquations::solve() const {
+	if (totalWeight <= 0.0) {
+		throw std::invalid_argument("Cannot solve normal equations without any samples");
+	}
+
+	// S^T S is symmetric positive semi-definite, so LDLT is both fast and stable here
+	Eigen::LDLT<Eigen::Matrix3d> ldlt(sourceSource);
+	if (ldlt.info() != Eigen::Success || ldlt.rcond() < 1e-12) {
+		throw std::runtime_error("Normal equations are singular; the start image does not span all three color channels");
+	}
+
+	ColorCorrectionMatrix result;
+	result.matrix = ldlt.solve(sourceTarget).transpose();
+	return result;
+}
+
+void ColorCorrectionMatrixSolver::ValidateImagePair(const ImageData& startImage, const ImageData& targetImage) {
+	if (!startImage.isValid() || !targetImage.isValid()) {
+		throw std::invalid_argument("Start and target images must both be valid");
+	}
 
-ColorCorrectionMatrix ColorCorrectionMatrixSolver::Solve(const ImageData& startImage, const ImageData& targetImage) {
 	// Check that images have the same dimensions and are RGB
 	if (startImage.width != targetImage.width || startImage.height != targetImage.height) {
 		throw std::invalid_argument("Images have different widths: start=" + std::to_string(startImage.width) + 
@@ -24,45 +775,443 @@ ColorCorrectionMatrix ColorCorrectionMatrixSolver::Solve(const ImageData& startI
 		throw std::invalid_argument("Images must be RGB (3 channels), but have " + std::to_string(startImage.channels) + " channels");
 	}
 
-	double m_r[3] = { 1.0, 0.0, 0.0 };
-	double m_g[3] = { 0.0, 1.0, 0.0 };
-	double m_b[3] = { 0.0, 0.0, 1.0 };
+	if (startImage.sampleType != targetImage.sampleType || startImage.transfer != targetImage.transfer) {
+		throw std::invalid_argument(std::string("Images have different sample formats: start=") + SampleTypeName(startImage.sampleType) +
+									" " + TransferFunctionName(startImage.transfer) + ", target=" + SampleTypeName(targetImage.sampleType) +
+									" " + TransferFunctionName(targetImage.transfer));
+	}
+}
 
-	ceres::Problem problem;
+NormalEquations ColorCorrectionMatrixSolver::AccumulateNormalEquations(const ImageData& startImage, const ImageData& targetImage) {
+	ValidateImagePair(startImage, targetImage);
 
-	// Iterate through all pixels in the images
-	const unsigned char* startData = startImage.data.get();
-	const unsigned char* targetData = targetImage.data.get();
-	
-	for (int y = 0; y < startImage.height; ++y) {
-		for (int x = 0; x < startImage.width; ++x) {
-			// Calculate pixel index
-			int pixelIndex = (y * startImage.width + x) * startImage.channels;
-			
-			// Extract RGB values and normalize to [0, 1] range
-			double startR = startData[pixelIndex] / 255.0;
-			double startG = startData[pixelIndex + 1] / 255.0;
-			double startB = startData[pixelIndex + 2] / 255.0;
-			
-			double targetR = targetData[pixelIndex] / 255.0;
-			double targetG = targetData[pixelIndex + 1] / 255.0;
-			double targetB = targetData[pixelIndex + 2] / 255.0;
-			
-			// Create Eigen vectors for this pixel
-			Eigen::Vector3d start(startR, startG, startB);
-			Eigen::Vector3d target(targetR, targetG, targetB);
-			
-			// Create cost function for this pixel
-			ceres::CostFunction* cost_function =
-				new ceres::AutoDiffCostFunction<CostFunctor, 3, 3, 3, 3>(new CostFunctor(start, target));
-			problem.AddResidualBlock(cost_function, nullptr, m_r, m_g, m_b);
+	const FitSelection selection{ nullptr, startImage.pixelCount(), false };
+	if (startImage.sampleType != SampleType::U8) {
+		return AccumulateDecoded(FitDecodedPixels{ selection, startImage, targetImage, WorkingSpace::Encoded }, nullptr);
+	}
+	return AccumulateExact(FitPixels(startImage, targetImage, selection, WorkingSpace::Encoded), nullptr).toNormalEquations();
+}
+
+NormalEquations ColorCorrectionMatrixSolver::AccumulateNormalEquations(ImageReader& startReader, ImageReader& targetReader, int stripRows,
+																	   WorkingSpace space) {
+	if (startReader.width() != targetReader.width() || startReader.height() != targetReader.height()) {
+		throw std::invalid_argument("Images have different dimensions: start=" + std::to_string(startReader.width()) + "x" + std::to_string(startReader.height()) +
+									", target=" + std::to_string(targetReader.width()) + "x" + std::to_string(targetReader.height()));
+	}
+
+	if (startReader.channels() != 3 || targetReader.channels() != 3) {
+		throw std::invalid_argument("Images must be RGB (3 channels), but have " + std::to_string(startReader.channels()) +
+									" and " + std::to_string(targetReader.channels()) + " channels");
+	}
+
+	// A strip never needs more rows than the image has
+	stripRows = std::clamp(stripRows, 1, std::max(1, startReader.height()));
+	std::vector<unsigned char> startStrip(startReader.rowBytes() * stripRows);
+	std::vector<unsigned char> targetStrip(targetReader.rowBytes() * stripRows);
+
+	// Linear light has no exact integer form, so its strips go into floating-point sums through the decode table
+	const Rgb8Roots<double>& roots = Rgb8Roots<double>::get(space);
+	IntegerNormalEquations sums;
+	NormalEquations decoded;
+	int rowsDone = 0;
+	while (rowsDone < startReader.height()) {
+		int startRows = startReader.readRows(startStrip.data(), stripRows);
+		int targetRows = targetReader.readRows(targetStrip.data(), stripRows);
+		if (startRows <= 0 || startRows != targetRows) {
+			throw std::runtime_error("Failed to read image rows after row " + std::to_string(rowsDone));
+		}
+
+		const size_t stripPixels = static_cast<size_t>(startRows) * startReader.width();
+		for (size_t i = 0; i < stripPixels; ++i) {
+			const unsigned char* s = startStrip.data() + i * 3;
+			const unsigned char* t = targetStrip.data() + i * 3;
+			if (space == WorkingSpace::Linear) {
+				decoded.add(Eigen::Vector3d(roots.value[s[0]], roots.value[s[1]], roots.value[s[2]]),
+							Eigen::Vector3d(roots.value[t[0]], roots.value[t[1]], roots.value[t[2]]));
+			} else {
+				sums.add(s, t);
+			}
+		}
+		rowsDone += startRows;
+	}
+	return space == WorkingSpace::Linear ? decoded : sums.toNormalEquations();
+}
+
+NormalEquations ColorCorrectionMatrixSolver::AccumulateNormalEquations(const ImageData& startImage, const ImageData& targetImage,
+																	   const std::vector<size_t>& pixelIndices) {
+	ValidateImagePair(startImage, targetImage);
+
+	const FitSelection selection{ &pixelIndices, startImage.pixelCount(), false };
+	if (startImage.sampleType != SampleType::U8) {
+		return AccumulateDecoded(FitDecodedPixels{ selection, startImage, targetImage, WorkingSpace::Encoded }, nullptr);
+	}
+	return AccumulateExact(FitPixels(startImage, targetImage, selection, WorkingSpace::Encoded), nullptr).toNormalEquations();
+}
+
+double ColorCorrectionMatrixSolver::ComputeRmse(const ImageData& startImage, const ImageData& targetImage,
+												const std::vector<size_t>& pixelIndices, const ColorCorrectionMatrix& matrix) {
+	if (pixelIndices.empty()) {
+		return 0.0;
+	}
+
+	// Linear-light predictions are clamped and encoded as the apply path stores them
+	const bool encode = matrix.space == WorkingSpace::Linear && targetImage.transfer == TransferFunction::Srgb;
+	double squaredError = 0.0;
+	for (size_t index : pixelIndices) {
+		float s[3], t[3];
+		DecodeSamples(startImage, index * 3, 3, matrix.space, s);
+		DecodeSamples(targetImage, index * 3, 3, WorkingSpace::Encoded, t);
+		Eigen::Vector3d predicted = matrix.apply(Eigen::Vector3d(s[0], s[1], s[2]));
+		if (encode) {
+			predicted = predicted.cwiseMax(0.0).cwiseMin(1.0).unaryExpr([](double value) { return SrgbCurve::encode(value); });
 		}
+		squaredError += ((predicted - Eigen::Vector3d(t[0], t[1], t[2])) * 255.0).squaredNorm();
 	}
+	return std::sqrt(squaredError / (3.0 * pixelIndices.size()));
+}
+
+double ColorCorrectionMatrixSolver::RobustWeight(RobustLoss loss, double residual, double scale) {
+	switch (loss) {
+	case RobustLoss::Huber:
+		return residual <= scale ? 1.0 : scale / residual;
+	case RobustLoss::Cauchy: {
+		const double ratio = residual / scale;
+		return 1.0 / (1.0 + ratio * ratio);
+	}
+	case RobustLoss::None:
+	default:
+		return 1.0;
+	}
+}
+
+bool ColorCorrectionMatrixSolver::IsSaturated(const unsigned char* source, const unsigned char* target) {
+	for (int c = 0; c < 3; ++c) {
+		if (source[c] == 0 || source[c] == 255 || target[c] == 0 || target[c] == 255) {
+			return true;
+		}
+	}
+	return false;
+}
+
+ColorCorrectionMatrix ColorCorrectionMatrixSolver::Solve(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool) {
+	ValidateImagePair(startImage, targetImage);
+
+	ValidateOptions(options_);
+	if (options_.pyramidLevels > 1 && IsIterative(options_) && ImagePyramid::canHalve(startImage)) {
+		return SolvePyramid(startImage, targetImage, threadPool);
+	}
+
+	const size_t totalPixels = startImage.pixelCount();
+	const bool sampling = PixelSampler::isSampling(options_.sampling, totalPixels);
+	const RobustOptions& robust = options_.robust;
+	report_ = SolveReport();
+	const bool rgb8 = startImage.sampleType == SampleType::U8;
+	if (!rgb8 && options_.mode == SolverMode::Ceres) {
+		throw std::invalid_argument("The Ceres solver needs 8-bit images");
+	}
+
+	// Restrict the fit to a bounded sample of pixels when a budget is set
+	Stopwatch setup;
+	std::vector<size_t> samples;
+	const FitSelection selection = SelectFitPixels(startImage, targetImage, options_, samples, report_.maskedPixels);
+
+	ColorCorrectionMatrix result;
+	if (rgb8) {
+		// Ceres always needs the histogram; reweighting falls back to the pixels when it would barely compress
+		const WorkingSpace codeSpace = CodeSpace(startImage, options_.space);
+		std::optional<ColorPairHistogram> histogram;
+		if (options_.mode == SolverMode::Ceres) {
+			histogram = ColorPairHistogram::build(startImage, targetImage, selection.indices, selection.skipSaturated, threadPool);
+		} else if (UsesColorPairs(options_)) {
+			histogram = ColorPairHistogram::buildIfCompressible(startImage, targetImage, selection.indices, selection.skipSaturated,
+																kMaxDistinctPairFraction, threadPool);
+		}
+
+		if (histogram) {
+			result = SolveColorPairs(*histogram, codeSpace, threadPool, setup);
+		} else {
+			result = FitSamples(FitPixels(startImage, targetImage, selection, options_.space), options_, threadPool, setup, report_);
+		}
+	} else {
+		// 16-bit and float samples rarely repeat, so they are always fitted per pixel
+		const FitDecodedPixels pixels{ selection, startImage, targetImage, options_.space };
+		result = FitSamples(pixels, options_, threadPool, setup, report_);
+	}
+	result.space = options_.space;
+
+	if (!sampling) {
+		report_.maskedPixels = totalPixels - report_.pixelsUsed;
+	}
+
+	if (sampling) {
+		// Measure what the speedup costs on pixels the fit never saw
+		Stopwatch evaluation;
+		std::vector<size_t> heldOut = PixelSampler::selectHeldOutPixels(totalPixels, samples, samples.size(), options_.sampling.seed + 1);
+		if (robust.maskSaturated) {
+			heldOut.erase(std::remove_if(heldOut.begin(), heldOut.end(), [&](size_t index) {
+				return IsSaturatedPixel(startImage, targetImage, index);
+			}), heldOut.end());
+		}
+		report_.heldOutPixels = heldOut.size();
+		report_.heldOutRmse = ComputeRmse(startImage, targetImage, heldOut, result);
+		report_.evaluationSeconds = evaluation.seconds();
+	}
+
+	return result;
+}
+
+ColorCorrectionMatrix ColorCorrectionMatrixSolver::SolvePyramid(const ImageData& startImage, const ImageData& targetImage,
+																ThreadPool* threadPool) {
+	Stopwatch pyramid;
+	const ImageData startHalf = ImagePyramid::halve(startImage, threadPool);
+	const ImageData targetHalf = ImagePyramid::halve(targetImage, threadPool);
+	SolverOptions coarseOptions = options_;
+	coarseOptions.pyramidLevels = options_.pyramidLevels - 1;
+	ColorCorrectionMatrixSolver coarse(coarseOptions);
+	const ColorCorrectionMatrix guess = coarse.Solve(startHalf, targetHalf, threadPool);
+	const int coarseLevels = coarse.report_.pyramidLevels + 1;
+	const double coarseSeconds = pyramid.seconds();
+
+	// The full-size fit starts where the coarse one ended, so a few iterations finish it
+	SolverOptions fineOptions = options_;
+	fineOptions.pyramidLevels = 1;
+	fineOptions.initialGuess = guess;
+	fineOptions.robust.maxIterations = std::min(options_.robust.maxIterations, options_.pyramidIterations);
+	fineOptions.maxCeresIterations = std::min(options_.maxCeresIterations, options_.pyramidIterations);
+	ColorCorrectionMatrixSolver fine(fineOptions);
+	ColorCorrectionMatrix result = fine.Solve(startImage, targetImage, threadPool);
+	report_ = fine.report_;
+	report_.pyramidLevels = coarseLevels;
+	report_.pyramidSeconds = coarseSeconds;
+	return result;
+}
+
+TiledCorrection ColorCorrectionMatrixSolver::SolveTiled(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool) {
+	ValidateImagePair(startImage, targetImage);
+	ValidateOptions(options_);
+
+	const TileOptions& grid = options_.tiles;
+	if (grid.columns < 1 || grid.rows < 1 || grid.columns > startImage.width || grid.rows > startImage.height) {
+		throw std::invalid_argument("The tile grid needs at least one tile, and at least one pixel per tile, in each direction");
+	}
+	if (!(grid.smoothing >= 0.0)) {
+		throw std::invalid_argument("Tile smoothing must not be negative");
+	}
+	const size_t totalPixels = startImage.pixelCount();
+	if (options_.mode != SolverMode::NormalEquations || options_.model != CorrectionModel::Linear ||
+		options_.robust.loss != RobustLoss::None || PixelSampler::isSampling(options_.sampling, totalPixels)) {
+		throw std::invalid_argument("Tiled fits support only the plain normal-equations solve of the linear model over every pixel");
+	}
+
+	report_ = SolveReport();
+	Stopwatch setup;
+	const FitSelection selection{ nullptr, totalPixels, options_.robust.maskSaturated };
+	std::vector<NormalEquations> tiles;
+	if (startImage.sampleType == SampleType::U8) {
+		tiles = AccumulateTiles(FitPixels(startImage, targetImage, selection, options_.space), startImage.width, startImage.height,
+								grid, threadPool);
+	} else {
+		tiles = AccumulateTiles(FitDecodedPixels{ selection, startImage, targetImage, options_.space }, startImage.width,
+								startImage.height, grid, threadPool);
+	}
+	NormalEquations total;
+	for (const NormalEquations& tile : tiles) {
+		total.merge(tile);
+	}
+	report_.pixelsUsed = static_cast<size_t>(total.totalWeight);
+	report_.maskedPixels = totalPixels - report_.pixelsUsed;
+	report_.setupSeconds = setup.seconds();
+
+	Stopwatch minimize;
+	TiledCorrection result;
+	result.columns = grid.columns;
+	result.rows = grid.rows;
+	result.space = options_.space;
+	result.matrices = SolveTileSystem(tiles, total, grid);
+	report_.minimizeSeconds = minimize.seconds();
+	return result;
+}
+
+void ColorCorrectionMatrixSolver::AddPair(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool) {
+	ValidateImagePair(startImage, targetImage);
+	ValidateOptions(options_);
+
+	// Joint fits keep no images, so reweighting and the models without exact integer sums run on the
+	// color-pair histogram, which only 8-bit codes fit in
+	const bool rgb8 = startImage.sampleType == SampleType::U8;
+	const bool usesHistogram = options_.mode == SolverMode::Ceres || options_.robust.loss != RobustLoss::None ||
+							   options_.model != CorrectionModel::Linear;
+	if (usesHistogram && !rgb8) {
+		throw std::invalid_argument("Joint robust, Ceres and non-linear fits need 8-bit images; 16-bit and float pairs support the plain linear fit");
+	}
+	if (usesHistogram && CodeSpace(startImage, options_.space) != options_.space) {
+		throw std::invalid_argument("Joint fits in linear light need sRGB-encoded 8-bit images");
+	}
+
+	Stopwatch setup;
+	std::vector<size_t> samples;
+	size_t maskedPixels = 0;
+	const FitSelection selection = SelectFitPixels(startImage, targetImage, options_, samples, maskedPixels);
+
+	std::optional<ColorPairHistogram> histogram;
+	std::optional<NormalEquations> decoded;
+	IntegerNormalEquations sums;
+	size_t pixelsUsed = 0;
+	if (usesHistogram) {
+		histogram = ColorPairHistogram::build(startImage, targetImage, selection.indices, selection.skipSaturated, threadPool);
+		pixelsUsed = histogram->pixelCount();
+	} else if (!rgb8) {
+		decoded = AccumulateDecoded(FitDecodedPixels{ selection, startImage, targetImage, options_.space }, threadPool);
+	} else {
+		const FitPixels pixels(startImage, targetImage, selection, options_.space);
+		if (pixels.exact) {
+			sums = AccumulateExact(pixels, threadPool);
+			pixelsUsed = sums.count;
+		} else {
+			decoded = AccumulateDecoded(pixels, threadPool);
+		}
+	}
+	if (decoded) {
+		pixelsUsed = static_cast<size_t>(decoded->totalWeight);
+	}
+	if (!selection.indices) {
+		maskedPixels = selection.totalPixels - pixelsUsed;
+	}
+	const double seconds = setup.seconds();
+
+	// Integer sums and histogram merges are exact and per-pair sums are added in a fixed order, so the
+	// result does not depend on the order pairs arrive in
+	std::lock_guard<std::mutex> lock(pairs_->mutex);
+	if (histogram) {
+		pairs_->histograms.push_back(std::move(*histogram));
+	} else if (decoded) {
+		pairs_->decodedSums.push_back(*decoded);
+	} else {
+		pairs_->sums.merge(sums);
+	}
+	++pairs_->pairs;
+	pairs_->maskedPixels += maskedPixels;
+	pairs_->setupSeconds += seconds;
+}
+
+ColorCorrectionMatrix ColorCorrectionMatrixSolver::SolvePairs(ThreadPool* threadPool) {
+	PairStatistics pairs;
+	{
+		std::lock_guard<std::mutex> lock(pairs_->mutex);
+		pairs.sums = pairs_->sums;
+		pairs.decodedSums = std::move(pairs_->decodedSums);
+		pairs.histograms = std::move(pairs_->histograms);
+		pairs.pairs = pairs_->pairs;
+		pairs.maskedPixels = pairs_->maskedPixels;
+		pairs.setupSeconds = pairs_->setupSeconds;
+		pairs_->sums = IntegerNormalEquations();
+		pairs_->decodedSums.clear();
+		pairs_->histograms.clear();
+		pairs_->pairs = 0;
+		pairs_->maskedPixels = 0;
+		pairs_->setupSeconds = 0.0;
+	}
+	if (pairs.pairs == 0) {
+		throw std::invalid_argument("No image pairs were added to the joint fit");
+	}
+
+	report_ = SolveReport();
+	Stopwatch setup;
+	ColorCorrectionMatrix result;
+	if (!pairs.histograms.empty()) {
+		const ColorPairHistogram histogram = ColorPairHistogram::merge(std::move(pairs.histograms), threadPool);
+		result = SolveColorPairs(histogram, options_.space, threadPool, setup);
+	} else {
+		// Encoded 8-bit pairs are in the integer sums; the rest each brought their own
+		NormalEquations equations = pairs.sums.toNormalEquations();
+		equations.merge(SumInOrder(std::move(pairs.decodedSums)));
+		report_.pixelsUsed = static_cast<size_t>(equations.totalWeight);
+		report_.setupSeconds = setup.seconds();
+		Stopwatch minimize;
+		result = equations.solve();
+		report_.minimizeSeconds = minimize.seconds();
+	}
+	result.space = options_.space;
+	report_.maskedPixels = pairs.maskedPixels;
+	report_.setupSeconds += pairs.setupSeconds;
+	return result;
+}
+
+ColorCorrectionMatrix ColorCorrectionMatrixSolver::SolveColorPairs(const ColorPairHistogram& histogram, WorkingSpace codeSpace,
+																	ThreadPool* threadPool, const Stopwatch& setup) {
+	report_.colorPairs = histogram.size();
+	if (options_.mode != SolverMode::Ceres) {
+		return FitSamples(FitHistogram(histogram, codeSpace), options_, threadPool, setup, report_);
+	}
+
+	report_.pixelsUsed = histogram.pixelCount();
+	ColorCorrectionMatrix result = SolveCeres(histogram, codeSpace, setup);
+	if (options_.robust.loss != RobustLoss::None) {
+		report_.inlierFraction = CorrectionInlierFraction(FitHistogram(histogram, codeSpace), result, options_.robust.scale, threadPool);
+	}
+	return result;
+}
+
+ColorCorrectionMatrix ColorCorrectionMatrixSolver::SolveCeres(const ColorPairHistogram& histogram, WorkingSpace codeSpace,
+															   const Stopwatch& setup) {
+	if (histogram.size() == 0) {
+		throw std::invalid_argument("No pixels left to fit after masking saturated pixels");
+	}
+
+	// Start from the identity unless the caller or a coarser pyramid level gave a guess
+	const Eigen::Matrix3d initial = options_.initialGuess ? options_.initialGuess->matrix : Eigen::Matrix3d::Identity();
+	double m_r[3] = { initial(0, 0), initial(1, 0), initial(2, 0) };
+	double m_g[3] = { initial(0, 1), initial(1, 1), initial(2, 1) };
+	double m_b[3] = { initial(0, 2), initial(1, 2), initial(2, 2) };
+
+	// The losses are shared or wrap a shared loss, so they are owned here rather than by the problem.
+	// Declared before the problem so they outlive it.
+	std::vector<std::unique_ptr<ceres::LossFunction>> losses;
+	ceres::LossFunction* loss = nullptr;
+	switch (options_.robust.loss) {
+	case RobustLoss::Huber:
+		loss = new ceres::HuberLoss(options_.robust.scale);
+		break;
+	case RobustLoss::Cauchy:
+		loss = new ceres::CauchyLoss(options_.robust.scale);
+		break;
+	case RobustLoss::None:
+	default:
+		break;
+	}
+	losses.emplace_back(loss);
+
+	ceres::Problem::Options problemOptions;
+	problemOptions.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+	ceres::Problem problem(problemOptions);
+
+	// One residual block per distinct color pair, its loss scaled by the number of pixels it stands for
+	const Rgb8Roots<double>& roots = Rgb8Roots<double>::get(codeSpace);
+	for (const ColorPairHistogram::Entry& entry : histogram.entries()) {
+		// Look up the RGB values on the 0..1 working scale
+		Eigen::Vector3d start(roots.value[entry.source(0)], roots.value[entry.source(1)], roots.value[entry.source(2)]);
+		Eigen::Vector3d target(roots.value[entry.target(0)], roots.value[entry.target(1)], roots.value[entry.target(2)]);
+
+		ceres::LossFunction* pairLoss = loss;
+		if (entry.count > 1) {
+			pairLoss = new ceres::ScaledLoss(loss, static_cast<double>(entry.count), ceres::DO_NOT_TAKE_OWNERSHIP);
+			losses.emplace_back(pairLoss);
+		}
+
+		ceres::CostFunction* cost_function =
+			new ceres::AutoDiffCostFunction<CostFunctor, 3, 3, 3, 3>(new CostFunctor(start, target));
+		problem.AddResidualBlock(cost_function, pairLoss, m_r, m_g, m_b);
+	}
+
+	report_.setupSeconds = setup.seconds();
 
 	ceres::Solver::Options options;
 	options.minimizer_progress_to_stdout = true;
+	options.max_num_iterations = options_.maxCeresIterations;
 	ceres::Solver::Summary summary;
+	Stopwatch minimize;
 	ceres::Solve(options, &problem, &summary);
+	report_.minimizeSeconds = minimize.seconds();
 	std::cout << summary.BriefReport() << "\n";
 
 	// Construct the result matrix from the optimized parameters
@@ -73,58 +1222,3 @@ ColorCorrectionMatrix ColorCorrectionMatrixSolver::Solve(const ImageData& startI
 	
 	return result;
 }
-
-ImageData ColorCorrectionMatrixSolver::ApplyMatrix(const ImageData& inputImage, const ColorCorrectionMatrix& correctionMatrix) {
-    // Validate input image
-    if (!inputImage.isValid()) {
-        throw std::invalid_argument("Input image is not valid");
-    }
-    
-    if (inputImage.channels != 3) {
-        throw std::invalid_argument("Image must be RGB (3 channels), but has " + std::to_string(inputImage.channels) + " channels");
-    }
-    
-    // Create output image with same dimensions
-    ImageData outputImage;
-    outputImage.width = inputImage.width;
-    outputImage.height = inputImage.height;
-    outputImage.channels = inputImage.channels;
-    
-    // Allocate memory for output image data
-    int totalPixels = inputImage.width * inputImage.height * inputImage.channels;
-    unsigned char* outputData = new unsigned char[totalPixels];
-    outputImage.data = std::unique_ptr<unsigned char, void(*)(void*)>(outputData, [](void* ptr) { delete[] static_cast<unsigned char*>(ptr); });
-    
-    const unsigned char* inputData = inputImage.data.get();
-    
-    // Process each pixel
-    for (int y = 0; y < inputImage.height; ++y) {
-        for (int x = 0; x < inputImage.width; ++x) {
-            // Calculate pixel index
-            int pixelIndex = (y * inputImage.width + x) * inputImage.channels;
-            
-            // Extract RGB values and normalize to [0, 1] range
-            double r = inputData[pixelIndex] / 255.0;
-            double g = inputData[pixelIndex + 1] / 255.0;
-            double b = inputData[pixelIndex + 2] / 255.0;
-            
-            // Create input color vector
-            Eigen::Vector3d inputColor(r, g, b);
-            
-            // Apply color correction matrix
-            Eigen::Vector3d correctedColor = correctionMatrix.apply(inputColor);
-            
-            // Clamp values to [0, 1] range
-            correctedColor[0] = std::max(0.0, std::min(1.0, correctedColor[0]));
-            correctedColor[1] = std::max(0.0, std::min(1.0, correctedColor[1]));
-            correctedColor[2] = std::max(0.0, std::min(1.0, correctedColor[2]));
-            
-            // Convert back to [0, 255] range and store in output
-            outputData[pixelIndex] = static_cast<unsigned char>(std::round(correctedColor[0] * 255.0));
-            outputData[pixelIndex + 1] = static_cast<unsigned char>(std::round(correctedColor[1] * 255.0));
-            outputData[pixelIndex + 2] = static_cast<unsigned char>(std::round(correctedColor[2] * 255.0));
-        }
-    }
-    
-    return outputImage;
-}
\ No newline at end of file
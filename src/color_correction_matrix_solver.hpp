@@ -1,33 +1,230 @@
 #pragma once
 
-#include <ceres/ceres.h>
 #include <Eigen/Dense>
+#include <memory>
+#include <optional>
+#include <string>
+#include <color_correction_matrix.hpp>
 #include <image_data.hpp>
+#include <pixel_sampler.hpp>
+#include <tiled_correction.hpp>
 
-// Represents a 3x3 color correction matrix
-struct ColorCorrectionMatrix {
-    Eigen::Matrix3d matrix;
+class ImageReader;
+class ImageWriter;
+class ThreadPool;
+class Stopwatch;
+class ColorPairHistogram;
 
-    ColorCorrectionMatrix()
-        : matrix(Eigen::Matrix3d::Identity()) {}
+// Selects how Solve fits the color correction matrix
+enum class SolverMode {
+    NormalEquations, // Closed-form linear least squares over streamed per-pixel statistics
+    Ceres            // Ceres residual block per distinct color pair (for robust or nonlinear objectives)
+};
+
+enum class RobustLoss {
+    None,   // Plain least squares
+    Huber,  // Quadratic up to the scale, linear beyond it
+    Cauchy  // Logarithmic; residuals far beyond the scale get almost no weight
+};
+
+// Names used on the command line and in daemon requests
+inline const char* SolverModeName(SolverMode mode) {
+    return mode == SolverMode::Ceres ? "ceres" : "normal";
+}
+
+inline std::optional<SolverMode> ParseSolverMode(const std::string& name) {
+    for (SolverMode mode : { SolverMode::NormalEquations, SolverMode::Ceres }) {
+        if (name == SolverModeName(mode)) {
+            return mode;
+        }
+    }
+    return std::nullopt;
+}
 
-    ColorCorrectionMatrix(const Eigen::Matrix3d& m, const Eigen::Vector3d& o)
-        : matrix(m) {}
+inline const char* RobustLossName(RobustLoss loss) {
+    switch (loss) {
+    case RobustLoss::Huber:
+        return "huber";
+    case RobustLoss::Cauchy:
+        return "cauchy";
+    case RobustLoss::None:
+    default:
+        return "none";
+    }
+}
 
-    // Apply the color correction to a color vector (RGB)
-    Eigen::Vector3d apply(const Eigen::Vector3d& color) const {
-        return matrix * color;
+inline std::optional<RobustLoss> ParseRobustLoss(const std::string& name) {
+    for (RobustLoss loss : { RobustLoss::None, RobustLoss::Huber, RobustLoss::Cauchy }) {
+        if (name == RobustLossName(loss)) {
+            return loss;
+        }
     }
+    return std::nullopt;
+}
+
+struct RobustOptions {
+    RobustLoss loss = RobustLoss::None;
+    double scale = 0.02;        // Residual (RGB distance on the 0..1 working scale) where the loss stops being quadratic
+    int maxIterations = 10;     // Reweighting passes of the normal-equations solver
+    bool maskSaturated = false; // Leave out pixels with a channel at either end of its range (0 or 255) in either image
+};
+
+// Grid of a spatially varying fit (SolveTiled)
+struct TileOptions {
+    int columns = 1;
+    int rows = 1;
+    // Weight pulling each tile's matrix toward its neighbors', relative to the pixels of an average tile;
+    // 0 fits the tiles independently, large values approach a single matrix
+    double smoothing = 0.1;
+};
+
+struct SolverOptions {
+    SolverMode mode = SolverMode::NormalEquations;
+    CorrectionModel model = CorrectionModel::Linear; // Models other than Linear need the normal-equations solver
+    // Fit in linear light, decoding sRGB images, or on the stored values as earlier versions did.
+    // The fitted correction records it, so applying it decodes and re-encodes the same way.
+    WorkingSpace space = WorkingSpace::Linear;
+    SamplingOptions sampling;
+    RobustOptions robust;
+    // Reweight over distinct (source, target) color pairs instead of pixels; the Ceres solver always does
+    bool compressColorPairs = true;
+    int maxCeresIterations = 50; // Minimizer iterations of the Ceres solver
+
+    // Starting point of the iterative fits (reweighting passes, Ceres) in place of the unweighted fit or the
+    // identity, e.g. the matrix of the previous frame of a sequence. It must have the configured model and
+    // working space; the closed-form least-squares fit does not need one.
+    std::optional<ColorCorrectionMatrix> initialGuess;
+    // Coarse-to-fine solve over this many resolution levels (1 = off): each level fits a 2x area-downsampled
+    // copy of the pair and warm-starts the next finer one. Only iterative fits use it.
+    int pyramidLevels = 1;
+    // Reweighting passes or Ceres iterations allowed at each warm-started finer level
+    int pyramidIterations = 3;
+    TileOptions tiles;
+};
+
+// Statistics about the most recent Solve
+struct SolveReport {
+    size_t pixelsUsed = 0;    // Pixels that contributed to the fit
+    size_t heldOutPixels = 0; // Pixels left out by sampling and used to measure the fit (0 without sampling)
+    double heldOutRmse = 0.0; // Per-channel RMS error on the held-out pixels, in 8-bit code values
+    double setupSeconds = 0.0;      // Sampling plus accumulating the normal equations or building the Ceres problem
+    double minimizeSeconds = 0.0;   // Solving the normal equations or running the Ceres minimizer
+    double evaluationSeconds = 0.0; // Held-out error measurement
+    size_t maskedPixels = 0;    // Saturated pixels left out of the fit
+    int robustIterations = 0;   // Reweighting passes run by the robust normal-equations solver
+    double inlierFraction = 0.0; // Share of fitted pixels whose residual is within the robust scale (robust mode only)
+    size_t colorPairs = 0;      // Distinct color pairs the fit was compressed to (0 when it ran over pixels)
+    int pyramidLevels = 0;          // Coarser levels solved to warm-start this fit
+    double pyramidSeconds = 0.0;    // Downsampling plus the coarser solves
+};
+
+// Sufficient statistics of the least-squares problem M * source ~= target.
+// Accumulating them is a single streaming pass with O(1) memory in the image size.
+struct NormalEquations {
+    Eigen::Matrix3d sourceSource = Eigen::Matrix3d::Zero(); // sum of source * source^T
+    Eigen::Matrix3d sourceTarget = Eigen::Matrix3d::Zero(); // sum of source * target^T
+    double totalWeight = 0.0;
+
+    void add(const Eigen::Vector3d& source, const Eigen::Vector3d& target, double weight = 1.0) {
+        sourceSource.noalias() += weight * source * source.transpose();
+        sourceTarget.noalias() += weight * source * target.transpose();
+        totalWeight += weight;
+    }
+
+    void merge(const NormalEquations& other) {
+        sourceSource += other.sourceSource;
+        sourceTarget += other.sourceTarget;
+        totalWeight += other.totalWeight;
+    }
+
+    // Solve (S^T S) M^T = S^T T for the matrix minimizing the summed squared error
+    ColorCorrectionMatrix solve() const;
 };
 
 class ColorCorrectionMatrixSolver {
 public:
-    ColorCorrectionMatrix Solve(const ImageData& startImage, const ImageData& targetImage);
+    ColorCorrectionMatrixSolver();
+    explicit ColorCorrectionMatrixSolver(const SolverOptions& options);
+    ~ColorCorrectionMatrixSolver();
+
+    // Fit the matrix; the reweighting passes of the robust solver run on the pool's threads when given
+    ColorCorrectionMatrix Solve(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool = nullptr);
+
+    // Spatially varying fit of a linear matrix per tile of the options' grid, for vignetting or uneven
+    // lighting one matrix cannot follow. Per-tile normal equations are accumulated in one parallel pass, then
+    // solved together with each tile pulled toward its neighbors, so the cost stays close to Solve's.
+    // Supports the plain least-squares linear fit over every pixel (saturated pixels may be masked).
+    TiledCorrection SolveTiled(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool = nullptr);
+
+    // Joint fit of one matrix over many image pairs, e.g. several shots of a chart against their references.
+    // AddPair folds a pair into its statistics (integer sums, per-pair sums in linear light or for 16-bit and
+    // float images, or a color-pair histogram for robust, Ceres and non-linear fits of 8-bit images), after
+    // which its images can be released. It is thread-safe, so pairs can be added as they are decoded.
+    // Sampling picks the fitted pixels of each pair; there is no held-out evaluation.
+    void AddPair(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool = nullptr);
+    // Fit the matrix to every pair added so far and start a new set; the report covers all pairs
+    ColorCorrectionMatrix SolvePairs(ThreadPool* threadPool = nullptr);
     
-    // Apply a color correction matrix to an image
-    static ImageData ApplyMatrix(const ImageData& inputImage, const ColorCorrectionMatrix& correctionMatrix);
+    // Apply a color correction matrix to an image, split into row bands across the pool's threads when given.
+    // Defined in color_correction_apply.cpp so apply-only builds do not need the solver or Ceres.
+    // The result's storage comes from BufferPool::shared().
+    static ImageData ApplyMatrix(const ImageData& inputImage, const ColorCorrectionMatrix& correctionMatrix, ThreadPool* threadPool = nullptr);
+
+    // Apply into a caller-allocated image of the same dimensions; outputImage may be inputImage
+    static void ApplyMatrixInto(const ImageData& inputImage, ImageData& outputImage, const ColorCorrectionMatrix& correctionMatrix,
+                                ThreadPool* threadPool = nullptr);
+
+    // Apply in place, allocating nothing
+    static void ApplyMatrixInPlace(ImageData& image, const ColorCorrectionMatrix& correctionMatrix, ThreadPool* threadPool = nullptr);
+
+    // Apply a tiled correction, blending its matrices per pixel; outputImage may be inputImage
+    static void ApplyTiledInto(const ImageData& inputImage, ImageData& outputImage, const TiledCorrection& correction,
+                               ThreadPool* threadPool = nullptr);
+
+    // Apply a color correction matrix strip by strip from a reader to a writer; throws on I/O failure
+    static void ApplyMatrix(ImageReader& reader, ImageWriter& writer, const ColorCorrectionMatrix& correctionMatrix,
+                            int stripRows, ThreadPool* threadPool = nullptr);
+
+    const SolveReport& GetReport() const { return report_; }
+
+    // Accumulate the normal equations of an image pair on its stored values in a single pass
+    static NormalEquations AccumulateNormalEquations(const ImageData& startImage, const ImageData& targetImage);
+    // Accumulate the normal equations from two 8-bit sRGB row streams, holding only one strip of each in memory
+    static NormalEquations AccumulateNormalEquations(ImageReader& startReader, ImageReader& targetReader, int stripRows,
+                                                     WorkingSpace space = WorkingSpace::Encoded);
+    // Accumulate the normal equations over the given flat pixel indices only
+    static NormalEquations AccumulateNormalEquations(const ImageData& startImage, const ImageData& targetImage,
+                                                     const std::vector<size_t>& pixelIndices);
+
+    // IRLS weight of a residual under the loss: 1 inside the scale, falling off beyond it
+    static double RobustWeight(RobustLoss loss, double residual, double scale);
+
+    // True when a channel of either 8-bit pixel is clipped at 0 or 255
+    static bool IsSaturated(const unsigned char* source, const unsigned char* target);
+
+    // Per-channel RMS error of the matrix over the given pixels, in 8-bit code values of the stored target
+    // (predictions in linear light are encoded first)
+    static double ComputeRmse(const ImageData& startImage, const ImageData& targetImage,
+                              const std::vector<size_t>& pixelIndices, const ColorCorrectionMatrix& matrix);
 
 private:
+    struct PairStatistics;
+
+    static void ValidateImagePair(const ImageData& startImage, const ImageData& targetImage);
+    // Solve a half-size copy of the pair (recursively, for further levels) and warm-start the full-size fit from it
+    ColorCorrectionMatrix SolvePyramid(const ImageData& startImage, const ImageData& targetImage, ThreadPool* threadPool);
+    // Normal-equations or Ceres fit over a color-pair histogram, including the robust inlier fraction.
+    // codeSpace is the scale its 8-bit codes are read on.
+    ColorCorrectionMatrix SolveColorPairs(const ColorPairHistogram& histogram, WorkingSpace codeSpace, ThreadPool* threadPool,
+                                          const Stopwatch& setup);
+    // One residual block per distinct color pair, weighted by its pixel count.
+    // setup has been running since Solve began, so sampling and the histogram count toward the setup time.
+    ColorCorrectionMatrix SolveCeres(const ColorPairHistogram& histogram, WorkingSpace codeSpace, const Stopwatch& setup);
+
+    SolverOptions options_;
+    SolveReport report_;
+    std::unique_ptr<PairStatistics> pairs_; // Accumulated by AddPair
+
     struct CostFunctor {
         Eigen::Vector3d source;
         Eigen::Vector3d target;
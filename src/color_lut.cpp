@@ -0,0 +1,262 @@
+#include "color_lut.hpp"
+#include "buffer_pool.hpp"
+#include "color_correction_kernels.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+ColorLut3D ColorLut3D::bake(const ColorCorrectionMatrix& matrix, const LutOptions& options, ThreadPool* threadPool) {
+    if (options.size < 2 || options.size > kFullSize) {
+        throw std::invalid_argument("LUT size must be between 2 and " + std::to_string(kFullSize) + ", got " + std::to_string(options.size));
+    }
+    
+    ColorLut3D lut;
+    lut.size_ = options.size;
+    lut.interpolation_ = options.interpolation;
+    
+    if (lut.isFull()) {
+        lut.bakeFull(matrix, threadPool);
+    } else {
+        lut.bakeLattice(matrix);
+    }
+    return lut;
+}
+
+void ColorLut3D::bakeFull(const ColorCorrectionMatrix& matrix, ThreadPool* threadPool) {
+    table_.resize(size_t(3) << 24);
+    
+    // Run every color through the apply kernel so the table reproduces ApplyMatrix bit for bit
+    auto bakeReds = [&](size_t beginRed, size_t endRed) {
+        unsigned char row[256 * 3];
+        for (size_t r = beginRed; r < endRed; ++r) {
+            for (int g = 0; g < 256; ++g) {
+                for (int b = 0; b < 256; ++b) {
+                    row[b * 3] = static_cast<unsigned char>(r);
+                    row[b * 3 + 1] = static_cast<unsigned char>(g);
+                    row[b * 3 + 2] = static_cast<unsigned char>(b);
+                }
+                ApplyCorrectionRgb8(row, table_.data() + ((r << 16) | (size_t(g) << 8)) * 3, 256, matrix);
+            }
+        }
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(256, bakeReds);
+    } else {
+        bakeReds(0, 256);
+    }
+}
+
+void ColorLut3D::bakeLattice(const ColorCorrectionMatrix& matrix) {
+    const int n = size_;
+    lattice_.resize(size_t(n) * n * n * 3);
+    
+    for (int b = 0; b < n; ++b) {
+        for (int g = 0; g < n; ++g) {
+            for (int r = 0; r < n; ++r) {
+                // Nodes sit on stored code values, so corrections in linear light decode and encode around them
+                Eigen::Vector3d color(double(r) / (n - 1), double(g) / (n - 1), double(b) / (n - 1));
+                Eigen::Vector3d corrected = matrix.applyToEncoded(color);
+                int32_t* node = lattice_.data() + ((size_t(b) * n + g) * n + r) * 3;
+                for (int c = 0; c < 3; ++c) {
+                    node[c] = static_cast<int32_t>(std::lround(corrected[c] * 255.0 * 256.0));
+                }
+            }
+        }
+    }
+    
+    // Position of each 8-bit value on the lattice axis, split into a cell index and a fixed-point weight
+    for (int v = 0; v < 256; ++v) {
+        int index = v * (n - 1) / 255;
+        if (index == n - 1) {
+            index = n - 2;
+        }
+        nodeIndex_[v] = index;
+        nodeWeight_[v] = static_cast<int32_t>(((v * (n - 1) - index * 255) * 256 + 127) / 255);
+    }
+}
+
+void ColorLut3D::applyRows(const unsigned char* input, unsigned char* output, size_t pixelCount) const {
+    if (isFull()) {
+        applyFull(input, output, pixelCount);
+    } else if (interpolation_ == LutInterpolation::Trilinear) {
+        applyTrilinear(input, output, pixelCount);
+    } else {
+        applyTetrahedral(input, output, pixelCount);
+    }
+}
+
+void ColorLut3D::applyFull(const unsigned char* input, unsigned char* output, size_t pixelCount) const {
+    const uint8_t* table = table_.data();
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        const uint8_t* entry = table + ((size_t(in[0]) << 16) | (size_t(in[1]) << 8) | in[2]) * 3;
+        unsigned char* out = output + i * 3;
+        out[0] = entry[0];
+        out[1] = entry[1];
+        out[2] = entry[2];
+    }
+}
+
+void ColorLut3D::applyTrilinear(const unsigned char* input, unsigned char* output, size_t pixelCount) const {
+    const size_t strideG = size_t(size_) * 3;
+    const size_t strideB = strideG * size_;
+    
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        const int64_t fr = nodeWeight_[in[0]], fg = nodeWeight_[in[1]], fb = nodeWeight_[in[2]];
+        const int32_t* c000 = lattice_.data() + nodeIndex_[in[2]] * strideB + nodeIndex_[in[1]] * strideG + nodeIndex_[in[0]] * 3;
+        
+        // Weights of the 8 cell corners; they sum to 2^24
+        const int64_t w[8] = {
+            (256 - fr) * (256 - fg) * (256 - fb), fr * (256 - fg) * (256 - fb),
+            (256 - fr) * fg * (256 - fb),         fr * fg * (256 - fb),
+            (256 - fr) * (256 - fg) * fb,         fr * (256 - fg) * fb,
+            (256 - fr) * fg * fb,                 fr * fg * fb
+        };
+        const size_t offsets[8] = { 0, 3, strideG, strideG + 3, strideB, strideB + 3, strideB + strideG, strideB + strideG + 3 };
+        
+        unsigned char* out = output + i * 3;
+        for (int c = 0; c < 3; ++c) {
+            int64_t sum = 0;
+            for (int k = 0; k < 8; ++k) {
+                sum += w[k] * c000[offsets[k] + c];
+            }
+            // Lattice values are in 1/256ths and weights in 1/2^24ths of a code value
+            out[c] = static_cast<unsigned char>((sum + (int64_t(1) << 31)) >> 32);
+        }
+    }
+}
+
+void ColorLut3D::applyTetrahedral(const unsigned char* input, unsigned char* output, size_t pixelCount) const {
+    const size_t strideR = 3;
+    const size_t strideG = size_t(size_) * 3;
+    const size_t strideB = strideG * size_;
+    
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const unsigned char* in = input + i * 3;
+        const int32_t fr = nodeWeight_[in[0]], fg = nodeWeight_[in[1]], fb = nodeWeight_[in[2]];
+        const int32_t* c000 = lattice_.data() + nodeIndex_[in[2]] * strideB + nodeIndex_[in[1]] * strideG + nodeIndex_[in[0]] * 3;
+        const int32_t* c111 = c000 + strideR + strideG + strideB;
+        
+        // Pick the tetrahedron by ordering the fractional coordinates; each uses 4 corners
+        const int32_t* c1;
+        const int32_t* c2;
+        int32_t w0, w1, w2, w3;
+        if (fr >= fg) {
+            if (fg >= fb) {
+                c1 = c000 + strideR; c2 = c1 + strideG;
+                w0 = 256 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+            } else if (fr >= fb) {
+                c1 = c000 + strideR; c2 = c1 + strideB;
+                w0 = 256 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+            } else {
+                c1 = c000 + strideB; c2 = c1 + strideR;
+                w0 = 256 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+            }
+        } else {
+            if (fr >= fb) {
+                c1 = c000 + strideG; c2 = c1 + strideR;
+                w0 = 256 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+            } else if (fg >= fb) {
+                c1 = c000 + strideG; c2 = c1 + strideB;
+                w0 = 256 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+            } else {
+                c1 = c000 + strideB; c2 = c1 + strideG;
+                w0 = 256 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+            }
+        }
+        
+        unsigned char* out = output + i * 3;
+        for (int c = 0; c < 3; ++c) {
+            int32_t sum = w0 * c000[c] + w1 * c1[c] + w2 * c2[c] + w3 * c111[c];
+            out[c] = static_cast<unsigned char>((sum + (1 << 15)) >> 16);
+        }
+    }
+}
+
+ImageData ColorLut3D::apply(const ImageData& inputImage, ThreadPool* threadPool) const {
+    if (!inputImage.isValid()) {
+        throw std::invalid_argument("Input image is not valid");
+    }
+    
+    ImageData outputImage = BufferPool::shared().allocateImage(inputImage.width, inputImage.height, inputImage.channels);
+    outputImage.transfer = inputImage.transfer;
+    applyInto(inputImage, outputImage, threadPool);
+    return outputImage;
+}
+
+void ColorLut3D::applyInto(const ImageData& inputImage, ImageData& outputImage, ThreadPool* threadPool) const {
+    if (!inputImage.isValid()) {
+        throw std::invalid_argument("Input image is not valid");
+    }
+    
+    if (inputImage.channels != 3) {
+        throw std::invalid_argument("Image must be RGB (3 channels), but has " + std::to_string(inputImage.channels) + " channels");
+    }
+    
+    // Tables are indexed by 8-bit codes and baked for sRGB input
+    if (inputImage.sampleType != SampleType::U8 || inputImage.transfer != TransferFunction::Srgb) {
+        throw std::invalid_argument(std::string("LUTs apply only to 8-bit sRGB images, not ") + SampleTypeName(inputImage.sampleType) + " " +
+                                    TransferFunctionName(inputImage.transfer) + " ones");
+    }
+    
+    if (!outputImage.isValid() || outputImage.width != inputImage.width || outputImage.height != inputImage.height ||
+        outputImage.channels != inputImage.channels || outputImage.sampleType != SampleType::U8) {
+        throw std::invalid_argument("Output image must be allocated with the input image's dimensions");
+    }
+    
+    const unsigned char* inputData = inputImage.data.get();
+    unsigned char* outputData = outputImage.data.get();
+    const size_t rowBytes = static_cast<size_t>(inputImage.width) * inputImage.channels;
+    
+    auto applyBand = [&](size_t beginRow, size_t endRow) {
+        applyRows(inputData + beginRow * rowBytes, outputData + beginRow * rowBytes, (endRow - beginRow) * inputImage.width);
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(inputImage.height, applyBand);
+    } else {
+        applyBand(0, inputImage.height);
+    }
+}
+
+bool ColorLut3D::saveCube(const ColorCorrectionMatrix& matrix, int size, const std::string& path) {
+    if (size < 2 || size > kFullSize) {
+        std::cerr << "Error: .cube size must be between 2 and " << kFullSize << std::endl;
+        return false;
+    }
+    
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Error: Failed to open '" << path << "' for writing" << std::endl;
+        return false;
+    }
+    
+    file << "TITLE \"Color correction matrix\"\n";
+    file << "LUT_3D_SIZE " << size << "\n";
+    file << "DOMAIN_MIN 0.0 0.0 0.0\n";
+    file << "DOMAIN_MAX 1.0 1.0 1.0\n";
+    file << std::fixed << std::setprecision(6);
+    
+    // Red changes fastest, as the format requires
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            for (int r = 0; r < size; ++r) {
+                Eigen::Vector3d color(double(r) / (size - 1), double(g) / (size - 1), double(b) / (size - 1));
+                Eigen::Vector3d corrected = matrix.applyToEncoded(color);
+                file << corrected[0] << " " << corrected[1] << " " << corrected[2] << "\n";
+            }
+        }
+    }
+    
+    if (!file) {
+        std::cerr << "Error: Failed to write '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "color_correction_matrix.hpp"
+#include "image_data.hpp"
+
+class ThreadPool;
+
+enum class LutInterpolation {
+    Trilinear,   // Blend the 8 corners of the lattice cell
+    Tetrahedral  // Blend the 4 corners of the tetrahedron containing the color; cheaper and hue-preserving
+};
+
+struct LutOptions {
+    int size = 0; // 0 disables the LUT, kFullSize bakes every 8-bit color, otherwise the lattice size per axis
+    LutInterpolation interpolation = LutInterpolation::Tetrahedral;
+};
+
+// A correction baked into a 3D lookup table so applying it needs no per-pixel floating point.
+// The full table stores the exact 8-bit result for all 16.7M colors (48 MiB); lattices store
+// size^3 samples and interpolate with fixed-point integer weights.
+class ColorLut3D {
+public:
+    static constexpr int kFullSize = 256;
+
+    // Bake with the same clamp and rounding as ApplyMatrix. A full table matches ApplyMatrix with the same apply kernel exactly.
+    static ColorLut3D bake(const ColorCorrectionMatrix& matrix, const LutOptions& options, ThreadPool* threadPool = nullptr);
+
+    int size() const { return size_; }
+    bool isFull() const { return size_ == kFullSize; }
+    LutInterpolation interpolation() const { return interpolation_; }
+
+    // Transform pixelCount interleaved RGB pixels; input and output may be the same buffer
+    void applyRows(const unsigned char* input, unsigned char* output, size_t pixelCount) const;
+
+    // Apply to an 8-bit RGB image, split into row bands across the pool's threads when given
+    ImageData apply(const ImageData& inputImage, ThreadPool* threadPool = nullptr) const;
+
+    // Apply into a caller-allocated image of the same dimensions; outputImage may be inputImage
+    void applyInto(const ImageData& inputImage, ImageData& outputImage, ThreadPool* threadPool = nullptr) const;
+
+    // Write a size^3 lattice of the correction as an Adobe/Resolve .cube file
+    static bool saveCube(const ColorCorrectionMatrix& matrix, int size, const std::string& path);
+
+private:
+    ColorLut3D() = default;
+
+    void bakeFull(const ColorCorrectionMatrix& matrix, ThreadPool* threadPool);
+    void bakeLattice(const ColorCorrectionMatrix& matrix);
+
+    void applyFull(const unsigned char* input, unsigned char* output, size_t pixelCount) const;
+    void applyTrilinear(const unsigned char* input, unsigned char* output, size_t pixelCount) const;
+    void applyTetrahedral(const unsigned char* input, unsigned char* output, size_t pixelCount) const;
+
+    int size_ = 0;
+    LutInterpolation interpolation_ = LutInterpolation::Tetrahedral;
+
+    // Full table: 3 bytes per color, indexed by (r << 16) | (g << 8) | b
+    std::vector<uint8_t> table_;
+
+    // Lattice: 3 values per node in 1/256ths of an 8-bit code value, red index fastest
+    std::vector<int32_t> lattice_;
+    // Per 8-bit input value: lower lattice index and blend weight toward the next node (0..256)
+    int32_t nodeIndex_[256] = {};
+    int32_t nodeWeight_[256] = {};
+};
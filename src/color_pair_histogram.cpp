@@ -0,0 +1,256 @@
+#include "color_pair_histogram.hpp"
+#include "color_correction_matrix_solver.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Keys are split into shards by hash so the merge can run one shard per thread
+constexpr int kShardBits = 4;
+constexpr size_t kShardCount = size_t(1) << kShardBits;
+
+constexpr uint64_t kEmptyKey = ~uint64_t(0); // Packed keys use only 48 bits
+
+uint64_t hashKey(uint64_t key) {
+    key ^= key >> 29;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 32;
+    return key;
+}
+
+size_t shardOf(uint64_t hash) {
+    return static_cast<size_t>(hash >> (64 - kShardBits));
+}
+
+// The order of ColorPairHistogram::entries(): by hash shard, then by key
+bool precedes(uint64_t a, uint64_t b) {
+    const size_t shardA = shardOf(hashKey(a));
+    const size_t shardB = shardOf(hashKey(b));
+    return shardA != shardB ? shardA < shardB : a < b;
+}
+
+// Open-addressing count table with linear probing, kept at most half full.
+// Slots hold the key next to its count so a lookup touches one cache line.
+class PairTable {
+public:
+    void add(uint64_t key, uint64_t hash, uint64_t count) {
+        if ((size_ + 1) * 2 > slots_.size()) {
+            grow();
+        }
+        
+        const size_t mask = slots_.size() - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            ColorPairHistogram::Entry& entry = slots_[slot];
+            if (entry.key == key) {
+                entry.count += count;
+                return;
+            }
+            if (entry.key == kEmptyKey) {
+                entry = ColorPairHistogram::Entry{ key, count };
+                ++size_;
+                return;
+            }
+        }
+    }
+
+    template <typename Visit>
+    void forEach(Visit&& visit) const {
+        for (const ColorPairHistogram::Entry& entry : slots_) {
+            if (entry.key != kEmptyKey) {
+                visit(entry.key, entry.count);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    void grow() {
+        std::vector<ColorPairHistogram::Entry> slots(std::max<size_t>(1024, slots_.size() * 2),
+                                                     ColorPairHistogram::Entry{ kEmptyKey, 0 });
+        slots.swap(slots_);
+        size_ = 0;
+        for (const ColorPairHistogram::Entry& entry : slots) {
+            if (entry.key != kEmptyKey) {
+                add(entry.key, hashKey(entry.key), entry.count);
+            }
+        }
+    }
+
+    std::vector<ColorPairHistogram::Entry> slots_;
+    size_t size_ = 0;
+};
+
+using ShardedTable = std::array<PairTable, kShardCount>;
+
+} // namespace
+
+uint64_t ColorPairHistogram::pack(const unsigned char* source, const unsigned char* target) {
+    return uint64_t(source[0]) | (uint64_t(source[1]) << 8) | (uint64_t(source[2]) << 16) |
+           (uint64_t(target[0]) << 24) | (uint64_t(target[1]) << 32) | (uint64_t(target[2]) << 40);
+}
+
+ColorPairHistogram ColorPairHistogram::build(const ImageData& startImage, const ImageData& targetImage,
+                                             const std::vector<size_t>* pixelIndices, bool skipSaturated,
+                                             ThreadPool* threadPool) {
+    return *buildIfCompressible(startImage, targetImage, pixelIndices, skipSaturated, 1.0, threadPool);
+}
+
+std::optional<ColorPairHistogram> ColorPairHistogram::buildIfCompressible(const ImageData& startImage, const ImageData& targetImage,
+                                                                          const std::vector<size_t>* pixelIndices, bool skipSaturated,
+                                                                          double maxDistinctFraction, ThreadPool* threadPool) {
+    if (startImage.sampleType != SampleType::U8 || targetImage.sampleType != SampleType::U8) {
+        throw std::invalid_argument("Color-pair histograms need 8-bit images");
+    }
+
+    // Bands compare their distinct pairs to their counted pixels at this interval
+    constexpr size_t kCheckInterval = 65536;
+    const unsigned char* startData = startImage.data.get();
+    const unsigned char* targetData = targetImage.data.get();
+    const size_t count = pixelIndices ? pixelIndices->size() : static_cast<size_t>(startImage.width) * startImage.height;
+    
+    // Pass 1: every band counts into its own sharded tables
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ShardedTable>> bands;
+    std::atomic<bool> abandoned(false);
+    auto countBand = [&](size_t begin, size_t end) {
+        auto tables = std::make_unique<ShardedTable>();
+        size_t counted = 0;
+        for (size_t i = begin; i < end; ++i) {
+            if (maxDistinctFraction < 1.0 && (i - begin + 1) % kCheckInterval == 0) {
+                size_t distinct = 0;
+                for (const PairTable& table : *tables) {
+                    distinct += table.size();
+                }
+                if (distinct > maxDistinctFraction * counted) {
+                    abandoned = true;
+                }
+                if (abandoned) {
+                    return;
+                }
+            }
+            
+            const size_t index = pixelIndices ? (*pixelIndices)[i] : i;
+            const unsigned char* s = startData + index * 3;
+            const unsigned char* t = targetData + index * 3;
+            if (skipSaturated && ColorCorrectionMatrixSolver::IsSaturated(s, t)) {
+                continue;
+            }
+            const uint64_t key = pack(s, t);
+            const uint64_t hash = hashKey(key);
+            (*tables)[shardOf(hash)].add(key, hash, 1);
+            ++counted;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        bands.push_back(std::move(tables));
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(count, countBand);
+    } else {
+        countBand(0, count);
+    }
+    if (abandoned) {
+        return std::nullopt;
+    }
+    
+    // Pass 2: merge each shard across bands; shards hold disjoint keys, so they merge independently
+    std::vector<std::vector<Entry>> shardEntries(kShardCount);
+    auto mergeShards = [&](size_t beginShard, size_t endShard) {
+        for (size_t shard = beginShard; shard < endShard; ++shard) {
+            // A single band already holds every key of the shard once
+            PairTable merged;
+            if (bands.size() != 1) {
+                for (const auto& band : bands) {
+                    (*band)[shard].forEach([&](uint64_t key, uint64_t pixels) { merged.add(key, hashKey(key), pixels); });
+                }
+            }
+            const PairTable& table = bands.size() == 1 ? (*bands.front())[shard] : merged;
+            
+            std::vector<Entry>& entries = shardEntries[shard];
+            entries.reserve(table.size());
+            table.forEach([&](uint64_t key, uint64_t pixels) { entries.push_back(Entry{ key, pixels }); });
+            std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        }
+    };
+    
+    if (threadPool) {
+        threadPool->parallelFor(kShardCount, mergeShards);
+    } else {
+        mergeShards(0, kShardCount);
+    }
+    bands.clear();
+    
+    ColorPairHistogram histogram;
+    size_t total = 0;
+    for (const auto& entries : shardEntries) {
+        total += entries.size();
+    }
+    histogram.entries_.reserve(total);
+    for (const auto& entries : shardEntries) {
+        for (const Entry& entry : entries) {
+            histogram.entries_.push_back(entry);
+            histogram.pixelCount_ += entry.count;
+        }
+    }
+    return histogram;
+}
+
+
+ColorPairHistogram ColorPairHistogram::mergeTwo(const ColorPairHistogram& first, const ColorPairHistogram& second) {
+    // Both entry lists are in the same order, so one linear pass joins them
+    ColorPairHistogram merged;
+    merged.entries_.reserve(first.size() + second.size());
+    merged.pixelCount_ = first.pixelCount_ + second.pixelCount_;
+    
+    auto a = first.entries_.begin();
+    auto b = second.entries_.begin();
+    while (a != first.entries_.end() && b != second.entries_.end()) {
+        if (a->key == b->key) {
+            merged.entries_.push_back(Entry{ a->key, a->count + b->count });
+            ++a;
+            ++b;
+        } else if (precedes(a->key, b->key)) {
+            merged.entries_.push_back(*a++);
+        } else {
+            merged.entries_.push_back(*b++);
+        }
+    }
+    merged.entries_.insert(merged.entries_.end(), a, first.entries_.end());
+    merged.entries_.insert(merged.entries_.end(), b, second.entries_.end());
+    return merged;
+}
+
+ColorPairHistogram ColorPairHistogram::merge(std::vector<ColorPairHistogram> histograms, ThreadPool* threadPool) {
+    if (histograms.empty()) {
+        return ColorPairHistogram();
+    }
+    
+    // Each round halves the list, so every entry is copied O(log N) times
+    while (histograms.size() > 1) {
+        std::vector<ColorPairHistogram> next((histograms.size() + 1) / 2);
+        auto mergeRange = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (2 * i + 1 < histograms.size()) {
+                    next[i] = mergeTwo(histograms[2 * i], histograms[2 * i + 1]);
+                } else {
+                    next[i] = std::move(histograms[2 * i]);
+                }
+            }
+        };
+        
+        if (threadPool) {
+            threadPool->parallelFor(next.size(), mergeRange);
+        } else {
+            mergeRange(0, next.size());
+        }
+        histograms = std::move(next);
+    }
+    return std::move(histograms.front());
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "image_data.hpp"
+
+class ThreadPool;
+
+// Joint histogram of exact (source RGB, target RGB) pairs in an image pair.
+// Flat regions collapse to a few entries, so a fit over the weighted entries costs
+// O(distinct color pairs) instead of O(pixels) and gives the same result.
+class ColorPairHistogram {
+public:
+    struct Entry {
+        uint64_t key;   // Source RGB in bits 0-23, target RGB in bits 24-47
+        uint64_t count; // Pixels with this pair
+
+        unsigned char source(int channel) const { return static_cast<unsigned char>(key >> (8 * channel)); }
+        unsigned char target(int channel) const { return static_cast<unsigned char>(key >> (24 + 8 * channel)); }
+    };
+
+    // Count the pairs of two 8-bit images over every pixel, or only the given flat indices, optionally
+    // skipping saturated pixels. Each thread fills its own hash tables, which are merged shard by shard in parallel.
+    static ColorPairHistogram build(const ImageData& startImage, const ImageData& targetImage,
+                                    const std::vector<size_t>* pixelIndices, bool skipSaturated,
+                                    ThreadPool* threadPool = nullptr);
+
+    // Like build, but give up and return nothing as soon as a band finds more than maxDistinctFraction
+    // of its pixels to be distinct pairs, i.e. when the histogram would barely compress the fit
+    static std::optional<ColorPairHistogram> buildIfCompressible(const ImageData& startImage, const ImageData& targetImage,
+                                                                 const std::vector<size_t>* pixelIndices, bool skipSaturated,
+                                                                 double maxDistinctFraction, ThreadPool* threadPool = nullptr);
+
+    // Combine the histograms of several image pairs into one, merging them pairwise in parallel.
+    // The result does not depend on the order of the inputs.
+    static ColorPairHistogram merge(std::vector<ColorPairHistogram> histograms, ThreadPool* threadPool = nullptr);
+
+    // Distinct pairs in a fixed order (by hash shard, then key), so results do not depend on the thread count
+    const std::vector<Entry>& entries() const { return entries_; }
+    size_t size() const { return entries_.size(); }
+
+    // Pixels counted
+    uint64_t pixelCount() const { return pixelCount_; }
+
+    static uint64_t pack(const unsigned char* source, const unsigned char* target);
+
+private:
+    static ColorPairHistogram mergeTwo(const ColorPairHistogram& first, const ColorPairHistogram& second);
+
+    std::vector<Entry> entries_;
+    uint64_t pixelCount_ = 0;
+};
@@ -0,0 +1,64 @@
+#include "command_line.hpp"
+#include <cmath>
+#include <iostream>
+
+std::optional<std::string> CommandLine::optionValue(int argc, char* argv[], int& index) {
+    if (index + 1 >= argc) {
+        std::cerr << "Error: Missing value for option '" << argv[index] << "'" << std::endl;
+        return std::nullopt;
+    }
+    return std::string(argv[++index]);
+}
+
+std::optional<unsigned long long> CommandLine::parseCount(const std::string& value, const char* what, unsigned long long maximum) {
+    try {
+        size_t consumed = 0;
+        long long count = std::stoll(value, &consumed);
+        if (consumed == value.size() && count >= 0) {
+            if (static_cast<unsigned long long>(count) > maximum) {
+                std::cerr << "Error: Invalid " << what << " '" << value << "' (must be at most " << maximum << ")" << std::endl;
+                return std::nullopt;
+            }
+            return static_cast<unsigned long long>(count);
+        }
+    } catch (const std::exception&) {
+    }
+    std::cerr << "Error: Invalid " << what << " '" << value << "'" << std::endl;
+    return std::nullopt;
+}
+
+
+std::optional<unsigned long long> CommandLine::parsePositiveCount(const std::string& value, const char* what, unsigned long long maximum) {
+    auto count = parseCount(value, what, maximum);
+    if (count && *count == 0) {
+        std::cerr << "Error: Invalid " << what << " '" << value << "' (must be at least 1)" << std::endl;
+        return std::nullopt;
+    }
+    return count;
+}
+
+std::optional<double> CommandLine::parsePositive(const std::string& value, const char* what) {
+    try {
+        size_t consumed = 0;
+        double number = std::stod(value, &consumed);
+        if (consumed == value.size() && std::isfinite(number) && number > 0.0) {
+            return number;
+        }
+    } catch (const std::exception&) {
+    }
+    std::cerr << "Error: Invalid " << what << " '" << value << "'" << std::endl;
+    return std::nullopt;
+}
+
+std::optional<double> CommandLine::parseNonNegative(const std::string& value, const char* what) {
+    try {
+        size_t consumed = 0;
+        double number = std::stod(value, &consumed);
+        if (consumed == value.size() && std::isfinite(number) && number >= 0.0) {
+            return number;
+        }
+    } catch (const std::exception&) {
+    }
+    std::cerr << "Error: Invalid " << what << " '" << value << "'" << std::endl;
+    return std::nullopt;
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+// Helpers shared by the command-line front ends
+class CommandLine {
+public:
+    // Fetch the value following the option at argv[index], advancing index past it
+    static std::optional<std::string> optionValue(int argc, char* argv[], int& index);
+
+    // Parse an integer option value between 0 and maximum, the largest value its destination holds;
+    // `what` names the value in the error message
+    static std::optional<unsigned long long> parseCount(const std::string& value, const char* what, unsigned long long maximum);
+
+    // Parse an integer option value between 1 and maximum
+    static std::optional<unsigned long long> parsePositiveCount(const std::string& value, const char* what, unsigned long long maximum);
+
+    // Parse a finite, strictly positive number
+    static std::optional<double> parsePositive(const std::string& value, const char* what);
+
+    // Parse a finite number that is zero or positive
+    static std::optional<double> parseNonNegative(const std::string& value, const char* what);
+};
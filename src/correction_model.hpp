@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cmath>
+#include <optional>
+#include <string>
+#include "transfer_function.hpp"
+
+// Form of the correction. Each model maps a source color (r, g, b on a 0..1 scale) to a list of terms,
+// and the corrected color is a 3 x termCount coefficient matrix times those terms.
+enum class CorrectionModel {
+    Linear,          // r, g, b: a 3x3 matrix
+    Affine,          // r, g, b, 1: a 3x4 matrix whose last column is an offset, e.g. a black-level difference
+    RootPolynomial2, // Adds sqrt(rg), sqrt(gb), sqrt(rb)
+    RootPolynomial3  // Adds the cube roots of rg^2, gb^2, rb^2, gr^2, bg^2, br^2 and rgb as well
+};
+
+// Compile-time description of a model, so solve accumulators and apply kernels can be specialized per model.
+// Root-polynomial terms factor into per-channel roots (sqrt(rg) = sqrt(r) sqrt(g)), so evaluate takes the
+// roots precomputed and 8-bit colors get them from 256-entry tables.
+template <CorrectionModel Model>
+struct CorrectionModelTerms;
+
+template <>
+struct CorrectionModelTerms<CorrectionModel::Linear> {
+    static constexpr int kCount = 3;
+    static constexpr bool kUsesRoots = false;
+
+    template <typename T>
+    static void evaluate(const T rgb[3], const T*, const T*, T* terms) {
+        terms[0] = rgb[0];
+        terms[1] = rgb[1];
+        terms[2] = rgb[2];
+    }
+};
+
+template <>
+struct CorrectionModelTerms<CorrectionModel::Affine> {
+    static constexpr int kCount = 4;
+    static constexpr bool kUsesRoots = false;
+
+    template <typename T>
+    static void evaluate(const T rgb[3], const T*, const T*, T* terms) {
+        terms[0] = rgb[0];
+        terms[1] = rgb[1];
+        terms[2] = rgb[2];
+        terms[3] = T(1);
+    }
+};
+
+template <>
+struct CorrectionModelTerms<CorrectionModel::RootPolynomial2> {
+    static constexpr int kCount = 6;
+    static constexpr bool kUsesRoots = true;
+
+    template <typename T>
+    static void evaluate(const T rgb[3], const T sqrtRgb[3], const T*, T* terms) {
+        terms[0] = rgb[0];
+        terms[1] = rgb[1];
+        terms[2] = rgb[2];
+        terms[3] = sqrtRgb[0] * sqrtRgb[1];
+        terms[4] = sqrtRgb[1] * sqrtRgb[2];
+        terms[5] = sqrtRgb[0] * sqrtRgb[2];
+    }
+};
+
+template <>
+struct CorrectionModelTerms<CorrectionModel::RootPolynomial3> {
+    static constexpr int kCount = 13;
+    static constexpr bool kUsesRoots = true;
+
+    template <typename T>
+    static void evaluate(const T rgb[3], const T sqrtRgb[3], const T cbrtRgb[3], T* terms) {
+        CorrectionModelTerms<CorrectionModel::RootPolynomial2>::evaluate(rgb, sqrtRgb, cbrtRgb, terms);
+        const T r = cbrtRgb[0], g = cbrtRgb[1], b = cbrtRgb[2];
+        terms[6] = r * g * g;
+        terms[7] = g * b * b;
+        terms[8] = r * b * b;
+        terms[9] = g * r * r;
+        terms[10] = b * g * g;
+        terms[11] = b * r * r;
+        terms[12] = r * g * b;
+    }
+};
+
+// Largest term count of any model, for fixed-size scratch buffers
+constexpr int kMaxCorrectionTerms = CorrectionModelTerms<CorrectionModel::RootPolynomial3>::kCount;
+
+// Channel values, square roots and cube roots of the 256 8-bit code values on the 0..1 scale of a
+// working space: the codes themselves, or the linear light of sRGB-encoded codes
+template <typename T>
+struct Rgb8Roots {
+    T value[256];
+    T sqrtValue[256];
+    T cbrtValue[256];
+
+    static const Rgb8Roots& get(WorkingSpace space = WorkingSpace::Encoded) {
+        static const Rgb8Roots encoded = build(WorkingSpace::Encoded);
+        static const Rgb8Roots linear = build(WorkingSpace::Linear);
+        return space == WorkingSpace::Linear ? linear : encoded;
+    }
+
+private:
+    static Rgb8Roots build(WorkingSpace space) {
+        Rgb8Roots table;
+        for (int i = 0; i < 256; ++i) {
+            const double value = space == WorkingSpace::Linear ? SrgbCurve::decode(i / 255.0) : i / 255.0;
+            table.value[i] = static_cast<T>(value);
+            table.sqrtValue[i] = static_cast<T>(std::sqrt(value));
+            table.cbrtValue[i] = static_cast<T>(std::cbrt(value));
+        }
+        return table;
+    }
+};
+
+// Terms of a color on the 0..1 scale
+template <CorrectionModel Model, typename T>
+void EvaluateCorrectionTerms(const T rgb[3], T* terms) {
+    T sqrtRgb[3] = {}, cbrtRgb[3] = {};
+    if constexpr (CorrectionModelTerms<Model>::kUsesRoots) {
+        for (int c = 0; c < 3; ++c) {
+            // Clamp so out-of-range colors (e.g. from a lattice) do not produce NaN
+            const T value = rgb[c] > T(0) ? rgb[c] : T(0);
+            sqrtRgb[c] = std::sqrt(value);
+            cbrtRgb[c] = std::cbrt(value);
+        }
+    }
+    CorrectionModelTerms<Model>::evaluate(rgb, sqrtRgb, cbrtRgb, terms);
+}
+
+// Terms of an 8-bit RGB color, with the values and roots taken from tables
+template <CorrectionModel Model, typename T>
+void EvaluateCorrectionTermsRgb8(const unsigned char* rgb, T* terms, const Rgb8Roots<T>& roots = Rgb8Roots<T>::get()) {
+    const T value[3] = { roots.value[rgb[0]], roots.value[rgb[1]], roots.value[rgb[2]] };
+    const T sqrtRgb[3] = { roots.sqrtValue[rgb[0]], roots.sqrtValue[rgb[1]], roots.sqrtValue[rgb[2]] };
+    const T cbrtRgb[3] = { roots.cbrtValue[rgb[0]], roots.cbrtValue[rgb[1]], roots.cbrtValue[rgb[2]] };
+    CorrectionModelTerms<Model>::evaluate(value, sqrtRgb, cbrtRgb, terms);
+}
+
+// Run-time dispatch for code that is not specialized per model
+template <typename T>
+void EvaluateCorrectionTerms(CorrectionModel model, const T rgb[3], T* terms) {
+    switch (model) {
+    case CorrectionModel::Affine:
+        EvaluateCorrectionTerms<CorrectionModel::Affine>(rgb, terms);
+        break;
+    case CorrectionModel::RootPolynomial2:
+        EvaluateCorrectionTerms<CorrectionModel::RootPolynomial2>(rgb, terms);
+        break;
+    case CorrectionModel::RootPolynomial3:
+        EvaluateCorrectionTerms<CorrectionModel::RootPolynomial3>(rgb, terms);
+        break;
+    case CorrectionModel::Linear:
+    default:
+        EvaluateCorrectionTerms<CorrectionModel::Linear>(rgb, terms);
+        break;
+    }
+}
+
+inline int CorrectionModelTermCount(CorrectionModel model) {
+    switch (model) {
+    case CorrectionModel::Affine:
+        return CorrectionModelTerms<CorrectionModel::Affine>::kCount;
+    case CorrectionModel::RootPolynomial2:
+        return CorrectionModelTerms<CorrectionModel::RootPolynomial2>::kCount;
+    case CorrectionModel::RootPolynomial3:
+        return CorrectionModelTerms<CorrectionModel::RootPolynomial3>::kCount;
+    case CorrectionModel::Linear:
+    default:
+        return CorrectionModelTerms<CorrectionModel::Linear>::kCount;
+    }
+}
+
+// Names used on the command line and in matrix files
+inline const char* CorrectionModelName(CorrectionModel model) {
+    switch (model) {
+    case CorrectionModel::Affine:
+        return "affine";
+    case CorrectionModel::RootPolynomial2:
+        return "rp2";
+    case CorrectionModel::RootPolynomial3:
+        return "rp3";
+    case CorrectionModel::Linear:
+    default:
+        return "linear";
+    }
+}
+
+inline std::optional<CorrectionModel> ParseCorrectionModel(const std::string& name) {
+    for (CorrectionModel model : { CorrectionModel::Linear, CorrectionModel::Affine, CorrectionModel::RootPolynomial2,
+                                   CorrectionModel::RootPolynomial3 }) {
+        if (name == CorrectionModelName(model)) {
+            return model;
+        }
+    }
+    return std::nullopt;
+}
\ No newline at end of file
@@ -0,0 +1,430 @@
+#include "correction_service.hpp"
+#include "color_correction_matrix_io.hpp"
+#include "color_correction_matrix_solver.hpp"
+#include "image_file_handler.hpp"
+#include <cmath>
+#include <climits>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::optional<std::string> optionalString(const JsonObject& request, const std::string& key) {
+    if (!request.has(key)) {
+        return std::nullopt;
+    }
+    auto value = request.string(key);
+    if (!value) {
+        throw std::invalid_argument("Field '" + key + "' must be a string");
+    }
+    return value;
+}
+
+std::optional<bool> optionalBoolean(const JsonObject& request, const std::string& key) {
+    if (!request.has(key)) {
+        return std::nullopt;
+    }
+    auto value = request.boolean(key);
+    if (!value) {
+        throw std::invalid_argument("Field '" + key + "' must be true or false");
+    }
+    return value;
+}
+
+std::optional<double> optionalPositive(const JsonObject& request, const std::string& key) {
+    if (!request.has(key)) {
+        return std::nullopt;
+    }
+    auto value = request.number(key);
+    if (!value || !(*value > 0.0)) {
+        throw std::invalid_argument("Field '" + key + "' must be a positive number");
+    }
+    return value;
+}
+
+// Non-negative integer no larger than limit
+std::optional<size_t> optionalCount(const JsonObject& request, const std::string& key, double limit) {
+    if (!request.has(key)) {
+        return std::nullopt;
+    }
+    auto value = request.number(key);
+    if (!value || *value < 0.0 || *value > limit || std::floor(*value) != *value) {
+        throw std::invalid_argument("Field '" + key + "' must be a whole number from 0 to " + std::to_string(static_cast<long long>(limit)));
+    }
+    return static_cast<size_t>(*value);
+}
+
+// Enum field named as on the command line
+template <typename T>
+std::optional<T> optionalName(const JsonObject& request, const std::string& key,
+                              std::optional<T> (*parse)(const std::string&), const char* expected) {
+    auto name = optionalString(request, key);
+    if (!name) {
+        return std::nullopt;
+    }
+    auto value = parse(*name);
+    if (!value) {
+        throw std::invalid_argument("Unknown " + key + " '" + *name + "' (expected " + expected + ")");
+    }
+    return value;
+}
+
+double milliseconds(double seconds) {
+    return std::round(seconds * 1e6) / 1e3;
+}
+
+// POSIX shared-memory object mapped into this process, e.g. a frame a capture process shares
+// with the daemon instead of writing it to disk
+class SharedMemory {
+public:
+    SharedMemory(std::string name, size_t bytes, bool writable) : bytes_(bytes) {
+        if (name.empty() || name[0] != '/') {
+            name = "/" + name;
+        }
+        const int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open shared memory '" + name + "'");
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < bytes) {
+            close(fd);
+            throw std::runtime_error("Shared memory '" + name + "' is smaller than the " + std::to_string(bytes) +
+                                     " bytes of the image");
+        }
+        mapping_ = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping_ == MAP_FAILED) {
+            throw std::runtime_error("Cannot map shared memory '" + name + "'");
+        }
+    }
+
+    ~SharedMemory() {
+        munmap(mapping_, bytes_);
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    unsigned char* data() const { return static_cast<unsigned char*>(mapping_); }
+
+private:
+    void* mapping_ = nullptr;
+    size_t bytes_;
+};
+
+// Image of a request: decoded from the file in `<key>` or borrowed from the 8-bit RGB pixels of the
+// shared-memory object in `<key>_shm` with the request's width and height
+struct RequestImage {
+    ImageData image;
+    std::unique_ptr<SharedMemory> shared;
+
+    static RequestImage open(const JsonObject& request, const std::string& key, bool writable = false) {
+        RequestImage opened;
+        if (auto path = optionalString(request, key)) {
+            opened.image = ImageFileHandler::loadImage(*path);
+            if (!opened.image.isValid()) {
+                throw std::runtime_error("Failed to load image '" + *path + "'");
+            }
+        } else if (auto name = optionalString(request, key + "_shm")) {
+            opened.shared = mapShared(request, *name, writable);
+            opened.image = ImageData::borrow(opened.shared->data(), dimension(request, "width"), dimension(request, "height"), 3);
+        } else {
+            throw std::invalid_argument("Missing '" + key + "' or '" + key + "_shm'");
+        }
+        return opened;
+    }
+
+    // Write the corrected image to a file: straight into a mapped output where the format allows, else
+    // by correcting the image in place (a copy of read-only shared memory) and encoding it. Consumes the image.
+    void saveCorrected(const ColorCorrectionMatrix& matrix, const std::string& path, ThreadPool& threadPool) {
+        ImageData output = ImageFileHandler::createMappedImage(path, image);
+        if (output.isValid()) {
+            ColorCorrectionMatrixSolver::ApplyMatrixInto(image, output, matrix, &threadPool);
+            return;
+        }
+        if (shared) {
+            image = ColorCorrectionMatrixSolver::ApplyMatrix(image, matrix, &threadPool);
+            shared.reset();
+        } else {
+            ColorCorrectionMatrixSolver::ApplyMatrixInPlace(image, matrix, &threadPool);
+        }
+        if (!ImageFileHandler::saveImage(image, path)) {
+            throw std::runtime_error("Failed to save image to '" + path + "'");
+        }
+    }
+
+    static std::unique_ptr<SharedMemory> mapShared(const JsonObject& request, const std::string& name, bool writable) {
+        const size_t bytes = static_cast<size_t>(dimension(request, "width")) * dimension(request, "height") * 3;
+        return std::make_unique<SharedMemory>(name, bytes, writable);
+    }
+
+    static int dimension(const JsonObject& request, const std::string& key) {
+        auto value = optionalCount(request, key, INT_MAX);
+        if (!value || *value == 0) {
+            throw std::invalid_argument("Shared-memory images need a positive '" + key + "'");
+        }
+        return static_cast<int>(*value);
+    }
+};
+
+} // namespace
+
+CorrectionService::CorrectionService(const Options& options)
+    : options_(options), threadPool_(options.threadCount), queue_(options.queueCapacity)
+{
+    const unsigned int workers = options_.workers > 0 ? options_.workers : 1;
+    for (unsigned int i = 0; i < workers; ++i) {
+        workers_.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+CorrectionService::~CorrectionService() {
+    stop();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void CorrectionService::submit(const std::string& line, Respond respond) {
+    auto reject = [&respond](const JsonObject* request, const std::string& error) {
+        JsonObject response;
+        if (request) {
+            response.copy(*request, "id");
+        }
+        response.setBoolean("ok", false);
+        response.setString("error", error);
+        respond(response.serialize());
+    };
+
+    std::string error;
+    auto request = JsonObject::parse(line, error);
+    if (!request) {
+        reject(nullptr, "Malformed request: " + error);
+        return;
+    }
+    if (stopping_) {
+        reject(&*request, "Service is shutting down");
+        return;
+    }
+
+    JsonObject id;
+    id.copy(*request, "id");
+    // push only fails when the service stopped while waiting for room
+    if (!queue_.push(Job{ std::move(*request), respond, Stopwatch() })) {
+        reject(&id, "Service is shutting down");
+    }
+}
+
+void CorrectionService::stop() {
+    stopping_ = true;
+    queue_.close();
+}
+
+void CorrectionService::workerLoop() {
+    while (auto job = queue_.pop()) {
+        const double queueSeconds = job->received.seconds();
+        const Stopwatch runTime;
+
+        JsonObject response;
+        response.copy(job->request, "id");
+        response.copy(job->request, "op");
+        response.setBoolean("ok", true);
+        std::string error;
+        try {
+            run(job->request, response);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (!error.empty()) {
+            response.setBoolean("ok", false);
+            response.setString("error", error);
+            ++jobsFailed_;
+        } else {
+            ++jobsCompleted_;
+        }
+
+        const double runSeconds = runTime.seconds();
+        const double totalSeconds = job->received.seconds();
+        response.setNumber("queue_ms", milliseconds(queueSeconds));
+        response.setNumber("run_ms", milliseconds(runSeconds));
+        response.setNumber("total_ms", milliseconds(totalSeconds));
+
+        // One line per job, in a single write so concurrent jobs do not interleave
+        std::ostringstream log;
+        log << "Job";
+        if (auto id = job->request.string("id")) {
+            log << " " << *id;
+        } else if (auto number = job->request.number("id")) {
+            log << " " << *number;
+        }
+        log << ": " << job->request.string("op").value_or("?") << (error.empty() ? " ok" : " failed (" + error + ")")
+            << ", queued " << milliseconds(queueSeconds) << " ms, ran " << milliseconds(runSeconds) << " ms\n";
+        std::cerr << log.str() << std::flush;
+
+        job->respond(response.serialize());
+    }
+}
+
+void CorrectionService::run(const JsonObject& request, JsonObject& response) {
+    const auto op = optionalString(request, "op");
+    if (!op) {
+        throw std::invalid_argument("Missing 'op'");
+    }
+    if (*op == "solve") {
+        solve(request, response);
+    } else if (*op == "apply") {
+        apply(request, response);
+    } else if (*op == "ping") {
+        response.setNumber("threads", threadPool_.threadCount());
+        response.setNumber("workers", static_cast<double>(workers_.size()));
+        response.setNumber("queue_capacity", static_cast<double>(options_.queueCapacity));
+        response.setNumber("completed", static_cast<double>(jobsCompleted_));
+        response.setNumber("failed", static_cast<double>(jobsFailed_));
+    } else if (*op == "shutdown") {
+        stop();
+    } else {
+        throw std::invalid_argument("Unknown op '" + *op + "' (expected 'solve', 'apply', 'ping' or 'shutdown')");
+    }
+}
+
+void CorrectionService::solve(const JsonObject& request, JsonObject& response) {
+    SolverOptions options;
+    if (auto model = optionalName(request, "model", &ParseCorrectionModel, "'linear', 'affine', 'rp2' or 'rp3'")) {
+        options.model = *model;
+    }
+    if (auto space = optionalName(request, "space", &ParseWorkingSpace, "'linear' or 'encoded'")) {
+        options.space = *space;
+    }
+    if (auto mode = optionalName(request, "solver", &ParseSolverMode, "'normal' or 'ceres'")) {
+        options.mode = *mode;
+    }
+    if (auto loss = optionalName(request, "robust", &ParseRobustLoss, "'none', 'huber' or 'cauchy'")) {
+        options.robust.loss = *loss;
+    }
+    if (auto scale = optionalPositive(request, "robust_scale")) {
+        // In 8-bit code values, as --robust-scale
+        options.robust.scale = *scale / 255.0;
+    }
+    if (auto mask = optionalBoolean(request, "mask_saturated")) {
+        options.robust.maskSaturated = *mask;
+    }
+    // As on the command line: a budget alone implies random sampling, a mode alone gets the default budget
+    auto sampling = optionalName(request, "sampling", &ParseSamplingMode, "'none', 'stride', 'random' or 'stratified'");
+    if (auto budget = optionalCount(request, "max_samples", 1e15)) {
+        options.sampling.maxSamples = *budget;
+        options.sampling.mode = SamplingMode::Random;
+    }
+    if (sampling) {
+        options.sampling.mode = *sampling;
+    }
+    if (options.sampling.mode != SamplingMode::None && options.sampling.maxSamples == 0) {
+        options.sampling.maxSamples = SamplingOptions::kDefaultMaxSamples;
+    }
+    if (auto levels = optionalCount(request, "pyramid_levels", 16)) {
+        options.pyramidLevels = static_cast<int>(*levels);
+    }
+    if (auto path = optionalString(request, "initial_matrix")) {
+        options.initialGuess = loadMatrix(*path);
+    }
+
+    RequestImage start = RequestImage::open(request, "start");
+    const RequestImage target = RequestImage::open(request, "target");
+
+    ColorCorrectionMatrixSolver solver(options);
+    const ColorCorrectionMatrix matrix = solver.Solve(start.image, target.image, &threadPool_);
+    const SolveReport& report = solver.GetReport();
+
+    const Eigen::Matrix3d& m = matrix.matrix;
+    response.setString("model", CorrectionModelName(matrix.model));
+    response.setString("space", WorkingSpaceName(matrix.space));
+    response.setNumbers("matrix", { m(0, 0), m(0, 1), m(0, 2), m(1, 0), m(1, 1), m(1, 2), m(2, 0), m(2, 1), m(2, 2) });
+    if (matrix.terms.cols() > 0) {
+        std::vector<double> terms;
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < matrix.terms.cols(); ++col) {
+                terms.push_back(matrix.terms(row, col));
+            }
+        }
+        response.setNumbers("terms", terms);
+    }
+    response.setNumber("pixels", static_cast<double>(report.pixelsUsed));
+    if (report.heldOutPixels > 0) {
+        response.setNumber("held_out_rmse", report.heldOutRmse);
+    }
+
+    if (auto path = optionalString(request, "save_matrix")) {
+        if (!ColorCorrectionMatrixIO::save(matrix, *path)) {
+            throw std::runtime_error("Failed to save matrix to '" + *path + "'");
+        }
+        // A later apply of the same file must not see the matrix it replaced
+        std::lock_guard<std::mutex> lock(matrixMutex_);
+        matrices_.erase(*path);
+    }
+    if (auto path = optionalString(request, "output")) {
+        start.saveCorrected(matrix, *path, threadPool_);
+    }
+}
+
+void CorrectionService::apply(const JsonObject& request, JsonObject& response) {
+    const auto matrixPath = optionalString(request, "matrix");
+    if (!matrixPath) {
+        throw std::invalid_argument("Missing 'matrix'");
+    }
+    const ColorCorrectionMatrix matrix = loadMatrix(*matrixPath);
+
+    const auto outputPath = optionalString(request, "output");
+    const auto outputName = optionalString(request, "output_shm");
+    // Without an output, a shared-memory input is corrected where it lies
+    const bool inPlace = !outputPath && !outputName;
+    if (inPlace && !request.has("input_shm")) {
+        throw std::invalid_argument("Missing 'output' or 'output_shm'");
+    }
+
+    RequestImage input = RequestImage::open(request, "input", inPlace);
+    response.setNumber("pixels", static_cast<double>(input.image.pixelCount()));
+    if (outputName) {
+        if (input.image.sampleType != SampleType::U8 || input.image.channels != 3) {
+            throw std::invalid_argument("Shared-memory output holds 8-bit RGB; the input is " +
+                                        std::string(SampleTypeName(input.image.sampleType)) + " with " +
+                                        std::to_string(input.image.channels) + " channels");
+        }
+        const auto output = RequestImage::mapShared(request, *outputName, true);
+        ImageData outputImage = ImageData::borrow(output->data(), input.image.width, input.image.height, 3);
+        ColorCorrectionMatrixSolver::ApplyMatrixInto(input.image, outputImage, matrix, &threadPool_);
+    }
+    if (outputPath) {
+        input.saveCorrected(matrix, *outputPath, threadPool_);
+    }
+    if (inPlace) {
+        ColorCorrectionMatrixSolver::ApplyMatrixInPlace(input.image, matrix, &threadPool_);
+    }
+}
+
+ColorCorrectionMatrix CorrectionService::loadMatrix(const std::string& path) {
+    std::error_code error;
+    const auto modified = std::filesystem::last_write_time(path, error);
+    if (error) {
+        throw std::runtime_error("Cannot read matrix file '" + path + "': " + error.message());
+    }
+    {
+        std::lock_guard<std::mutex> lock(matrixMutex_);
+        auto cached = matrices_.find(path);
+        if (cached != matrices_.end() && cached->second.modified == modified) {
+            return cached->second.matrix;
+        }
+    }
+
+    auto loaded = ColorCorrectionMatrixIO::load(path);
+    if (!loaded) {
+        throw std::runtime_error("Failed to load matrix '" + path + "'");
+    }
+    std::lock_guard<std::mutex> lock(matrixMutex_);
+    matrices_[path] = CachedMatrix{ modified, *loaded };
+    return *loaded;
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bounded_queue.hpp"
+#include "color_correction_matrix.hpp"
+#include "image_data.hpp"
+#include "json_object.hpp"
+#include "stage_profiler.hpp"
+#include "thread_pool.hpp"
+
+// Solve and apply jobs for the long-running daemon. Every job shares one warm thread pool, the
+// process-wide buffer pool and a cache of loaded matrices, so a job pays for its pixels but not for
+// thread start-up, first-touch page faults or re-reading the same matrix file. Requests wait in a
+// bounded queue and a fixed number of job workers take them in order.
+// Requests and responses are single-line JSON objects; the fields are listed in the README.
+class CorrectionService {
+public:
+    struct Options {
+        unsigned int threadCount = 0; // Threads of the shared pool; 0 uses every hardware thread
+        unsigned int workers = 2;     // Jobs that run at the same time
+        size_t queueCapacity = 16;    // Queued jobs before submit() blocks
+    };
+
+    // Receives the response line of one request
+    using Respond = std::function<void(const std::string& line)>;
+
+    explicit CorrectionService(const Options& options);
+    // Stops and waits for the queued jobs
+    ~CorrectionService();
+
+    CorrectionService(const CorrectionService&) = delete;
+    CorrectionService& operator=(const CorrectionService&) = delete;
+
+    // Queue one request. respond is called exactly once: on a job worker, or right away for malformed
+    // requests and after stop(). Blocks while the queue is full, which throttles the sender.
+    void submit(const std::string& line, Respond respond);
+
+    // Refuse further requests; jobs already queued still run. Also triggered by a "shutdown" request.
+    void stop();
+    bool stopping() const { return stopping_; }
+
+    unsigned int threadCount() const { return threadPool_.threadCount(); }
+
+private:
+    struct Job {
+        JsonObject request;
+        Respond respond;
+        Stopwatch received;
+    };
+
+    struct CachedMatrix {
+        std::filesystem::file_time_type modified;
+        ColorCorrectionMatrix matrix;
+    };
+
+    void workerLoop();
+    // Run one request, adding its results to response; throws with the message for the response on failure
+    void run(const JsonObject& request, JsonObject& response);
+    void solve(const JsonObject& request, JsonObject& response);
+    void apply(const JsonObject& request, JsonObject& response);
+    // Load a matrix file, reusing the parsed matrix while the file is unchanged
+    ColorCorrectionMatrix loadMatrix(const std::string& path);
+
+    Options options_;
+    ThreadPool threadPool_;
+    BoundedQueue<Job> queue_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stopping_{ false };
+    std::atomic<size_t> jobsCompleted_{ 0 };
+    std::atomic<size_t> jobsFailed_{ 0 };
+
+    std::mutex matrixMutex_;
+    std::unordered_map<std::string, CachedMatrix> matrices_;
+};
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "daemon_application.hpp"
+#include "command_line.hpp"
+#include "line_channel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t signalled = 0;
+
+void onSignal(int) {
+    signalled = 1;
+}
+
+// Stop reading new requests; the service still finishes what it has queued
+bool shouldStop(const CorrectionService& service) {
+    return signalled != 0 || service.stopping();
+}
+
+// Hand every request line to the service, answering on the same channel
+void serveChannel(CorrectionService& service, const std::shared_ptr<LineChannel>& channel) {
+    channel->receive([&service, &channel](const std::string& line) {
+        // The responder keeps the channel open until the last queued job of this client answers
+        service.submit(line, [channel](const std::string& response) { channel->send(response); });
+    }, [&service]() { return shouldStop(service); });
+}
+
+} // namespace
+
+std::optional<DaemonApplication::Arguments>
+DaemonApplication::parseArguments(int argc, char* argv[]) {
+    Arguments args;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::optional<std::string> value;
+        if (arg == "--socket" || arg == "--workers" || arg == "--queue" || arg == "--threads") {
+            value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+        }
+
+        if (arg == "--socket") {
+            args.socketPath = *value;
+        } else if (arg == "--workers") {
+            auto count = CommandLine::parsePositiveCount(*value, "worker count", UINT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.service.workers = static_cast<unsigned int>(*count);
+        } else if (arg == "--queue") {
+            auto count = CommandLine::parsePositiveCount(*value, "queue capacity", SIZE_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.service.queueCapacity = static_cast<size_t>(*count);
+        } else if (arg == "--threads") {
+            auto count = CommandLine::parseCount(*value, "thread count", UINT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.service.threadCount = static_cast<unsigned int>(*count);
+        } else {
+            std::cerr << "Error: Unknown argument '" << arg << "'" << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    return args;
+}
+
+int DaemonApplication::run(const Arguments& args) {
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    // A client that hangs up must not take the daemon with it; writes fail instead
+    std::signal(SIGPIPE, SIG_IGN);
+
+    CorrectionService service(args.service);
+    std::cerr << "Correction service ready: " << std::max(args.service.workers, 1u) << " job workers, "
+              << service.threadCount() << " threads, queue of " << args.service.queueCapacity << std::endl;
+    const int status = args.socketPath ? serveSocket(service, *args.socketPath) : serveStdin(service);
+    // The service's destructor runs the jobs still queued before returning
+    return status;
+}
+
+int DaemonApplication::serveStdin(CorrectionService& service) {
+    // Keep stdout for responses only: the library's progress output goes to stderr from here on
+    const int responseFd = dup(STDOUT_FILENO);
+    if (responseFd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        std::cerr << "Error: Cannot set up the response stream: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    auto channel = std::make_shared<LineChannel>(STDIN_FILENO, responseFd, false);
+    serveChannel(service, channel);
+    service.stop();
+    return 0;
+}
+
+int DaemonApplication::serveSocket(CorrectionService& service, const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path '" << path << "' is too long" << std::endl;
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // Replace a socket left behind by an earlier run, but never another kind of file
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Error: '" << path << "' exists and is not a socket" << std::endl;
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, 16) != 0) {
+        std::cerr << "Error: Cannot listen on '" << path << "': " << std::strerror(errno) << std::endl;
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        return -1;
+    }
+    std::cerr << "Listening on " << path << std::endl;
+
+    struct Connection {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    std::vector<Connection> connections;
+
+    while (!shouldStop(service)) {
+        pollfd descriptor{ listenFd, POLLIN, 0 };
+        if (poll(&descriptor, 1, 200) <= 0) {
+            continue;
+        }
+        const int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            continue;
+        }
+
+        // Join the threads of clients that have gone
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (*it->finished) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto channel = std::make_shared<LineChannel>(clientFd, clientFd, true);
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([&service, channel, finished]() {
+            serveChannel(service, channel);
+            *finished = true;
+        });
+        connections.push_back(Connection{ std::move(thread), finished });
+    }
+
+    service.stop();
+    close(listenFd);
+    unlink(path.c_str());
+    for (Connection& connection : connections) {
+        connection.thread.join();
+    }
+    return 0;
+}
+
+void DaemonApplication::printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [options]" << std::endl;
+    std::cerr << "Reads one JSON request per line and writes one JSON response per line (see README)." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --socket PATH           Serve clients of a Unix socket instead of stdin/stdout" << std::endl;
+    std::cerr << "  --workers N             Jobs run at the same time (default: 2)" << std::endl;
+    std::cerr << "  --queue N               Jobs waiting before requests block (default: 16)" << std::endl;
+    std::cerr << "  --threads N             Threads shared by all jobs (default: all cores)" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include "correction_service.hpp"
+
+// Long-running front end of CorrectionService: reads one JSON request per line from stdin, or from
+// every client of a local Unix socket, and writes one JSON response line per request. Responses of
+// concurrent jobs may come back out of order; clients match them by "id".
+class DaemonApplication {
+public:
+    struct Arguments {
+        std::optional<std::string> socketPath; // Listen here instead of reading stdin
+        CorrectionService::Options service;
+    };
+
+    // Parse command line arguments
+    static std::optional<Arguments> parseArguments(int argc, char* argv[]);
+
+    // Serve requests until end of input, a "shutdown" request or SIGINT/SIGTERM
+    int run(const Arguments& args);
+
+    // Print usage information
+    void printUsage(const char* programName);
+
+private:
+    int serveStdin(CorrectionService& service);
+    int serveSocket(CorrectionService& service, const std::string& path);
+};
\ No newline at end of file
@@ -0,0 +1,15 @@
+#include <iostream>
+#include "daemon_application.hpp"
+
+int main(int argc, char* argv[])
+{
+    auto args = DaemonApplication::parseArguments(argc, argv);
+    if (!args.has_value()) {
+        DaemonApplication app;
+        app.printUsage(argv[0]);
+        return -1;
+    }
+    
+    DaemonApplication app;
+    return app.run(args.value());
+}
\ No newline at end of file
@@ -1,15 +1,49 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Storage of one channel value. Integer samples span 0..255 or 0..65535; float samples are
+// nominally 0..1 but may exceed it (HDR).
+enum class SampleType {
+    U8,
+    U16, // Native byte order
+    F32
+};
+
+// How stored values relate to light
+enum class TransferFunction {
+    Linear, // Proportional to light, e.g. decoded HDR
+    Srgb    // The sRGB curve, used by ordinary 8- and 16-bit files
+};
+
+inline size_t SampleBytes(SampleType type) {
+    switch (type) {
+    case SampleType::U16:
+        return 2;
+    case SampleType::F32:
+        return 4;
+    case SampleType::U8:
+    default:
+        return 1;
+    }
+}
+
 struct ImageData {
     std::unique_ptr<unsigned char, void(*)(void*)> data;
     int width;
     int height;
     int channels;
+    SampleType sampleType;
+    TransferFunction transfer;
 
-    ImageData() : data(nullptr, nullptr), width(0), height(0), channels(0) {}
+    ImageData()
+        : data(nullptr, nullptr), width(0), height(0), channels(0), sampleType(SampleType::U8), transfer(TransferFunction::Srgb) {}
 
     ImageData(ImageData&& other) noexcept
-        : data(std::move(other.data)), width(other.width), height(other.height), channels(other.channels)
+        : data(std::move(other.data)), width(other.width), height(other.height), channels(other.channels),
+          sampleType(other.sampleType), transfer(other.transfer)
     {
         other.width = 0;
         other.height = 0;
@@ -22,6 +56,8 @@ struct ImageData {
             width = other.width;
             height = other.height;
             channels = other.channels;
+            sampleType = other.sampleType;
+            transfer = other.transfer;
             other.width = 0;
             other.height = 0;
             other.channels = 0;
@@ -32,6 +68,31 @@ struct ImageData {
     ImageData(const ImageData&) = delete;
     ImageData& operator=(const ImageData&) = delete;
 
+    // Wrap caller-owned pixels without taking ownership; the caller keeps them alive
+    static ImageData borrow(unsigned char* pixels, int width, int height, int channels,
+                            SampleType sampleType = SampleType::U8, TransferFunction transfer = TransferFunction::Srgb) {
+        ImageData image;
+        image.data = std::unique_ptr<unsigned char, void(*)(void*)>(pixels, [](void*) {});
+        image.width = width;
+        image.height = height;
+        image.channels = channels;
+        image.sampleType = sampleType;
+        image.transfer = transfer;
+        return image;
+    }
+
+    size_t pixelCount() const {
+        return static_cast<size_t>(width) * height;
+    }
+
+    size_t rowBytes() const {
+        return static_cast<size_t>(width) * channels * SampleBytes(sampleType);
+    }
+
+    size_t byteCount() const {
+        return rowBytes() * height;
+    }
+
     bool isValid() const {
         return data != nullptr && width > 0 && height > 0 && channels > 0;
     }
@@ -1,6 +1,20 @@
 #include "image_file_handler.hpp"
+#include "buffer_pool.hpp"
+#include "mapped_image.hpp"
+#include "transfer_function.hpp"
 #include <iostream>
 #include <algorithm>
+#include <cstdio>
+#include <optional>
+
+// Route stb allocations through the shared buffer pool so decoded frames and codec scratch
+// buffers are recycled instead of freshly mapped for every image
+#define STBI_MALLOC(size) BufferPool::shared().allocate(size)
+#define STBI_REALLOC(block, size) BufferPool::reallocate(block, size)
+#define STBI_FREE(block) BufferPool::release(block)
+#define STBIW_MALLOC(size) BufferPool::shared().allocate(size)
+#define STBIW_REALLOC(block, size) BufferPool::reallocate(block, size)
+#define STBIW_FREE(block) BufferPool::release(block)
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -8,11 +22,44 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+namespace {
+
+std::string lowercaseExtension(const std::string& imagePath) {
+    const size_t dot = imagePath.find_last_of('.');
+    std::string extension = dot == std::string::npos ? std::string() : imagePath.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+} // namespace
+
 ImageData ImageFileHandler::loadImage(const std::string& imagePath) {
-    ImageData imageData;
+    // Uncompressed frames are viewed in place instead of being copied by a decoder
+    ImageData imageData = MappedImage::load(imagePath);
+    if (imageData.isValid()) {
+        return imageData;
+    }
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    std::string extension = imagePath.substr(imagePath.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == "pfm" || MappedImage::parseRawName(imagePath, rawWidth, rawHeight, rawType)) {
+        return imageData; // MappedImage reported the problem; stb reads neither format
+    }
     
-    // Load image using stb_image
-    unsigned char* rawData = stbi_load(imagePath.c_str(), &imageData.width, &imageData.height, &imageData.channels, 0);
+
+    // Load image using stb_image, keeping 16-bit PNG/PNM samples and HDR floats at their precision
+    void* rawData = nullptr;
+    if (stbi_is_hdr(imagePath.c_str())) {
+        rawData = stbi_loadf(imagePath.c_str(), &imageData.width, &imageData.height, &imageData.channels, 0);
+        imageData.sampleType = SampleType::F32;
+        imageData.transfer = TransferFunction::Linear;
+    } else if (stbi_is_16_bit(imagePath.c_str())) {
+        rawData = stbi_load_16(imagePath.c_str(), &imageData.width, &imageData.height, &imageData.channels, 0);
+        imageData.sampleType = SampleType::U16;
+    } else {
+        rawData = stbi_load(imagePath.c_str(), &imageData.width, &imageData.height, &imageData.channels, 0);
+    }
     
     if (!rawData) {
         std::cerr << "Error: Failed to load image '" << imagePath << "': " << stbi_failure_reason() << std::endl;
@@ -20,7 +67,7 @@ ImageData ImageFileHandler::loadImage(const std::string& imagePath) {
     }
     
     // Wrap the raw pointer in a unique_ptr with custom deleter
-    imageData.data = std::unique_ptr<unsigned char, void(*)(void*)>(rawData, stbi_image_free);
+    imageData.data = std::unique_ptr<unsigned char, void(*)(void*)>(static_cast<unsigned char*>(rawData), stbi_image_free);
     
     return imageData;
 }
@@ -35,28 +82,79 @@ bool ImageFileHandler::saveImage(const ImageData& image, const std::string& imag
     std::string extension = imagePath.substr(imagePath.find_last_of('.') + 1);
     std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
     
+    // PPM holds 8- and 16-bit samples, HDR linear floats, raw dumps what their name states and the
+    // other formats 8-bit sRGB; anything else is converted on the way out
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    const bool raw = MappedImage::parseRawName(imagePath, rawWidth, rawHeight, rawType);
+    const TransferFunction rawTransfer = rawType == SampleType::F32 ? TransferFunction::Linear : TransferFunction::Srgb;
+    std::optional<ImageData> converted;
+    if (raw) {
+        if (rawWidth != image.width || rawHeight != image.height || image.channels != 3) {
+            std::cerr << "Error: '" << imagePath << "' names a " << rawWidth << "x" << rawHeight << " RGB image, but the image is "
+                      << image.width << "x" << image.height << " with " << image.channels << " channels" << std::endl;
+            return false;
+        }
+        if (image.sampleType != rawType || image.transfer != rawTransfer) {
+            converted = ConvertImage(image, rawType, rawTransfer);
+        }
+    } else if (extension == "hdr") {
+        if (image.sampleType != SampleType::F32 || image.transfer != TransferFunction::Linear) {
+            converted = ConvertImage(image, SampleType::F32, TransferFunction::Linear);
+        }
+    } else if (extension == "ppm") {
+        if (image.sampleType == SampleType::F32 || image.transfer != TransferFunction::Srgb) {
+            converted = ConvertImage(image, SampleType::U16, TransferFunction::Srgb);
+        }
+    } else if ((extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" || extension == "tga") &&
+               (image.sampleType != SampleType::U8 || image.transfer != TransferFunction::Srgb)) {
+        std::cout << "Note: " << extension << " stores 8-bit sRGB samples; converting the " << SampleTypeName(image.sampleType) << " "
+                  << TransferFunctionName(image.transfer) << " image" << std::endl;
+        converted = ConvertImage(image, SampleType::U8, TransferFunction::Srgb);
+    }
+    // Writing over the file a mapped image views would truncate the pixels being written
+    if (!converted.has_value() && MappedImage::isViewed(imagePath)) {
+        converted = ConvertImage(image, image.sampleType, image.transfer);
+    }
+    const ImageData& output = converted.has_value() ? *converted : image;
+    
     int result = 0;
     
-    if (extension == "png") {
-        result = stbi_write_png(imagePath.c_str(), image.width, image.height, 
-                               image.channels, image.data.get(), 
-                               image.width * image.channels);
+    if (raw) {
+        FILE* file = std::fopen(imagePath.c_str(), "wb");
+        if (file) {
+            result = std::fwrite(output.data.get(), 1, output.byteCount(), file) == output.byteCount();
+            result = std::fclose(file) == 0 && result;
+        }
+    }
+    else if (extension == "png") {
+        result = stbi_write_png(imagePath.c_str(), output.width, output.height, 
+                               output.channels, output.data.get(), 
+                               output.width * output.channels);
     }
     else if (extension == "jpg" || extension == "jpeg") {
-        result = stbi_write_jpg(imagePath.c_str(), image.width, image.height, 
-                               image.channels, image.data.get(), 90); // 90% quality
+        result = stbi_write_jpg(imagePath.c_str(), output.width, output.height, 
+                               output.channels, output.data.get(), 90); // 90% quality
     }
     else if (extension == "bmp") {
-        result = stbi_write_bmp(imagePath.c_str(), image.width, image.height, 
-                               image.channels, image.data.get());
+        result = stbi_write_bmp(imagePath.c_str(), output.width, output.height, 
+                               output.channels, output.data.get());
     }
     else if (extension == "tga") {
-        result = stbi_write_tga(imagePath.c_str(), image.width, image.height, 
-                               image.channels, image.data.get());
+        result = stbi_write_tga(imagePath.c_str(), output.width, output.height, 
+                               output.channels, output.data.get());
+    }
+    else if (extension == "hdr") {
+        result = stbi_write_hdr(imagePath.c_str(), output.width, output.height, 
+                               output.channels, reinterpret_cast<const float*>(output.data.get()));
+    }
+    else if (extension == "ppm") {
+        auto writer = PnmStreamWriter::open(imagePath, output.width, output.height, output.channels, output.sampleType);
+        result = writer && writer->writeRows(output.data.get(), output.height) && writer->finish();
     }
     else {
         std::cerr << "Error: Unsupported file format '" << extension << "' for '" << imagePath << "'" << std::endl;
-        std::cerr << "Supported formats: PNG, JPG/JPEG, BMP, TGA" << std::endl;
+        std::cerr << "Supported formats: PNG, JPG/JPEG, BMP, TGA, PPM, HDR, raw RGB (_WxH.rgb/.rgb16/.rgbf)" << std::endl;
         return false;
     }
     
@@ -69,6 +167,79 @@ bool ImageFileHandler::saveImage(const ImageData& image, const std::string& imag
     return true;
 }
 
+bool ImageFileHandler::canLoad(const std::string& imagePath) {
+    static const char* extensions[] = { "png", "jpg", "jpeg", "bmp", "tga", "psd", "gif", "ppm", "pgm", "pnm", "hdr", "pfm" };
+    const std::string extension = lowercaseExtension(imagePath);
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    return std::any_of(std::begin(extensions), std::end(extensions), [&](const char* e) { return extension == e; }) ||
+           MappedImage::parseRawName(imagePath, rawWidth, rawHeight, rawType);
+}
+
+bool ImageFileHandler::canSave(const std::string& imagePath) {
+    static const char* extensions[] = { "png", "jpg", "jpeg", "bmp", "tga", "ppm", "hdr" };
+    const std::string extension = lowercaseExtension(imagePath);
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    return std::any_of(std::begin(extensions), std::end(extensions), [&](const char* e) { return extension == e; }) ||
+           MappedImage::parseRawName(imagePath, rawWidth, rawHeight, rawType);
+}
+
+std::string ImageFileHandler::outputExtension(const std::string& imagePath) {
+    const std::string extension = lowercaseExtension(imagePath);
+    const std::string own = extension.empty() ? std::string() : imagePath.substr(imagePath.find_last_of('.'));
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    if (extension == "ppm" || extension == "hdr" || MappedImage::parseRawName(imagePath, rawWidth, rawHeight, rawType)) {
+        return own;
+    }
+    if (extension == "pfm") {
+        return ".hdr";
+    }
+    
+    // Only the header is read; a file stb cannot open keeps the 8-bit default
+    int width = 0, height = 0, channels = 0;
+    const bool known = stbi_info(imagePath.c_str(), &width, &height, &channels) != 0;
+    if (known && stbi_is_hdr(imagePath.c_str())) {
+        return ".hdr";
+    }
+    if (known && stbi_is_16_bit(imagePath.c_str()) && channels == 3) {
+        return ".ppm";
+    }
+    return canSave(imagePath) ? own : ".png";
+}
+
+ImageData ImageFileHandler::createMappedImage(const std::string& imagePath, const ImageData& like) {
+    return MappedImage::create(imagePath, like.width, like.height, like.channels, like.sampleType, like.transfer);
+}
+
+std::unique_ptr<ImageReader> ImageFileHandler::openReader(const std::string& imagePath) {
+    if (auto reader = PnmStreamReader::open(imagePath)) {
+        return reader;
+    }
+    
+    ImageData image = loadImage(imagePath);
+    if (!image.isValid()) {
+        return nullptr;
+    }
+    if (image.sampleType != SampleType::U8) {
+        std::cerr << "Error: Row streaming supports only 8-bit images, but '" << imagePath << "' has "
+                  << SampleTypeName(image.sampleType) << " samples" << std::endl;
+        return nullptr;
+    }
+    return std::make_unique<DecodedImageReader>(std::move(image));
+}
+
+std::unique_ptr<ImageWriter> ImageFileHandler::openWriter(const std::string& imagePath, int width, int height, int channels) {
+    std::string extension = imagePath.substr(imagePath.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    
+    if (extension == "ppm") {
+        return PnmStreamWriter::open(imagePath, width, height, channels);
+    }
+    return std::make_unique<BufferedImageWriter>(imagePath, width, height, channels);
+}
+
 void ImageFileHandler::printImageInfo(const ImageData& image, const std::string& imagePath) {
     if (!image.isValid()) {
         std::cerr << "Error: Invalid image data for '" << imagePath << "'" << std::endl;
@@ -78,4 +249,5 @@ void ImageFileHandler::printImageInfo(const ImageData& image, const std::string&
     std::cout << "Successfully loaded image: " << imagePath << std::endl;
     std::cout << "  Dimensions: " << image.width << "x" << image.height << " pixels" << std::endl;
     std::cout << "  Channels: " << image.channels << std::endl;
+    std::cout << "  Samples: " << SampleTypeName(image.sampleType) << " " << TransferFunctionName(image.transfer) << std::endl;
 }
\ No newline at end of file
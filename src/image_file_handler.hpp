@@ -3,10 +3,29 @@
 #include <memory>
 #include <string>
 #include <image_data.hpp>
+#include <image_stream.hpp>
 
 class ImageFileHandler {
 public:
+    // 8-bit PPM, PFM and raw RGB dumps are memory-mapped (see MappedImage); other formats go through stb
     static ImageData loadImage(const std::string& imagePath);
     static bool saveImage(const ImageData& image, const std::string& imagePath);
+
+    // Whether loadImage reads, and saveImage writes, the format the path's extension names
+    static bool canLoad(const std::string& imagePath);
+    static bool canSave(const std::string& imagePath);
+
+    // Extension, with its dot, for a corrected copy of the image at imagePath: its own when saveImage
+    // writes that format at the image's precision, otherwise .ppm for 16-bit RGB, .hdr for float and .png
+    static std::string outputExtension(const std::string& imagePath);
+
+    // Image with the size and samples of like whose pixels are the file at imagePath, so correcting into
+    // it writes the file without saveImage; an invalid image when the format cannot be written that way
+    static ImageData createMappedImage(const std::string& imagePath, const ImageData& like);
+
+    // Row-streaming access. Binary PPM streams from disk; other formats fall back to a whole-image decode/encode.
+    static std::unique_ptr<ImageReader> openReader(const std::string& imagePath);
+    static std::unique_ptr<ImageWriter> openWriter(const std::string& imagePath, int width, int height, int channels);
+
     static void printImageInfo(const ImageData& image, const std::string& imagePath);
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "image_pyramid.hpp"
+#include "buffer_pool.hpp"
+#include "thread_pool.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+// Average 2x2 blocks of rows [beginRow, endRow) of the output; integer samples round to nearest
+template <typename Sample, typename Sum>
+void halveRows(const ImageData& image, ImageData& half, size_t beginRow, size_t endRow) {
+    const Sample* in = reinterpret_cast<const Sample*>(image.data.get());
+    Sample* out = reinterpret_cast<Sample*>(half.data.get());
+    const size_t inStride = static_cast<size_t>(image.width) * image.channels;
+    const size_t outStride = static_cast<size_t>(half.width) * half.channels;
+    const int channels = image.channels;
+
+    for (size_t y = beginRow; y < endRow; ++y) {
+        const Sample* top = in + 2 * y * inStride;
+        const Sample* bottom = top + inStride;
+        Sample* row = out + y * outStride;
+        for (int x = 0; x < half.width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                const size_t left = static_cast<size_t>(2 * x) * channels + c;
+                const Sum sum = Sum(top[left]) + top[left + channels] + bottom[left] + bottom[left + channels];
+                if constexpr (std::is_floating_point_v<Sample>) {
+                    row[x * channels + c] = sum * Sample(0.25);
+                } else {
+                    row[x * channels + c] = static_cast<Sample>((sum + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+ImageData ImagePyramid::halve(const ImageData& image, ThreadPool* threadPool) {
+    if (!image.isValid() || image.width < 2 || image.height < 2) {
+        throw std::invalid_argument("Cannot halve an image smaller than 2x2");
+    }
+
+    ImageData half = BufferPool::shared().allocateImage(image.width / 2, image.height / 2, image.channels, image.sampleType);
+    half.transfer = image.transfer;
+
+    auto rows = [&](size_t beginRow, size_t endRow) {
+        switch (image.sampleType) {
+        case SampleType::U16:
+            halveRows<uint16_t, uint32_t>(image, half, beginRow, endRow);
+            break;
+        case SampleType::F32:
+            halveRows<float, float>(image, half, beginRow, endRow);
+            break;
+        case SampleType::U8:
+        default:
+            halveRows<unsigned char, uint32_t>(image, half, beginRow, endRow);
+            break;
+        }
+    };
+    if (threadPool) {
+        threadPool->parallelFor(half.height, rows);
+    } else {
+        rows(0, half.height);
+    }
+    return half;
+}
+
+bool ImagePyramid::canHalve(const ImageData& image) {
+    return image.width / 2 >= kMinLevelSize && image.height / 2 >= kMinLevelSize;
+}
\ No newline at end of file
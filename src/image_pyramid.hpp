@@ -0,0 +1,19 @@
+#pragma once
+
+#include "image_data.hpp"
+
+class ThreadPool;
+
+// Area-filtered downsampling for coarse-to-fine solves
+class ImagePyramid {
+public:
+    // Smallest side a level may have; coarser levels hold too few pixels to be worth solving
+    static constexpr int kMinLevelSize = 32;
+
+    // Half-size copy in which every pixel is the mean of a 2x2 block, keeping the sample type and
+    // transfer; an odd last row or column is dropped. The storage comes from BufferPool::shared().
+    static ImageData halve(const ImageData& image, ThreadPool* threadPool = nullptr);
+
+    // True when the image can be halved without going below kMinLevelSize
+    static bool canHalve(const ImageData& image);
+};
\ No newline at end of file
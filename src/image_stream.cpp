@@ -0,0 +1,206 @@
+#include "image_stream.hpp"
+#include "buffer_pool.hpp"
+#include "image_file_handler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// Read the next header token of a PNM file, skipping whitespace and '#' comments
+bool readPnmToken(FILE* file, std::string& token) {
+    token.clear();
+    int c = std::fgetc(file);
+    while (c != EOF) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = std::fgetc(file);
+            }
+        } else if (std::isspace(c)) {
+            c = std::fgetc(file);
+        } else {
+            break;
+        }
+    }
+    while (c != EOF && !std::isspace(c)) {
+        token.push_back(static_cast<char>(c));
+        c = std::fgetc(file);
+    }
+    // The single whitespace character after the last header token has been consumed
+    return !token.empty();
+}
+
+bool parsePositive(const std::string& token, int& value) {
+    try {
+        size_t consumed = 0;
+        value = std::stoi(token, &consumed);
+        return consumed == token.size() && value > 0;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<PnmStreamReader> PnmStreamReader::open(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<PnmStreamReader> reader(new PnmStreamReader());
+    reader->file_ = file;
+    
+    std::string magic, width, height, maxValue;
+    int maxSample = 0;
+    if (!readPnmToken(file, magic) || magic != "P6" ||
+        !readPnmToken(file, width) || !parsePositive(width, reader->width_) ||
+        !readPnmToken(file, height) || !parsePositive(height, reader->height_) ||
+        !readPnmToken(file, maxValue) || !parsePositive(maxValue, maxSample) || maxSample != 255) {
+        return nullptr;
+    }
+    
+    reader->channels_ = 3;
+    return reader;
+}
+
+PnmStreamReader::~PnmStreamReader() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+int PnmStreamReader::readRows(unsigned char* buffer, int rowCount) {
+    rowCount = std::min(rowCount, height_ - rowsRead_);
+    if (rowCount <= 0) {
+        return 0;
+    }
+    
+    if (std::fread(buffer, rowBytes(), rowCount, file_) != static_cast<size_t>(rowCount)) {
+        std::cerr << "Error: Unexpected end of PPM data after row " << rowsRead_ << std::endl;
+        return -1;
+    }
+    rowsRead_ += rowCount;
+    return rowCount;
+}
+
+std::unique_ptr<PnmStreamWriter> PnmStreamWriter::open(const std::string& path, int width, int height, int channels,
+                                                       SampleType sampleType) {
+    if (channels != 3) {
+        std::cerr << "Error: PPM output requires RGB (3 channels), but image has " << channels << " channels" << std::endl;
+        return nullptr;
+    }
+    if (sampleType == SampleType::F32) {
+        std::cerr << "Error: PPM output requires 8- or 16-bit samples" << std::endl;
+        return nullptr;
+    }
+    
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error: Failed to open '" << path << "' for writing" << std::endl;
+        return nullptr;
+    }
+    
+    std::unique_ptr<PnmStreamWriter> writer(new PnmStreamWriter());
+    writer->file_ = file;
+    writer->wideSamples_ = sampleType == SampleType::U16;
+    writer->rowBytes_ = static_cast<size_t>(width) * channels * SampleBytes(sampleType);
+    std::fprintf(file, "P6\n%d %d\n%d\n", width, height, writer->wideSamples_ ? 65535 : 255);
+    return writer;
+}
+
+PnmStreamWriter::~PnmStreamWriter() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+bool PnmStreamWriter::writeRows(const unsigned char* rows, int rowCount) {
+    if (!wideSamples_) {
+        return std::fwrite(rows, rowBytes_, rowCount, file_) == static_cast<size_t>(rowCount);
+    }
+    
+    // PPM stores 16-bit samples most significant byte first
+    swapped_.resize(rowBytes_);
+    for (int row = 0; row < rowCount; ++row) {
+        const unsigned char* in = rows + row * rowBytes_;
+        for (size_t i = 0; i < rowBytes_; i += 2) {
+            uint16_t sample;
+            std::memcpy(&sample, in + i, sizeof(sample));
+            swapped_[i] = static_cast<unsigned char>(sample >> 8);
+            swapped_[i + 1] = static_cast<unsigned char>(sample & 0xFF);
+        }
+        if (std::fwrite(swapped_.data(), rowBytes_, 1, file_) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PnmStreamWriter::finish() {
+    bool ok = std::fclose(file_) == 0;
+    file_ = nullptr;
+    return ok;
+}
+
+DecodedImageReader::DecodedImageReader(ImageData image)
+    : image_(std::move(image)) {
+    width_ = image_.width;
+    height_ = image_.height;
+    channels_ = image_.channels;
+}
+
+int DecodedImageReader::readRows(unsigned char* buffer, int rowCount) {
+    rowCount = std::min(rowCount, height_ - rowsRead_);
+    if (rowCount <= 0) {
+        return 0;
+    }
+    
+    std::memcpy(buffer, image_.data.get() + rowsRead_ * rowBytes(), rowCount * rowBytes());
+    rowsRead_ += rowCount;
+    return rowCount;
+}
+
+BufferedImageWriter::BufferedImageWriter(const std::string& path, int width, int height, int channels)
+    : path_(path), image_(BufferPool::shared().allocateImage(width, height, channels, SampleType::U8)) {
+    // Streamed rows are 8-bit sRGB codes
+    image_.transfer = TransferFunction::Srgb;
+}
+
+bool BufferedImageWriter::writeRows(const unsigned char* rows, int rowCount) {
+    const size_t rowBytes = static_cast<size_t>(image_.width) * image_.channels;
+    if (rowsWritten_ + rowCount > image_.height) {
+        return false;
+    }
+    
+    std::memcpy(image_.data.get() + rowsWritten_ * rowBytes, rows, rowCount * rowBytes);
+    rowsWritten_ += rowCount;
+    return true;
+}
+
+bool BufferedImageWriter::finish() {
+    return rowsWritten_ == image_.height && ImageFileHandler::saveImage(image_, path_);
+}
+
+bool StreamRows(ImageReader& reader, ImageWriter& writer, int stripRows,
+                const std::function<void(unsigned char* rows, int rowCount)>& transform) {
+    // A strip never needs more rows than the image has
+    stripRows = std::clamp(stripRows, 1, std::max(1, reader.height()));
+    std::vector<unsigned char> strip(reader.rowBytes() * stripRows);
+    
+    int rowsDone = 0;
+    while (rowsDone < reader.height()) {
+        int rowCount = reader.readRows(strip.data(), stripRows);
+        if (rowCount <= 0) {
+            return false;
+        }
+        transform(strip.data(), rowCount);
+        if (!writer.writeRows(strip.data(), rowCount)) {
+            return false;
+        }
+        rowsDone += rowCount;
+    }
+    return writer.finish();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "image_data.hpp"
+
+// Sequential source of image rows, so large frames can be processed a strip at a time
+class ImageReader {
+public:
+    virtual ~ImageReader() = default;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int channels() const { return channels_; }
+    size_t rowBytes() const { return static_cast<size_t>(width_) * channels_; }
+
+    // Read up to rowCount rows into buffer (rowCount * rowBytes() bytes).
+    // Returns the number of rows read; 0 once every row has been read, -1 on error.
+    virtual int readRows(unsigned char* buffer, int rowCount) = 0;
+
+protected:
+    int width_ = 0;
+    int height_ = 0;
+    int channels_ = 0;
+};
+
+// Sequential sink of image rows
+class ImageWriter {
+public:
+    virtual ~ImageWriter() = default;
+
+    virtual bool writeRows(const unsigned char* rows, int rowCount) = 0;
+
+    // Flush everything to disk; must be called after the last row
+    virtual bool finish() = 0;
+};
+
+// Binary 8-bit PPM (P6) read straight from the file one strip at a time
+class PnmStreamReader : public ImageReader {
+public:
+    // Returns nullptr if the file is not an 8-bit binary PPM
+    static std::unique_ptr<PnmStreamReader> open(const std::string& path);
+    ~PnmStreamReader() override;
+
+    int readRows(unsigned char* buffer, int rowCount) override;
+
+private:
+    PnmStreamReader() = default;
+
+    FILE* file_ = nullptr;
+    int rowsRead_ = 0;
+};
+
+// Binary 8- or 16-bit PPM (P6) written as rows arrive
+class PnmStreamWriter : public ImageWriter {
+public:
+    // 16-bit rows are given in native byte order and stored big-endian; float samples are not supported
+    static std::unique_ptr<PnmStreamWriter> open(const std::string& path, int width, int height, int channels,
+                                                 SampleType sampleType = SampleType::U8);
+    ~PnmStreamWriter() override;
+
+    bool writeRows(const unsigned char* rows, int rowCount) override;
+    bool finish() override;
+
+private:
+    PnmStreamWriter() = default;
+
+    FILE* file_ = nullptr;
+    size_t rowBytes_ = 0;
+    bool wideSamples_ = false;
+    std::vector<unsigned char> swapped_; // Big-endian copy of 16-bit rows
+};
+
+// Fallback for formats that cannot stream: decodes the whole image up front and hands out rows
+class DecodedImageReader : public ImageReader {
+public:
+    explicit DecodedImageReader(ImageData image);
+
+    int readRows(unsigned char* buffer, int rowCount) override;
+
+private:
+    ImageData image_;
+    int rowsRead_ = 0;
+};
+
+// Fallback for formats that cannot stream: collects every row and encodes on finish()
+class BufferedImageWriter : public ImageWriter {
+public:
+    BufferedImageWriter(const std::string& path, int width, int height, int channels);
+
+    bool writeRows(const unsigned char* rows, int rowCount) override;
+    bool finish() override;
+
+private:
+    std::string path_;
+    ImageData image_;
+    int rowsWritten_ = 0;
+};
+
+// Read strips of stripRows rows, transform each in place and hand it to the writer.
+// Only one strip is held in memory besides whatever a fallback reader or writer buffers.
+bool StreamRows(ImageReader& reader, ImageWriter& writer, int stripRows,
+                const std::function<void(unsigned char* rows, int rowCount)>& transform);
@@ -0,0 +1,344 @@
+#include "json_object.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Recursive-descent reader over one line of text
+class Reader {
+public:
+    explicit Reader(const std::string& text) : text_(text) {}
+
+    void skipSpace() {
+        while (pos_ < text_.size() && std::strchr(" \t\r\n", text_[pos_]) != nullptr) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeWord(const char* word) {
+        skipSpace();
+        const size_t length = std::strlen(word);
+        if (text_.compare(pos_, length, word) == 0) {
+            pos_ += length;
+            return true;
+        }
+        return false;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos_ == text_.size();
+    }
+
+    char peek() {
+        skipSpace();
+        return pos_ < text_.size() ? text_[pos_] : '\0';
+    }
+
+    size_t position() const { return pos_; }
+
+    // A quoted string with the JSON escapes; \u escapes are encoded as UTF-8
+    bool readString(std::string& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        out.clear();
+        while (pos_ < text_.size()) {
+            const char c = text_[pos_++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+            const char escape = text_[pos_++];
+            switch (escape) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned int code = 0;
+                if (pos_ + 4 > text_.size() ||
+                    std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, code, 16).ptr != text_.data() + pos_ + 4) {
+                    return false;
+                }
+                pos_ += 4;
+                if (code < 0x80) {
+                    out += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    out += static_cast<char>(0xC0 | (code >> 6));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    out += static_cast<char>(0xE0 | (code >> 12));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool readNumber(double& out) {
+        skipSpace();
+        const char* begin = text_.data() + pos_;
+        const char* end = text_.data() + text_.size();
+        // from_chars rejects a leading '+', as JSON does
+        const auto result = std::from_chars(begin, end, out);
+        if (result.ec != std::errc() || !std::isfinite(out)) {
+            return false;
+        }
+        pos_ += static_cast<size_t>(result.ptr - begin);
+        return true;
+    }
+
+private:
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+void appendNumber(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    // Counts print as integers; the shortest form would write 100000 as 1e+05
+    const bool integral = std::fabs(value) < 9007199254740992.0 && std::floor(value) == value;
+    const auto result = integral ? std::to_chars(buffer, buffer + sizeof(buffer), static_cast<long long>(value))
+                                 : std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void appendString(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned int>(c));
+                out += escape;
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+std::optional<JsonObject> JsonObject::parse(const std::string& text, std::string& error) {
+    Reader reader(text);
+    auto fail = [&](const char* what) {
+        error = std::string(what) + " at offset " + std::to_string(reader.position());
+        return std::nullopt;
+    };
+
+    if (!reader.consume('{')) {
+        return fail("Expected '{'");
+    }
+    JsonObject object;
+    if (!reader.consume('}')) {
+        do {
+            std::string key;
+            if (!reader.readString(key)) {
+                return fail("Expected a member name");
+            }
+            if (!reader.consume(':')) {
+                return fail("Expected ':'");
+            }
+
+            Value value;
+            const char next = reader.peek();
+            if (next == '"') {
+                value.type = Value::Type::String;
+                if (!reader.readString(value.text)) {
+                    return fail("Unterminated string");
+                }
+            } else if (next == '[') {
+                reader.consume('[');
+                value.type = Value::Type::Numbers;
+                if (!reader.consume(']')) {
+                    do {
+                        double number;
+                        if (!reader.readNumber(number)) {
+                            return fail("Expected a number in the array");
+                        }
+                        value.numbers.push_back(number);
+                    } while (reader.consume(','));
+                    if (!reader.consume(']')) {
+                        return fail("Expected ']'");
+                    }
+                }
+            } else if (reader.consumeWord("true") || reader.consumeWord("false")) {
+                value.type = Value::Type::Boolean;
+                value.flag = next == 't';
+            } else if (reader.consumeWord("null")) {
+                value.type = Value::Type::Null;
+            } else if (next == '{') {
+                return fail("Nested objects are not supported");
+            } else {
+                value.type = Value::Type::Number;
+                if (!reader.readNumber(value.number)) {
+                    return fail("Expected a value");
+                }
+            }
+            object.set(key, std::move(value));
+        } while (reader.consume(','));
+
+        if (!reader.consume('}')) {
+            return fail("Expected ',' or '}'");
+        }
+    }
+    if (!reader.atEnd()) {
+        return fail("Unexpected text after the object");
+    }
+    return object;
+}
+
+std::optional<std::string> JsonObject::string(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value || value->type != Value::Type::String) {
+        return std::nullopt;
+    }
+    return value->text;
+}
+
+std::optional<double> JsonObject::number(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value || value->type != Value::Type::Number) {
+        return std::nullopt;
+    }
+    return value->number;
+}
+
+std::optional<bool> JsonObject::boolean(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value || value->type != Value::Type::Boolean) {
+        return std::nullopt;
+    }
+    return value->flag;
+}
+
+void JsonObject::setString(const std::string& key, const std::string& text) {
+    Value value;
+    value.type = Value::Type::String;
+    value.text = text;
+    set(key, std::move(value));
+}
+
+void JsonObject::setNumber(const std::string& key, double number) {
+    Value value;
+    value.type = Value::Type::Number;
+    value.number = number;
+    set(key, std::move(value));
+}
+
+void JsonObject::setBoolean(const std::string& key, bool flag) {
+    Value value;
+    value.type = Value::Type::Boolean;
+    value.flag = flag;
+    set(key, std::move(value));
+}
+
+void JsonObject::setNumbers(const std::string& key, const std::vector<double>& numbers) {
+    Value value;
+    value.type = Value::Type::Numbers;
+    value.numbers = numbers;
+    set(key, std::move(value));
+}
+
+void JsonObject::copy(const JsonObject& other, const std::string& key) {
+    if (const Value* value = other.find(key)) {
+        set(key, *value);
+    }
+}
+
+std::string JsonObject::serialize() const {
+    std::string out = "{";
+    for (size_t i = 0; i < members_.size(); ++i) {
+        const auto& [key, value] = members_[i];
+        if (i > 0) {
+            out += ',';
+        }
+        appendString(out, key);
+        out += ':';
+        switch (value.type) {
+        case Value::Type::String:
+            appendString(out, value.text);
+            break;
+        case Value::Type::Number:
+            appendNumber(out, value.number);
+            break;
+        case Value::Type::Boolean:
+            out += value.flag ? "true" : "false";
+            break;
+        case Value::Type::Numbers:
+            out += '[';
+            for (size_t j = 0; j < value.numbers.size(); ++j) {
+                if (j > 0) {
+                    out += ',';
+                }
+                appendNumber(out, value.numbers[j]);
+            }
+            out += ']';
+            break;
+        case Value::Type::Null:
+        default:
+            out += "null";
+            break;
+        }
+    }
+    out += '}';
+    return out;
+}
+
+const JsonObject::Value* JsonObject::find(const std::string& key) const {
+    for (const auto& member : members_) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+void JsonObject::set(const std::string& key, Value value) {
+    for (auto& member : members_) {
+        if (member.first == key) {
+            member.second = std::move(value);
+            return;
+        }
+    }
+    members_.emplace_back(key, std::move(value));
+}
\ No newline at end of file
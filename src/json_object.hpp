@@ -0,0 +1,46 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Flat JSON object for the one-line requests and responses of the daemon: string, number, boolean
+// and null members plus arrays of numbers. Nested objects are rejected. Members keep their order.
+class JsonObject {
+public:
+    // Parse one object; on failure returns nothing and describes the problem in error
+    static std::optional<JsonObject> parse(const std::string& text, std::string& error);
+
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+
+    // Typed member access; nothing when the member is missing or has another type
+    std::optional<std::string> string(const std::string& key) const;
+    std::optional<double> number(const std::string& key) const;
+    std::optional<bool> boolean(const std::string& key) const;
+
+    // Add a member, replacing one with the same key
+    void setString(const std::string& key, const std::string& value);
+    void setNumber(const std::string& key, double value);
+    void setBoolean(const std::string& key, bool value);
+    void setNumbers(const std::string& key, const std::vector<double>& values);
+    // Copy a member of any type from another object, if it has one
+    void copy(const JsonObject& other, const std::string& key);
+
+    // Compact single-line form
+    std::string serialize() const;
+
+private:
+    struct Value {
+        enum class Type { Null, String, Number, Boolean, Numbers } type = Type::Null;
+        std::string text;
+        double number = 0.0;
+        bool flag = false;
+        std::vector<double> numbers;
+    };
+
+    const Value* find(const std::string& key) const;
+    void set(const std::string& key, Value value);
+
+    std::vector<std::pair<std::string, Value>> members_;
+};
\ No newline at end of file
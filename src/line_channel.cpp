@@ -0,0 +1,87 @@
+#include "line_channel.hpp"
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kPollMilliseconds = 200;
+
+} // namespace
+
+LineChannel::LineChannel(int readFd, int writeFd, bool ownsDescriptors)
+    : readFd_(readFd), writeFd_(writeFd), ownsDescriptors_(ownsDescriptors) {}
+
+LineChannel::~LineChannel() {
+    if (ownsDescriptors_) {
+        close(readFd_);
+        if (writeFd_ != readFd_) {
+            close(writeFd_);
+        }
+    }
+}
+
+bool LineChannel::send(const std::string& line) {
+    const std::string message = line + "\n";
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    size_t written = 0;
+    while (written < message.size()) {
+        const ssize_t result = write(writeFd_, message.data() + written, message.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool LineChannel::receive(const std::function<void(const std::string& line)>& onLine, const std::function<bool()>& stop) {
+    std::string pending;
+    char buffer[64 * 1024];
+    while (!stop || !stop()) {
+        pollfd descriptor{ readFd_, POLLIN, 0 };
+        const int ready = poll(&descriptor, 1, kPollMilliseconds);
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        const ssize_t count = read(readFd_, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return false;
+        }
+        if (count == 0) {
+            // A last line without a newline still counts
+            if (!pending.empty()) {
+                onLine(pending);
+            }
+            return true;
+        }
+
+        pending.append(buffer, static_cast<size_t>(count));
+        size_t start = 0;
+        for (size_t end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+            size_t length = end - start;
+            if (length > 0 && pending[end - 1] == '\r') {
+                --length;
+            }
+            if (length > 0) {
+                onLine(pending.substr(start, length));
+            }
+            start = end + 1;
+        }
+        pending.erase(0, start);
+        if (pending.size() > kMaxLineBytes) {
+            return false;
+        }
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Newline-delimited messages over file descriptors (a pipe, the standard streams or a stream
+// socket), shared by the daemon and its client. POSIX only.
+class LineChannel {
+public:
+    static constexpr size_t kMaxLineBytes = size_t(1) << 20;
+
+    // ownsDescriptors closes both descriptors (once, if they are the same) on destruction
+    LineChannel(int readFd, int writeFd, bool ownsDescriptors);
+    ~LineChannel();
+
+    LineChannel(const LineChannel&) = delete;
+    LineChannel& operator=(const LineChannel&) = delete;
+
+    // Write the line and a newline; safe to call from several threads. False once the peer is gone.
+    bool send(const std::string& line);
+
+    // Pass each non-empty line to onLine until end of input or a read error, or until stop returns
+    // true (checked a few times a second). False for read errors and lines over kMaxLineBytes.
+    bool receive(const std::function<void(const std::string& line)>& onLine,
+                 const std::function<bool()>& stop = nullptr);
+
+private:
+    int readFd_;
+    int writeFd_;
+    bool ownsDescriptors_;
+    std::mutex writeMutex_;
+};
\ No newline at end of file
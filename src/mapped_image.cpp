@@ -0,0 +1,357 @@
+#include "mapped_image.hpp"
+#include "buffer_pool.hpp"
+#include "transfer_function.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Mapping {
+    void* base = nullptr;
+    size_t bytes = 0;
+    uint64_t device = 0; // Identity of a mapped input file, so it is not overwritten while viewed
+    uint64_t inode = 0;
+};
+
+// Mappings of live images, keyed by the address of their first pixel
+std::mutex registryMutex;
+std::unordered_map<void*, Mapping> registry;
+
+std::string lowerExtension(const std::string& path) {
+    const size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? std::string() : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+// Header tokens of a PNM or PFM file in memory, with '#' comments skipped
+class HeaderReader {
+public:
+    HeaderReader(const unsigned char* data, size_t size) : data_(data), size_(size) {}
+
+    bool token(std::string& value) {
+        value.clear();
+        while (pos_ < size_) {
+            if (data_[pos_] == '#') {
+                while (pos_ < size_ && data_[pos_] != '\n') {
+                    ++pos_;
+                }
+            } else if (std::isspace(data_[pos_])) {
+                ++pos_;
+            } else {
+                break;
+            }
+        }
+        while (pos_ < size_ && !std::isspace(data_[pos_])) {
+            value.push_back(static_cast<char>(data_[pos_++]));
+        }
+        // Exactly one whitespace character separates the last token from the samples
+        if (pos_ < size_) {
+            ++pos_;
+        }
+        return !value.empty();
+    }
+
+    bool positive(int& value) {
+        std::string text;
+        if (!token(text)) {
+            return false;
+        }
+        try {
+            size_t consumed = 0;
+            value = std::stoi(text, &consumed);
+            return consumed == text.size() && value > 0;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    size_t position() const { return pos_; }
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+bool hostIsLittleEndian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+#if !defined(_WIN32)
+
+// Whole file, mapped copy-on-write
+Mapping mapFile(const std::string& path) {
+    Mapping mapping;
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return mapping;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+        void* base = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) {
+            mapping.base = base;
+            mapping.bytes = static_cast<size_t>(status.st_size);
+            mapping.device = static_cast<uint64_t>(status.st_dev);
+            mapping.inode = static_cast<uint64_t>(status.st_ino);
+        }
+    }
+    close(fd);
+    return mapping;
+}
+
+// New file of the given size, mapped so writes reach it
+Mapping createFile(const std::string& path, size_t bytes) {
+    Mapping mapping;
+    if (MappedImage::isViewed(path)) {
+        return mapping;
+    }
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return mapping;
+    }
+#if defined(__linux__)
+    // Reserve the blocks now: a full disk fails here instead of faulting on a later write to the mapping
+    const bool sized = posix_fallocate(fd, 0, static_cast<off_t>(bytes)) == 0;
+#else
+    const bool sized = ftruncate(fd, static_cast<off_t>(bytes)) == 0;
+#endif
+    if (sized) {
+        void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            mapping.base = base;
+            mapping.bytes = bytes;
+        }
+    }
+    close(fd);
+    if (!mapping.base) {
+        unlink(path.c_str());
+    }
+    return mapping;
+}
+
+void unmap(const Mapping& mapping) {
+    munmap(mapping.base, mapping.bytes);
+}
+
+#else
+
+Mapping mapFile(const std::string&) {
+    return Mapping();
+}
+
+Mapping createFile(const std::string&, size_t) {
+    return Mapping();
+}
+
+void unmap(const Mapping&) {}
+
+#endif
+
+// Image whose pixels start offset bytes into the mapping; the mapping is released with the image
+ImageData viewOf(const Mapping& mapping, size_t offset, int width, int height, SampleType sampleType,
+                 TransferFunction transfer, void (*release)(void*)) {
+    unsigned char* pixels = static_cast<unsigned char*>(mapping.base) + offset;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry[pixels] = mapping;
+    }
+    ImageData image;
+    image.data = std::unique_ptr<unsigned char, void(*)(void*)>(pixels, release);
+    image.width = width;
+    image.height = height;
+    image.channels = 3;
+    image.sampleType = sampleType;
+    image.transfer = transfer;
+    return image;
+}
+
+// PFM rows run bottom to top and samples may be big-endian, so they are copied into a pooled image
+ImageData copyPfm(const unsigned char* samples, int width, int height, bool littleEndian) {
+    ImageData image = BufferPool::shared().allocateImage(width, height, 3, SampleType::F32);
+    image.transfer = TransferFunction::Linear;
+    const size_t rowBytes = image.rowBytes();
+    const bool swap = littleEndian != hostIsLittleEndian();
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* in = samples + static_cast<size_t>(height - 1 - y) * rowBytes;
+        unsigned char* out = image.data.get() + static_cast<size_t>(y) * rowBytes;
+        if (!swap) {
+            std::memcpy(out, in, rowBytes);
+            continue;
+        }
+        for (size_t i = 0; i < rowBytes; i += 4) {
+            out[i] = in[i + 3];
+            out[i + 1] = in[i + 2];
+            out[i + 2] = in[i + 1];
+            out[i + 3] = in[i];
+        }
+    }
+    return image;
+}
+
+} // namespace
+
+bool MappedImage::parseRawName(const std::string& path, int& width, int& height, SampleType& sampleType) {
+    const std::string extension = lowerExtension(path);
+    if (extension == "rgb") {
+        sampleType = SampleType::U8;
+    } else if (extension == "rgb16") {
+        sampleType = SampleType::U16;
+    } else if (extension == "rgbf") {
+        sampleType = SampleType::F32;
+    } else {
+        return false;
+    }
+
+    // "..._<width>x<height>.<extension>"
+    const size_t dot = path.find_last_of('.');
+    const size_t underscore = path.find_last_of('_', dot);
+    if (underscore == std::string::npos) {
+        return false;
+    }
+    const std::string size = path.substr(underscore + 1, dot - underscore - 1);
+    int consumed = 0;
+    return std::sscanf(size.c_str(), "%dx%d%n", &width, &height, &consumed) == 2 &&
+           consumed == static_cast<int>(size.size()) && width > 0 && height > 0;
+}
+
+bool MappedImage::isViewed(const std::string& path) {
+#if !defined(_WIN32)
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& entry : registry) {
+        if (entry.second.inode == static_cast<uint64_t>(status.st_ino) && entry.second.device == static_cast<uint64_t>(status.st_dev)) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+ImageData MappedImage::load(const std::string& path) {
+    const std::string extension = lowerExtension(path);
+    int width = 0, height = 0;
+    SampleType sampleType = SampleType::U8;
+    const bool raw = parseRawName(path, width, height, sampleType);
+    if (!raw && extension != "ppm" && extension != "pnm" && extension != "pfm") {
+        return ImageData();
+    }
+
+    // Raw dumps and PFM have no other reader, so failures are reported here; PPM falls back to stb
+    const bool reportErrors = raw || extension == "pfm";
+    const Mapping mapping = mapFile(path);
+    if (!mapping.base) {
+        if (reportErrors) {
+            std::cerr << "Error: Failed to map image '" << path << "'" << std::endl;
+        }
+        return ImageData();
+    }
+    const unsigned char* bytes = static_cast<const unsigned char*>(mapping.base);
+
+    if (raw) {
+        const size_t expected = static_cast<size_t>(width) * height * 3 * SampleBytes(sampleType);
+        if (mapping.bytes != expected) {
+            std::cerr << "Error: Raw image '" << path << "' holds " << mapping.bytes << " bytes, but its name states "
+                      << width << "x" << height << " " << SampleTypeName(sampleType) << " RGB (" << expected << " bytes)" << std::endl;
+            unmap(mapping);
+            return ImageData();
+        }
+        const TransferFunction transfer = sampleType == SampleType::F32 ? TransferFunction::Linear : TransferFunction::Srgb;
+        return viewOf(mapping, 0, width, height, sampleType, transfer, &MappedImage::release);
+    }
+
+    HeaderReader header(bytes, mapping.bytes);
+    std::string magic, scale;
+    int maxValue = 0;
+    if (!header.token(magic) || (magic != "P6" && magic != "PF") || !header.positive(width) || !header.positive(height)) {
+        if (reportErrors) {
+            std::cerr << "Error: '" << path << "' is not a color PFM file" << std::endl;
+        }
+        unmap(mapping);
+        return ImageData();
+    }
+
+    if (magic == "PF") {
+        // A negative scale marks little-endian samples; its magnitude carries no meaning here
+        ImageData image;
+        const size_t samples = static_cast<size_t>(width) * height * 3 * sizeof(float);
+        if (header.token(scale) && mapping.bytes - header.position() >= samples) {
+            image = copyPfm(bytes + header.position(), width, height, scale[0] == '-');
+        } else {
+            std::cerr << "Error: Truncated or malformed PFM file '" << path << "'" << std::endl;
+        }
+        unmap(mapping);
+        return image;
+    }
+
+    // 16-bit PPM stores big-endian samples, so only 8-bit files can be viewed in place
+    const size_t samples = static_cast<size_t>(width) * height * 3;
+    if (!header.positive(maxValue) || maxValue != 255 || mapping.bytes - header.position() < samples) {
+        unmap(mapping);
+        return ImageData();
+    }
+    return viewOf(mapping, header.position(), width, height, SampleType::U8, TransferFunction::Srgb, &MappedImage::release);
+}
+
+ImageData MappedImage::create(const std::string& path, int width, int height, int channels,
+                              SampleType sampleType, TransferFunction transfer) {
+    if (channels != 3 || width <= 0 || height <= 0) {
+        return ImageData();
+    }
+
+    std::string header;
+    int rawWidth = 0, rawHeight = 0;
+    SampleType rawType = SampleType::U8;
+    if (parseRawName(path, rawWidth, rawHeight, rawType)) {
+        const TransferFunction rawTransfer = rawType == SampleType::F32 ? TransferFunction::Linear : TransferFunction::Srgb;
+        if (rawWidth != width || rawHeight != height || rawType != sampleType || rawTransfer != transfer) {
+            return ImageData();
+        }
+    } else if (lowerExtension(path) == "ppm" && sampleType == SampleType::U8 && transfer == TransferFunction::Srgb) {
+        header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    } else {
+        return ImageData();
+    }
+
+    const size_t pixelBytes = static_cast<size_t>(width) * height * channels * SampleBytes(sampleType);
+    const Mapping mapping = createFile(path, header.size() + pixelBytes);
+    if (!mapping.base) {
+        return ImageData();
+    }
+    std::memcpy(mapping.base, header.data(), header.size());
+    return viewOf(mapping, header.size(), width, height, sampleType, transfer, &MappedImage::release);
+}
+
+void MappedImage::release(void* pixels) {
+    Mapping mapping;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = registry.find(pixels);
+        if (it == registry.end()) {
+            return;
+        }
+        mapping = it->second;
+        registry.erase(it);
+    }
+    unmap(mapping);
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include "image_data.hpp"
+
+// Uncompressed frames read and written through memory mappings instead of stb's decode and encode
+// copies. Binary 8-bit PPM (P6) and raw interleaved RGB dumps are viewed in place; PFM is copied out
+// of the mapping because it stores the bottom row first. Raw dumps carry their size in the name:
+// <name>_<width>x<height>.rgb holds 8-bit sRGB samples, .rgb16 native-endian 16-bit sRGB and .rgbf
+// linear float32. Mapped images release their mapping through a registry keyed by pixel address,
+// which fits ImageData's plain function pointer deleter. POSIX only; elsewhere nothing maps and
+// ImageFileHandler falls back to stb.
+class MappedImage {
+public:
+    // View of a PPM, raw or PFM file, or an invalid image if the file is not one of them (not an
+    // error: the caller decodes it another way). Views are copy-on-write, so correcting one in place
+    // never modifies the file.
+    static ImageData load(const std::string& path);
+
+    // Create the file with its header and map its pixels, so writing the image writes the file and no
+    // encode pass is needed; the file is complete when the image is destroyed. Binary PPM takes 8-bit
+    // sRGB images, raw dumps whatever their name states; an invalid image for anything else.
+    static ImageData create(const std::string& path, int width, int height, int channels,
+                            SampleType sampleType, TransferFunction transfer);
+
+    // True while a view of the file at path is alive. Truncating that file, e.g. by saving a frame
+    // over its own source, would pull the pages out from under the view; create() refuses to.
+    static bool isViewed(const std::string& path);
+
+    // Size and sample format stated by a raw dump's name; false if the name does not follow the pattern
+    static bool parseRawName(const std::string& path, int& width, int& height, SampleType& sampleType);
+
+private:
+    // Deleter of mapped images
+    static void release(void* pixels);
+};
\ No newline at end of file
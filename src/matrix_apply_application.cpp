@@ -0,0 +1,343 @@
+#include "matrix_apply_application.hpp"
+#include "batch_processor.hpp"
+#include "color_correction_kernels.hpp"
+#include "color_correction_matrix_io.hpp"
+#include "color_correction_matrix_solver.hpp"
+#include "command_line.hpp"
+#include "image_file_handler.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+std::optional<MatrixApplyApplication::Arguments>
+MatrixApplyApplication::parseArguments(int argc, char* argv[]) {
+    Arguments args;
+    std::vector<std::string> positional;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::optional<std::string> value;
+        if (arg == "--matrix" || arg == "--batch" || arg == "--output-dir" || arg == "--threads" || arg == "--frames-in-flight" ||
+            arg == "--lut" || arg == "--lut-interp" || arg == "--export-cube" || arg == "--cube-size" || arg == "--strip-rows" ||
+            arg == "--profile-json") {
+            value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+        }
+        
+        if (arg == "--matrix") {
+            args.matrixPath = *value;
+        } else if (arg == "--batch") {
+            args.batchSource = *value;
+        } else if (arg == "--output-dir") {
+            args.outputDirectory = *value;
+        } else if (arg == "--threads") {
+            auto count = CommandLine::parseCount(*value, "thread count", UINT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.threadCount = static_cast<unsigned int>(*count);
+        } else if (arg == "--frames-in-flight") {
+            auto count = CommandLine::parsePositiveCount(*value, "frame count", SIZE_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.maxFramesInFlight = static_cast<size_t>(*count);
+        } else if (arg == "--lut") {
+            auto size = parseLutSize(*value);
+            if (!size) {
+                return std::nullopt;
+            }
+            args.lut.size = *size;
+        } else if (arg == "--lut-interp") {
+            auto interpolation = parseLutInterpolation(*value);
+            if (!interpolation) {
+                return std::nullopt;
+            }
+            args.lut.interpolation = *interpolation;
+        } else if (arg == "--export-cube") {
+            args.cubePath = *value;
+        } else if (arg == "--cube-size") {
+            auto size = parseLutSize(*value);
+            if (!size) {
+                return std::nullopt;
+            }
+            args.cubeSize = *size;
+        } else if (arg == "--stream") {
+            args.stream = true;
+        } else if (arg == "--strip-rows") {
+            auto count = CommandLine::parsePositiveCount(*value, "strip height", INT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.stripRows = static_cast<int>(*count);
+        } else if (arg == "--profile") {
+            args.profile = true;
+        } else if (arg == "--profile-json") {
+            args.profile = true;
+            args.profileJsonPath = *value;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown option '" << arg << "'" << std::endl;
+            return std::nullopt;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    
+    if (args.matrixPath.empty()) {
+        std::cerr << "Error: --matrix is required" << std::endl;
+        return std::nullopt;
+    }
+    
+    if (args.batchSource.has_value()) {
+        if (!positional.empty()) {
+            return std::nullopt;
+        }
+    } else if (positional.size() == 2) {
+        args.inputImagePath = positional[0];
+        args.outputImagePath = positional[1];
+    } else if (!positional.empty() || !args.cubePath.has_value()) {
+        return std::nullopt;
+    }
+    
+    return args;
+}
+
+int MatrixApplyApplication::run(const Arguments& args) {
+    profiler_.setEnabled(args.profile);
+    int status = applyStoredMatrix(args);
+    if (!profiler_.report(args.profileJsonPath)) {
+        return -1;
+    }
+    return status;
+}
+
+int MatrixApplyApplication::applyStoredMatrix(const Arguments& args) {
+    std::optional<ColorCorrectionMatrix> matrix;
+    {
+        auto scope = profiler_.measure("matrix.load");
+        matrix = ColorCorrectionMatrixIO::load(args.matrixPath);
+    }
+    if (!matrix.has_value()) {
+        return -1;
+    }
+    
+    if (args.cubePath.has_value() && !exportCube(matrix.value(), args.cubeSize, args.cubePath.value())) {
+        return -1;
+    }
+    
+    if (args.batchSource.has_value()) {
+        return runBatch(matrix.value(), args.batchSource.value(), args.outputDirectory, args.threadCount, args.maxFramesInFlight, args.lut,
+                        &profiler_);
+    }
+    if (!args.inputImagePath.has_value()) {
+        return 0;
+    }
+    if (args.stream) {
+        return applyStreaming(matrix.value(), args.lut, args.inputImagePath.value(), args.outputImagePath.value(),
+                              args.stripRows, args.threadCount, &profiler_);
+    }
+    
+    Stopwatch decode;
+    ImageData inputImage = ImageFileHandler::loadImage(args.inputImagePath.value());
+    if (!inputImage.isValid()) {
+        return -1;
+    }
+    const size_t pixels = static_cast<size_t>(inputImage.width) * inputImage.height;
+    profiler_.record("decode", decode.seconds(), pixels);
+    
+    try {
+        ThreadPool threadPool(args.threadCount);
+        std::optional<ColorLut3D> lut = bakeLut(matrix.value(), args.lut, threadPool, &profiler_);
+        // PPM and raw outputs are mapped, so the correction is written straight into the file;
+        // other formats are corrected in place and encoded afterwards
+        ImageData outputImage = ImageFileHandler::createMappedImage(args.outputImagePath.value(), inputImage);
+        ImageData& corrected = outputImage.isValid() ? outputImage : inputImage;
+        {
+            auto scope = profiler_.measure("apply", pixels);
+            if (lut.has_value()) {
+                lut->applyInto(inputImage, corrected, &threadPool);
+            } else {
+                ColorCorrectionMatrixSolver::ApplyMatrixInto(inputImage, corrected, matrix.value(), &threadPool);
+            }
+        }
+        auto scope = profiler_.measure("encode", pixels);
+        if (outputImage.isValid()) {
+            outputImage = ImageData(); // Unmaps, completing the file
+            std::cout << "Successfully saved image to: " << args.outputImagePath.value() << std::endl;
+            return 0;
+        }
+        return ImageFileHandler::saveImage(inputImage, args.outputImagePath.value()) ? 0 : -1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error applying color correction: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int MatrixApplyApplication::runBatch(const ColorCorrectionMatrix& matrix, const std::string& batchSource,
+                                     const std::optional<std::string>& outputDirectory, unsigned int threadCount, size_t maxFramesInFlight,
+                                     const LutOptions& lutOptions, StageProfiler* profiler) {
+    auto jobs = BatchProcessor::collectJobs(batchSource, outputDirectory);
+    if (!jobs.has_value()) {
+        return -1;
+    }
+    
+    ThreadPool threadPool(threadCount);
+    BatchOptions options;
+    options.maxFramesInFlight = maxFramesInFlight;
+    options.decodeThreads = std::max(1u, threadPool.threadCount() / 2);
+    options.encodeThreads = std::max(1u, threadPool.threadCount() / 2);
+    
+    std::optional<ColorLut3D> lut;
+    try {
+        lut = bakeLut(matrix, lutOptions, threadPool, profiler);
+    } catch (const std::exception& e) {
+        std::cerr << "Error baking LUT: " << e.what() << std::endl;
+        return -1;
+    }
+    
+    std::cout << "\nProcessing " << jobs->size() << " frames (" << (lut.has_value() ? "LUT" : ApplyKernelName(SelectApplyKernel())) << " kernel, "
+              << threadPool.threadCount() << " threads, " << options.maxFramesInFlight << " frames in flight)..." << std::endl;
+    
+    BatchProcessor processor(threadPool, options);
+    BatchResult result = lut.has_value()
+        ? processor.run(jobs.value(), [&lut](const ImageData& frame, ImageData& output, ThreadPool& pool) { lut->applyInto(frame, output, &pool); })
+        : processor.run(jobs.value(), matrix);
+    
+    std::cout << "Batch finished: " << result.succeeded << " succeeded, " << result.failed << " failed in "
+              << result.seconds << " s";
+    if (result.seconds > 0.0) {
+        std::cout << " (" << result.succeeded / result.seconds << " frames/s)";
+    }
+    std::cout << std::endl;
+    
+    if (profiler) {
+        // Stage times are summed over each stage's threads, so they can exceed the wall time
+        profiler->record("batch.decode (busy)", result.decodeSeconds, result.pixels);
+        profiler->record("batch.apply (busy)", result.applySeconds, result.pixels);
+        profiler->record("batch.encode (busy)", result.encodeSeconds, result.pixels);
+        profiler->record("batch.total", result.seconds, result.pixels);
+    }
+    
+    return result.failed == 0 ? 0 : -1;
+}
+
+int MatrixApplyApplication::applyStreaming(const ColorCorrectionMatrix& matrix, const LutOptions& lutOptions, const std::string& inputPath,
+                                           const std::string& outputPath, int stripRows, unsigned int threadCount,
+                                           StageProfiler* profiler) {
+    auto reader = ImageFileHandler::openReader(inputPath);
+    if (!reader) {
+        return -1;
+    }
+    auto writer = ImageFileHandler::openWriter(outputPath, reader->width(), reader->height(), reader->channels());
+    if (!writer) {
+        return -1;
+    }
+    
+    try {
+        ThreadPool threadPool(threadCount);
+        std::optional<ColorLut3D> lut = bakeLut(matrix, lutOptions, threadPool, profiler);
+        
+        Stopwatch stopwatch;
+        if (lut.has_value()) {
+            const size_t rowBytes = reader->rowBytes();
+            const int width = reader->width();
+            bool streamed = StreamRows(*reader, *writer, stripRows, [&](unsigned char* rows, int rowCount) {
+                threadPool.parallelFor(rowCount, [&](size_t beginRow, size_t endRow) {
+                    unsigned char* band = rows + beginRow * rowBytes;
+                    lut->applyRows(band, band, (endRow - beginRow) * width);
+                });
+            });
+            if (!streamed) {
+                throw std::runtime_error("Failed to stream the image through the LUT");
+            }
+        } else {
+            ColorCorrectionMatrixSolver::ApplyMatrix(*reader, *writer, matrix, stripRows, &threadPool);
+        }
+        if (profiler) {
+            profiler->record("stream.apply", stopwatch.seconds(), static_cast<size_t>(reader->width()) * reader->height());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error applying color correction: " << e.what() << std::endl;
+        return -1;
+    }
+    
+    std::cout << "Color-corrected image streamed to: " << outputPath << std::endl;
+    return 0;
+}
+
+std::optional<ColorLut3D> MatrixApplyApplication::bakeLut(const ColorCorrectionMatrix& matrix, const LutOptions& lut, ThreadPool& threadPool,
+                                                          StageProfiler* profiler) {
+    if (lut.size == 0) {
+        return std::nullopt;
+    }
+    
+    Stopwatch stopwatch;
+    ColorLut3D baked = ColorLut3D::bake(matrix, lut, &threadPool);
+    const double milliseconds = stopwatch.seconds() * 1e3;
+    if (profiler) {
+        profiler->record("lut.bake", stopwatch.seconds());
+    }
+    
+    if (baked.isFull()) {
+        std::cout << "Baked full 256^3 LUT in " << milliseconds << " ms" << std::endl;
+    } else {
+        std::cout << "Baked " << lut.size << "^3 LUT (" << (lut.interpolation == LutInterpolation::Trilinear ? "trilinear" : "tetrahedral")
+                  << ") in " << milliseconds << " ms" << std::endl;
+    }
+    return baked;
+}
+
+std::optional<int> MatrixApplyApplication::parseLutSize(const std::string& value) {
+    if (value == "full") {
+        return ColorLut3D::kFullSize;
+    }
+    auto size = CommandLine::parseCount(value, "LUT size", INT_MAX);
+    if (!size) {
+        return std::nullopt;
+    }
+    if (*size < 2 || *size > static_cast<unsigned long long>(ColorLut3D::kFullSize)) {
+        std::cerr << "Error: LUT size must be 'full' or between 2 and " << ColorLut3D::kFullSize << std::endl;
+        return std::nullopt;
+    }
+    return static_cast<int>(*size);
+}
+
+std::optional<LutInterpolation> MatrixApplyApplication::parseLutInterpolation(const std::string& value) {
+    if (value == "trilinear") {
+        return LutInterpolation::Trilinear;
+    }
+    if (value == "tetrahedral") {
+        return LutInterpolation::Tetrahedral;
+    }
+    std::cerr << "Error: Unknown LUT interpolation '" << value << "' (expected 'trilinear' or 'tetrahedral')" << std::endl;
+    return std::nullopt;
+}
+
+bool MatrixApplyApplication::exportCube(const ColorCorrectionMatrix& matrix, int size, const std::string& path) {
+    if (!ColorLut3D::saveCube(matrix, size, path)) {
+        return false;
+    }
+    std::cout << "Exported " << size << "^3 .cube LUT to: " << path << std::endl;
+    return true;
+}
+
+void MatrixApplyApplication::printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [options] --matrix <matrix_file> <input_image_path> <output_image_path>" << std::endl;
+    std::cerr << "       " << programName << " [options] --matrix <matrix_file> --batch <manifest|directory> [--output-dir <dir>]" << std::endl;
+    std::cerr << "       " << programName << " --matrix <matrix_file> --export-cube <cube_file> [--cube-size N]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --threads N             Worker threads (default: all cores)" << std::endl;
+    std::cerr << "  --frames-in-flight N    Maximum frames held in memory by the batch pipeline (default: 4)" << std::endl;
+    std::cerr << "  --lut full|N            Apply through a baked 3D LUT: every 8-bit color, or an N^3 lattice (e.g. 33, 65)" << std::endl;
+    std::cerr << "  --lut-interp MODE       trilinear|tetrahedral lattice interpolation (default: tetrahedral)" << std::endl;
+    std::cerr << "  --export-cube FILE      Write the correction as a .cube LUT" << std::endl;
+    std::cerr << "  --cube-size N           Lattice size of the exported .cube (default: 33)" << std::endl;
+    std::cerr << "  --stream                Apply from row strips (PPM streams from disk; other formats decode once)" << std::endl;
+    std::cerr << "  --strip-rows N          Rows per strip in streaming mode (default: 64)" << std::endl;
+    std::cerr << "  --profile               Report wall time, MP/s and peak RSS per stage" << std::endl;
+    std::cerr << "  --profile-json FILE     Also write the stage report as JSON" << std::endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include "color_correction_matrix.hpp"
+#include "color_lut.hpp"
+#include "image_data.hpp"
+#include "stage_profiler.hpp"
+#include "thread_pool.hpp"
+
+// Apply-only front end: loads a saved matrix and corrects images without linking the solver
+class MatrixApplyApplication {
+public:
+    struct Arguments {
+        std::string matrixPath;
+        std::optional<std::string> inputImagePath;
+        std::optional<std::string> outputImagePath;
+        std::optional<std::string> batchSource;
+        std::optional<std::string> outputDirectory;
+        unsigned int threadCount = 0; // 0 uses every hardware thread
+        size_t maxFramesInFlight = 4;
+        LutOptions lut;                       // Apply through a baked 3D LUT when lut.size > 0
+        std::optional<std::string> cubePath;  // Export the correction as a .cube file
+        int cubeSize = 33;
+        bool stream = false;                  // Apply strip by strip instead of decoding the whole frame
+        int stripRows = 64;
+        bool profile = false;                 // Report per-stage timings
+        std::optional<std::string> profileJsonPath;
+    };
+
+    // Parse command line arguments
+    static std::optional<Arguments> parseArguments(int argc, char* argv[]);
+    
+    // Apply the stored matrix to one image or a batch
+    int run(const Arguments& args);
+    
+    // Print usage information
+    void printUsage(const char* programName);
+
+    // Correct every frame of a manifest or directory; shared with the solver front end
+    static int runBatch(const ColorCorrectionMatrix& matrix, const std::string& batchSource,
+                        const std::optional<std::string>& outputDirectory, unsigned int threadCount, size_t maxFramesInFlight,
+                        const LutOptions& lut = LutOptions(), StageProfiler* profiler = nullptr);
+
+    // Correct one image strip by strip, with the matrix or a LUT baked from it
+    static int applyStreaming(const ColorCorrectionMatrix& matrix, const LutOptions& lut, const std::string& inputPath,
+                              const std::string& outputPath, int stripRows, unsigned int threadCount,
+                              StageProfiler* profiler = nullptr);
+
+    // Parse "full" or a lattice size for --lut
+    static std::optional<int> parseLutSize(const std::string& value);
+    static std::optional<LutInterpolation> parseLutInterpolation(const std::string& value);
+
+    // Export a .cube file and report the outcome
+    static bool exportCube(const ColorCorrectionMatrix& matrix, int size, const std::string& path);
+
+private:
+    int applyStoredMatrix(const Arguments& args);
+
+    static std::optional<ColorLut3D> bakeLut(const ColorCorrectionMatrix& matrix, const LutOptions& lut, ThreadPool& threadPool,
+                                             StageProfiler* profiler = nullptr);
+
+    StageProfiler profiler_;
+};
@@ -0,0 +1,200 @@
+#include "pixel_sampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+
+namespace {
+
+// 3 bits per channel gives 512 color strata
+constexpr int kStratumBits = 3;
+constexpr size_t kStratumCount = size_t(1) << (3 * kStratumBits);
+
+// Top kStratumBits bits of a channel value
+size_t channelStratum(const ImageData& image, size_t sample) {
+    switch (image.sampleType) {
+    case SampleType::U16:
+        return reinterpret_cast<const uint16_t*>(image.data.get())[sample] >> (16 - kStratumBits);
+    case SampleType::F32: {
+        const float value = reinterpret_cast<const float*>(image.data.get())[sample];
+        const int bin = value > 0.0f ? static_cast<int>(std::min(value, 1.0f) * (1 << kStratumBits)) : 0;
+        return static_cast<size_t>(std::min(bin, (1 << kStratumBits) - 1));
+    }
+    case SampleType::U8:
+    default:
+        return image.data.get()[sample] >> (8 - kStratumBits);
+    }
+}
+
+size_t stratumOf(const ImageData& image, size_t pixel) {
+    const size_t first = pixel * image.channels;
+    return (channelStratum(image, first) << (2 * kStratumBits)) | (channelStratum(image, first + 1) << kStratumBits) |
+           channelStratum(image, first + 2);
+}
+
+} // namespace
+
+std::vector<size_t> PixelSampler::selectPixels(const ImageData& image, const SamplingOptions& options) {
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    
+    if (!isSampling(options, pixelCount)) {
+        std::vector<size_t> all(pixelCount);
+        std::iota(all.begin(), all.end(), size_t(0));
+        return all;
+    }
+    
+    switch (options.mode) {
+    case SamplingMode::Stride:
+        return selectStride(image.width, image.height, options.maxSamples);
+    case SamplingMode::Stratified:
+        return selectStratified(image, options.maxSamples, options.seed);
+    case SamplingMode::Random:
+    default:
+        return selectRandom(pixelCount, options.maxSamples, options.seed);
+    }
+}
+
+std::vector<size_t> PixelSampler::selectHeldOutPixels(size_t pixelCount, const std::vector<size_t>& selected,
+                                                      size_t count, uint32_t seed) {
+    const size_t available = pixelCount - selected.size();
+    std::vector<size_t> heldOut;
+    
+    auto isSelected = [&selected](size_t index) {
+        return std::binary_search(selected.begin(), selected.end(), index);
+    };
+    
+    // When most remaining pixels are needed, walk the complement instead of rejection sampling
+    if (count * 2 >= available) {
+        heldOut.reserve(available);
+        for (size_t i = 0; i < pixelCount; ++i) {
+            if (!isSelected(i)) {
+                heldOut.push_back(i);
+            }
+        }
+        if (heldOut.size() > count) {
+            std::mt19937_64 rng(seed);
+            std::shuffle(heldOut.begin(), heldOut.end(), rng);
+            heldOut.resize(count);
+            std::sort(heldOut.begin(), heldOut.end());
+        }
+        return heldOut;
+    }
+    
+    std::mt19937_64 rng(seed ^ 0x9e3779b97f4a7c15ull);
+    std::uniform_int_distribution<size_t> pick(0, pixelCount - 1);
+    std::unordered_set<size_t> chosen;
+    chosen.reserve(count);
+    while (chosen.size() < count) {
+        size_t index = pick(rng);
+        if (!isSelected(index)) {
+            chosen.insert(index);
+        }
+    }
+    
+    heldOut.assign(chosen.begin(), chosen.end());
+    std::sort(heldOut.begin(), heldOut.end());
+    return heldOut;
+}
+
+std::vector<size_t> PixelSampler::selectStride(int width, int height, size_t maxSamples) {
+    // Use the same stride in x and y so the grid does not alias with the row length
+    size_t step = std::max<size_t>(1, static_cast<size_t>(std::sqrt(double(width) * height / maxSamples)));
+    auto gridSize = [&](size_t s) { return ((width + s - 1) / s) * ((height + s - 1) / s); };
+    while (gridSize(step) > maxSamples) {
+        ++step;
+    }
+    
+    std::vector<size_t> indices;
+    indices.reserve(gridSize(step));
+    for (size_t y = step / 2; y < static_cast<size_t>(height); y += step) {
+        for (size_t x = step / 2; x < static_cast<size_t>(width); x += step) {
+            indices.push_back(y * width + x);
+        }
+    }
+    return indices;
+}
+
+std::vector<size_t> PixelSampler::selectRandom(size_t pixelCount, size_t count, uint32_t seed) {
+    // Floyd's algorithm: count distinct indices in O(count) time and memory
+    std::mt19937_64 rng(seed);
+    std::unordered_set<size_t> chosen;
+    chosen.reserve(count);
+    for (size_t j = pixelCount - count; j < pixelCount; ++j) {
+        size_t index = std::uniform_int_distribution<size_t>(0, j)(rng);
+        if (!chosen.insert(index).second) {
+            chosen.insert(j);
+        }
+    }
+    
+    std::vector<size_t> indices(chosen.begin(), chosen.end());
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+std::vector<size_t> PixelSampler::selectStratified(const ImageData& image, size_t maxSamples, uint32_t seed) {
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    
+    // First pass: population of every color stratum
+    std::vector<size_t> population(kStratumCount, 0);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        ++population[stratumOf(image, i)];
+    }
+    
+    // Share the budget evenly between occupied strata; strata smaller than their share
+    // give the remainder back to the larger ones
+    std::vector<size_t> quota(kStratumCount, 0);
+    size_t remainingBudget = maxSamples;
+    size_t openStrata = std::count_if(population.begin(), population.end(), [](size_t n) { return n > 0; });
+    bool changed = true;
+    while (changed && openStrata > 0) {
+        changed = false;
+        const size_t share = remainingBudget / openStrata;
+        for (size_t s = 0; s < kStratumCount; ++s) {
+            if (population[s] > 0 && quota[s] == 0 && population[s] <= share) {
+                quota[s] = population[s];
+                remainingBudget -= population[s];
+                --openStrata;
+                changed = true;
+            }
+        }
+    }
+    if (openStrata > 0) {
+        size_t share = remainingBudget / openStrata;
+        size_t extra = remainingBudget % openStrata;
+        for (size_t s = 0; s < kStratumCount; ++s) {
+            if (population[s] > 0 && quota[s] == 0) {
+                quota[s] = share + (extra > 0 ? 1 : 0);
+                extra = extra > 0 ? extra - 1 : 0;
+            }
+        }
+    }
+    
+    // Second pass: reservoir-sample each stratum up to its quota
+    std::mt19937_64 rng(seed);
+    std::vector<std::vector<size_t>> reservoirs(kStratumCount);
+    std::vector<size_t> seen(kStratumCount, 0);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        size_t s = stratumOf(image, i);
+        if (quota[s] == 0) {
+            continue;
+        }
+        size_t n = seen[s]++;
+        if (reservoirs[s].size() < quota[s]) {
+            reservoirs[s].push_back(i);
+        } else {
+            size_t slot = std::uniform_int_distribution<size_t>(0, n)(rng);
+            if (slot < quota[s]) {
+                reservoirs[s][slot] = i;
+            }
+        }
+    }
+    
+    std::vector<size_t> indices;
+    indices.reserve(maxSamples);
+    for (const auto& reservoir : reservoirs) {
+        indices.insert(indices.end(), reservoir.begin(), reservoir.end());
+    }
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
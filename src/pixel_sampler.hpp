@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "image_data.hpp"
+
+// How the solver chooses which pixels to fit
+enum class SamplingMode {
+    None,       // Use every pixel
+    Stride,     // Uniform grid with a stride chosen to fit the sample budget
+    Random,     // Uniform random pixels from a fixed seed
+    Stratified  // Random pixels spread evenly across a coarse color histogram of the start image
+};
+
+// Names used on the command line and in daemon requests
+inline const char* SamplingModeName(SamplingMode mode) {
+    switch (mode) {
+    case SamplingMode::Stride:
+        return "stride";
+    case SamplingMode::Random:
+        return "random";
+    case SamplingMode::Stratified:
+        return "stratified";
+    case SamplingMode::None:
+    default:
+        return "none";
+    }
+}
+
+inline std::optional<SamplingMode> ParseSamplingMode(const std::string& name) {
+    for (SamplingMode mode : { SamplingMode::None, SamplingMode::Stride, SamplingMode::Random, SamplingMode::Stratified }) {
+        if (name == SamplingModeName(mode)) {
+            return mode;
+        }
+    }
+    return std::nullopt;
+}
+
+struct SamplingOptions {
+    static constexpr size_t kDefaultMaxSamples = 1000000; // Budget front ends use when only a mode is given
+
+    SamplingMode mode = SamplingMode::None;
+    size_t maxSamples = 0; // Sample budget; 0 or a budget >= the pixel count uses every pixel
+    uint32_t seed = 0;
+};
+
+class PixelSampler {
+public:
+    // Sorted flat pixel indices to fit, at most options.maxSamples of them.
+    // Memory is bounded by the sample budget; only stratified sampling reads the pixel values.
+    static std::vector<size_t> selectPixels(const ImageData& image, const SamplingOptions& options);
+
+    // Up to count sorted pixel indices that are not in the (sorted) selected set
+    static std::vector<size_t> selectHeldOutPixels(size_t pixelCount, const std::vector<size_t>& selected,
+                                                   size_t count, uint32_t seed);
+
+    static bool isSampling(const SamplingOptions& options, size_t pixelCount) {
+        return options.mode != SamplingMode::None && options.maxSamples > 0 && options.maxSamples < pixelCount;
+    }
+
+private:
+    static std::vector<size_t> selectStride(int width, int height, size_t maxSamples);
+    static std::vector<size_t> selectRandom(size_t pixelCount, size_t count, uint32_t seed);
+    static std::vector<size_t> selectStratified(const ImageData& image, size_t maxSamples, uint32_t seed);
+};
@@ -0,0 +1,305 @@
+#include "solver_benchmark.hpp"
+#include "buffer_pool.hpp"
+#include "color_correction_kernels.hpp"
+#include "color_correction_matrix_solver.hpp"
+#include "command_line.hpp"
+#include "thread_pool.hpp"
+#include "transfer_function.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Samples given to the Ceres benchmark; a per-pixel problem at full size would take minutes
+constexpr size_t kCeresSamples = 100000;
+// Budget for the sampled normal-equations benchmark
+constexpr size_t kSampleBudget = 1000000;
+
+ColorCorrectionMatrix referenceMatrix() {
+    ColorCorrectionMatrix matrix;
+    matrix.matrix << 0.90, 0.08, 0.02,
+                     0.05, 0.85, 0.10,
+                     0.02, 0.10, 0.88;
+    return matrix;
+}
+
+std::optional<std::vector<double>> parseSizes(const std::string& value) {
+    std::vector<double> sizes;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end = nullptr;
+        double size = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(size > 0.0)) {
+            std::cerr << "Error: Invalid image size '" << item << "' (expected megapixels, e.g. 0.3,4,24)" << std::endl;
+            return std::nullopt;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty()) {
+        return std::nullopt;
+    }
+    return sizes;
+}
+
+// Median wall time of repeated runs
+template <typename Function>
+double medianSeconds(unsigned int repeats, Function&& function) {
+    std::vector<double> seconds;
+    for (unsigned int i = 0; i < std::max(1u, repeats); ++i) {
+        Stopwatch stopwatch;
+        function();
+        seconds.push_back(stopwatch.seconds());
+    }
+    std::sort(seconds.begin(), seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+std::string kernelStageName(ApplyKernel kernel) {
+    std::string name = ApplyKernelName(kernel);
+    name.erase(std::remove(name.begin(), name.end(), '.'), name.end());
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return "apply." + name;
+}
+
+std::string lutStageName(const ColorLut3D& lut) {
+    return lut.isFull() ? "apply.lut.full" : "apply.lut." + std::to_string(lut.size());
+}
+
+}
+
+std::optional<SolverBenchmark::Arguments> SolverBenchmark::parseArguments(int argc, char* argv[]) {
+    Arguments args;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::optional<std::string> value;
+        if (arg == "--sizes" || arg == "--repeat" || arg == "--threads" || arg == "--json") {
+            value = CommandLine::optionValue(argc, argv, i);
+            if (!value) {
+                return std::nullopt;
+            }
+        }
+        
+        if (arg == "--sizes") {
+            auto sizes = parseSizes(*value);
+            if (!sizes) {
+                return std::nullopt;
+            }
+            args.megapixels = *sizes;
+        } else if (arg == "--repeat") {
+            auto count = CommandLine::parsePositiveCount(*value, "repeat count", UINT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.repeats = static_cast<unsigned int>(*count);
+        } else if (arg == "--threads") {
+            auto count = CommandLine::parseCount(*value, "thread count", UINT_MAX);
+            if (!count) {
+                return std::nullopt;
+            }
+            args.threadCount = static_cast<unsigned int>(*count);
+        } else if (arg == "--json") {
+            args.jsonPath = *value;
+        } else if (arg == "--ceres") {
+            args.includeCeres = true;
+        } else {
+            std::cerr << "Error: Unknown argument '" << arg << "'" << std::endl;
+            return std::nullopt;
+        }
+    }
+    
+    return args;
+}
+
+int SolverBenchmark::run(const Arguments& args) {
+    ThreadPool threadPool(args.threadCount);
+    std::cout << "Benchmarking with " << threadPool.threadCount() << " threads, best kernel "
+              << ApplyKernelName(SelectApplyKernel()) << ", median of " << args.repeats << " runs" << std::endl;
+    
+    std::vector<ColorLut3D> luts;
+    try {
+        luts.push_back(ColorLut3D::bake(referenceMatrix(), LutOptions{ ColorLut3D::kFullSize, LutInterpolation::Tetrahedral }, &threadPool));
+        luts.push_back(ColorLut3D::bake(referenceMatrix(), LutOptions{ 33, LutInterpolation::Tetrahedral }, &threadPool));
+        
+        for (double megapixels : args.megapixels) {
+            benchmarkSize(megapixels, args, luts, threadPool);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error running benchmark: " << e.what() << std::endl;
+        return -1;
+    }
+    
+    return profiler_.report(args.jsonPath) ? 0 : -1;
+}
+
+void SolverBenchmark::benchmarkSize(double megapixels, const Arguments& args, const std::vector<ColorLut3D>& luts, ThreadPool& threadPool) {
+    ImageData startImage, targetImage;
+    makeImagePair(megapixels, startImage, targetImage, threadPool);
+    const size_t pixels = static_cast<size_t>(startImage.width) * startImage.height;
+    std::cout << "\n" << startImage.width << "x" << startImage.height << " (" << pixels / 1e6 << " MP)" << std::endl;
+    
+    // Solver modes
+    SolverOptions normal;
+    profiler_.record("solve.normal", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver(normal).Solve(startImage, targetImage, &threadPool);
+    }), pixels);
+    
+    SolverOptions encoded;
+    encoded.space = WorkingSpace::Encoded;
+    profiler_.record("solve.normal.encoded", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver(encoded).Solve(startImage, targetImage, &threadPool);
+    }), pixels);
+    
+    SolverOptions stratified;
+    stratified.sampling.mode = SamplingMode::Stratified;
+    stratified.sampling.maxSamples = kSampleBudget;
+    if (PixelSampler::isSampling(stratified.sampling, pixels)) {
+        profiler_.record("solve.normal.stratified", medianSeconds(args.repeats, [&]() {
+            ColorCorrectionMatrixSolver(stratified).Solve(startImage, targetImage, &threadPool);
+        }), pixels);
+    }
+    
+    SolverOptions huber;
+    huber.robust.loss = RobustLoss::Huber;
+    huber.robust.maskSaturated = true;
+    profiler_.record("solve.normal.huber", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver(huber).Solve(startImage, targetImage, &threadPool);
+    }), pixels);
+    
+    SolverOptions pyramid = huber;
+    pyramid.pyramidLevels = 3;
+    profiler_.record("solve.normal.huber.pyramid", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver(pyramid).Solve(startImage, targetImage, &threadPool);
+    }), pixels);
+    
+    // Spatially varying fit on an 8x8 grid, which should stay within a small factor of solve.normal
+    SolverOptions tiled;
+    tiled.tiles.columns = 8;
+    tiled.tiles.rows = 8;
+    TiledCorrection tiledCorrection;
+    profiler_.record("solve.normal.tiled", medianSeconds(args.repeats, [&]() {
+        tiledCorrection = ColorCorrectionMatrixSolver(tiled).SolveTiled(startImage, targetImage, &threadPool);
+    }), pixels);
+    
+    // Higher-order correction models, fitted and applied through their specialized paths
+    std::vector<ColorCorrectionMatrix> models;
+    for (CorrectionModel model : { CorrectionModel::Affine, CorrectionModel::RootPolynomial2, CorrectionModel::RootPolynomial3 }) {
+        SolverOptions options;
+        options.model = model;
+        ColorCorrectionMatrixSolver solver(options);
+        profiler_.record(std::string("solve.normal.") + CorrectionModelName(model), medianSeconds(args.repeats, [&]() {
+            solver.Solve(startImage, targetImage, &threadPool);
+        }), pixels);
+        models.push_back(solver.Solve(startImage, targetImage, &threadPool));
+    }
+    
+    if (args.includeCeres) {
+        SolverOptions ceres;
+        ceres.mode = SolverMode::Ceres;
+        ceres.sampling.mode = SamplingMode::Random;
+        ceres.sampling.maxSamples = kCeresSamples;
+        profiler_.record("solve.ceres.random", medianSeconds(args.repeats, [&]() {
+            ColorCorrectionMatrixSolver(ceres).Solve(startImage, targetImage, &threadPool);
+        }), pixels);
+    }
+    
+    // Every apply kernel the CPU supports, writing into one preallocated image
+    ImageData outputImage = BufferPool::shared().allocateImage(startImage.width, startImage.height, startImage.channels);
+    const Eigen::Matrix3d matrix = referenceMatrix().matrix;
+    const size_t rowBytes = static_cast<size_t>(startImage.width) * startImage.channels;
+    
+    for (int k = 0; k <= static_cast<int>(SelectApplyKernel()); ++k) {
+        const ApplyKernel kernel = static_cast<ApplyKernel>(k);
+        profiler_.record(kernelStageName(kernel), medianSeconds(args.repeats, [&]() {
+            threadPool.parallelFor(startImage.height, [&](size_t beginRow, size_t endRow) {
+                ApplyMatrixRgb8(startImage.data.get() + beginRow * rowBytes, outputImage.data.get() + beginRow * rowBytes,
+                                (endRow - beginRow) * startImage.width, matrix, kernel);
+            });
+        }), pixels);
+    }
+    
+    ColorCorrectionMatrix linearLight = referenceMatrix();
+    linearLight.space = WorkingSpace::Linear;
+    profiler_.record("apply.linear-light", medianSeconds(args.repeats, [&]() {
+        threadPool.parallelFor(startImage.height, [&](size_t beginRow, size_t endRow) {
+            ApplyCorrectionRgb8(startImage.data.get() + beginRow * rowBytes, outputImage.data.get() + beginRow * rowBytes,
+                                (endRow - beginRow) * startImage.width, linearLight);
+        });
+    }), pixels);
+    
+    for (const ColorCorrectionMatrix& model : models) {
+        profiler_.record(std::string("apply.") + CorrectionModelName(model.model), medianSeconds(args.repeats, [&]() {
+            threadPool.parallelFor(startImage.height, [&](size_t beginRow, size_t endRow) {
+                ApplyCorrectionRgb8(startImage.data.get() + beginRow * rowBytes, outputImage.data.get() + beginRow * rowBytes,
+                                    (endRow - beginRow) * startImage.width, model);
+            });
+        }), pixels);
+    }
+    
+    profiler_.record("apply.tiled", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver::ApplyTiledInto(startImage, outputImage, tiledCorrection, &threadPool);
+    }), pixels);
+    
+    for (const ColorLut3D& lut : luts) {
+        profiler_.record(lutStageName(lut), medianSeconds(args.repeats, [&]() {
+            lut.applyInto(startImage, outputImage, &threadPool);
+        }), pixels);
+    }
+    
+    // The same pair widened to 16 bits, which is decoded through the per-sample paths
+    const ImageData startWide = ConvertImage(startImage, SampleType::U16, TransferFunction::Srgb);
+    const ImageData targetWide = ConvertImage(targetImage, SampleType::U16, TransferFunction::Srgb);
+    profiler_.record("solve.normal.16bit", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver(normal).Solve(startWide, targetWide, &threadPool);
+    }), pixels);
+    ImageData outputWide = BufferPool::shared().allocateImage(startImage.width, startImage.height, startImage.channels, SampleType::U16);
+    profiler_.record("apply.16bit", medianSeconds(args.repeats, [&]() {
+        ColorCorrectionMatrixSolver::ApplyMatrixInto(startWide, outputWide, linearLight, &threadPool);
+    }), pixels);
+}
+
+void SolverBenchmark::makeImagePair(double megapixels, ImageData& startImage, ImageData& targetImage, ThreadPool& threadPool) {
+    const double pixels = megapixels * 1e6;
+    const int width = std::max(1, static_cast<int>(std::lround(std::sqrt(pixels * 1.5))));
+    const int height = std::max(1, static_cast<int>(std::lround(pixels / width)));
+    
+    startImage = BufferPool::shared().allocateImage(width, height, 3);
+    targetImage = BufferPool::shared().allocateImage(width, height, 3);
+    
+    // Smooth gradients with hashed per-pixel noise, so every color region is populated
+    unsigned char* data = startImage.data.get();
+    threadPool.parallelFor(height, [&](size_t beginRow, size_t endRow) {
+        for (size_t y = beginRow; y < endRow; ++y) {
+            unsigned char* row = data + y * width * 3;
+            for (int x = 0; x < width; ++x) {
+                uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u;
+                hash ^= hash >> 13;
+                hash *= 0x5bd1e995u;
+                hash ^= hash >> 15;
+                
+                row[x * 3 + 0] = static_cast<unsigned char>(x * 223 / width + (hash & 31));
+                row[x * 3 + 1] = static_cast<unsigned char>(y * 223 / height + ((hash >> 5) & 31));
+                row[x * 3 + 2] = static_cast<unsigned char>((x + static_cast<int>(y)) * 223 / (width + height) + ((hash >> 10) & 31));
+            }
+        }
+    });
+    
+    ColorCorrectionMatrixSolver::ApplyMatrixInto(startImage, targetImage, referenceMatrix(), &threadPool);
+}
+
+void SolverBenchmark::printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [options]" << std::endl;
+    std::cerr << "  Times the solver modes and apply kernels on synthetic image pairs." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --sizes LIST            Comma-separated image sizes in megapixels (default: 0.3,1,4,12,24,50,100)" << std::endl;
+    std::cerr << "  --repeat N              Runs per benchmark; the median is reported (default: 3)" << std::endl;
+    std::cerr << "  --threads N             Worker threads (default: all cores)" << std::endl;
+    std::cerr << "  --ceres                 Also time the Ceres solver on " << kCeresSamples << " random samples" << std::endl;
+    std::cerr << "  --json FILE             Write the results as JSON" << std::endl;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+#include "color_lut.hpp"
+#include "image_data.hpp"
+#include "stage_profiler.hpp"
+
+class ThreadPool;
+
+// Benchmark front end: times the solver modes and apply kernels on synthetic image pairs
+// so regressions show up as numbers rather than impressions
+class SolverBenchmark {
+public:
+    struct Arguments {
+        std::vector<double> megapixels = { 0.3, 1.0, 4.0, 12.0, 24.0, 50.0, 100.0 };
+        unsigned int repeats = 3;     // Each benchmark reports the median of this many runs
+        unsigned int threadCount = 0; // 0 uses every hardware thread
+        bool includeCeres = false;    // Ceres is slow, so it runs on a fixed random sample only
+        std::optional<std::string> jsonPath;
+    };
+
+    // Parse command line arguments
+    static std::optional<Arguments> parseArguments(int argc, char* argv[]);
+
+    // Run every benchmark at every size
+    int run(const Arguments& args);
+
+    // Print usage information
+    void printUsage(const char* programName);
+
+    // Synthetic 3:2 start/target pair of about the given size; the target is a known matrix applied to the start
+    static void makeImagePair(double megapixels, ImageData& startImage, ImageData& targetImage, ThreadPool& threadPool);
+
+private:
+    void benchmarkSize(double megapixels, const Arguments& args, const std::vector<ColorLut3D>& luts, ThreadPool& threadPool);
+
+    StageProfiler profiler_{ true };
+};
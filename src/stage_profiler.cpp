@@ -0,0 +1,134 @@
+#include "stage_profiler.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+double throughput(const StageProfiler::Stage& stage) {
+    return stage.seconds > 0.0 ? stage.megapixels / stage.seconds : 0.0;
+}
+
+}
+
+StageProfiler::Scope::Scope(StageProfiler& profiler, std::string name, size_t pixels)
+    : profiler_(profiler), name_(std::move(name)), pixels_(pixels) {}
+
+StageProfiler::Scope::~Scope() {
+    profiler_.record(name_, stopwatch_.seconds(), pixels_);
+}
+
+void StageProfiler::record(const std::string& name, double seconds, size_t pixels) {
+    if (!enabled_) {
+        return;
+    }
+    
+    Stage stage;
+    stage.name = name;
+    stage.seconds = seconds;
+    stage.megapixels = pixels / 1e6;
+    stage.peakRssBytes = peakRssBytes();
+    stages_.push_back(stage);
+}
+
+void StageProfiler::print(std::ostream& stream) const {
+    if (!enabled_) {
+        return;
+    }
+    
+    stream << "\nProfile:" << std::endl;
+    stream << std::left << std::setw(28) << "  stage" << std::right << std::setw(10) << "MP" << std::setw(12) << "ms"
+           << std::setw(12) << "MP/s" << std::setw(14) << "peak RSS MB" << std::endl;
+    for (const Stage& stage : stages_) {
+        stream << "  " << std::left << std::setw(26) << stage.name << std::right << std::fixed << std::setprecision(2);
+        if (stage.megapixels > 0.0) {
+            stream << std::setw(10) << stage.megapixels << std::setw(12) << stage.seconds * 1e3 << std::setw(12) << throughput(stage);
+        } else {
+            stream << std::setw(10) << "-" << std::setw(12) << stage.seconds * 1e3 << std::setw(12) << "-";
+        }
+        stream << std::setw(14) << stage.peakRssBytes / (1024.0 * 1024.0) << std::endl;
+    }
+    stream << std::defaultfloat;
+}
+
+void StageProfiler::writeJson(std::ostream& stream) const {
+    stream << "{\n  \"stages\": [";
+    for (size_t i = 0; i < stages_.size(); ++i) {
+        const Stage& stage = stages_[i];
+        stream << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << jsonEscape(stage.name) << "\""
+               << ", \"seconds\": " << stage.seconds
+               << ", \"megapixels\": " << stage.megapixels
+               << ", \"mp_per_second\": " << throughput(stage)
+               << ", \"peak_rss_bytes\": " << stage.peakRssBytes << "}";
+    }
+    stream << "\n  ]\n}\n";
+}
+
+bool StageProfiler::saveJson(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Error: Failed to open profile output '" << path << "'" << std::endl;
+        return false;
+    }
+    
+    file << std::setprecision(9);
+    writeJson(file);
+    if (!file) {
+        std::cerr << "Error: Failed to write profile output '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StageProfiler::report(const std::optional<std::string>& jsonPath) const {
+    if (!enabled_) {
+        return true;
+    }
+    
+    print(std::cout);
+    if (jsonPath.has_value()) {
+        if (!saveJson(jsonPath.value())) {
+            return false;
+        }
+        std::cout << "Saved profile to: " << jsonPath.value() << std::endl;
+    }
+    return true;
+}
+
+size_t StageProfiler::peakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);        // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Wall-clock timer started on construction
+class Stopwatch {
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Per-stage wall time, throughput and peak RSS for --profile, printable as a table or JSON.
+// A disabled profiler records nothing, so call sites need no checks of their own.
+class StageProfiler {
+public:
+    struct Stage {
+        std::string name;
+        double seconds = 0.0;
+        double megapixels = 0.0;  // Pixels the stage processed, 0 when throughput does not apply
+        size_t peakRssBytes = 0;  // Process peak resident set size when the stage ended
+    };
+
+    // Times a stage from construction to destruction
+    class Scope {
+    public:
+        Scope(StageProfiler& profiler, std::string name, size_t pixels);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StageProfiler& profiler_;
+        std::string name_;
+        size_t pixels_;
+        Stopwatch stopwatch_;
+    };
+
+    explicit StageProfiler(bool enabled = false) : enabled_(enabled) {}
+
+    bool enabled() const { return enabled_; }
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+
+    void record(const std::string& name, double seconds, size_t pixels = 0);
+    Scope measure(const std::string& name, size_t pixels = 0) { return Scope(*this, name, pixels); }
+
+    const std::vector<Stage>& stages() const { return stages_; }
+
+    void print(std::ostream& stream) const;
+    void writeJson(std::ostream& stream) const;
+    bool saveJson(const std::string& path) const;
+
+    // Print the table and, when a path is given, save the JSON; false if saving failed
+    bool report(const std::optional<std::string>& jsonPath) const;
+
+    // Peak resident set size of this process so far, 0 where unsupported
+    static size_t peakRssBytes();
+
+private:
+    bool enabled_;
+    std::vector<Stage> stages_;
+};
@@ -0,0 +1,124 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    // The caller of parallelFor acts as one of the threads
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    taskAvailable_.notify_all();
+    
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    
+    const size_t bandCount = std::min<size_t>(threadCount(), count);
+    if (bandCount == 1) {
+        fn(0, count);
+        return;
+    }
+    
+    // Bands left to finish; guarded by doneMutex so the locals outlive every worker touching them
+    size_t remaining = bandCount - 1;
+    std::mutex doneMutex;
+    std::condition_variable done;
+    std::exception_ptr failure;
+    
+    auto runBand = [&](size_t band) {
+        try {
+            fn(count * band / bandCount, count * (band + 1) / bandCount);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    };
+    
+    for (size_t band = 1; band < bandCount; ++band) {
+        enqueue([&, band]() {
+            runBand(band);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        });
+    }
+    
+    runBand(0);
+    
+    // Help drain the queue while waiting so nested calls from worker threads cannot deadlock
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (remaining == 0) {
+                break;
+            }
+        }
+        if (!runPendingTask()) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            done.wait_for(lock, std::chrono::milliseconds(1), [&]() { return remaining == 0; });
+        }
+    }
+    
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    taskAvailable_.notify_one();
+}
+
+bool ThreadPool::runPendingTask() {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) {
+            return false;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            taskAvailable_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if (stopping_ && tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads shared by the parallel kernels.
+// The calling thread takes part in parallelFor, so a pool of N threads keeps N cores busy.
+class ThreadPool {
+public:
+    // threadCount == 0 uses every hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that run work, including the caller of parallelFor
+    unsigned int threadCount() const { return static_cast<unsigned int>(workers_.size()) + 1; }
+
+    // Split [0, count) into contiguous bands and run fn(begin, end) on each; blocks until all bands finish.
+    // The first exception thrown by a band is rethrown on the caller.
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn);
+
+    // Queue a task for a worker thread
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+private:
+    void enqueue(std::function<void()> task);
+    bool runPendingTask();
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable taskAvailable_;
+    bool stopping_ = false;
+};
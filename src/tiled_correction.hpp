@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "transfer_function.hpp"
+
+// A spatially varying linear correction: one matrix per tile of a columns x rows grid laid over the
+// image, blended bilinearly between tile centers (and held constant beyond the outer centers). The grid
+// is in proportions of the image, so it applies to any resolution of the frame it was fitted on.
+struct TiledCorrection {
+    int columns = 1;
+    int rows = 1;
+    WorkingSpace space = WorkingSpace::Encoded;
+    std::vector<Eigen::Matrix3d> matrices; // Row-major over the tiles
+
+    const Eigen::Matrix3d& tile(int column, int row) const {
+        return matrices[static_cast<size_t>(row) * columns + column];
+    }
+
+    // First pixel of tile index along an axis of size pixels split into tiles
+    static int tileStart(int index, int tiles, int size) {
+        return static_cast<int>(static_cast<int64_t>(index) * size / tiles);
+    }
+
+    // Tile holding pixel position along the axis: the largest index whose start is at most position
+    static int tileOf(int position, int tiles, int size) {
+        return static_cast<int>((static_cast<int64_t>(position + 1) * tiles - 1) / size);
+    }
+
+    // Position of pixel center p in tile-center units: tile i's center is at i, clamped to the outer centers
+    static double gridCoordinate(double p, int tiles, int size) {
+        return std::clamp((p + 0.5) * tiles / size - 0.5, 0.0, static_cast<double>(tiles - 1));
+    }
+
+    // Blended matrix of pixel (x, y) in a width x height image; the reference the apply kernels follow
+    Eigen::Matrix3d matrixAt(int x, int y, int width, int height) const {
+        const double u = gridCoordinate(x, columns, width);
+        const double v = gridCoordinate(y, rows, height);
+        const int c0 = static_cast<int>(u), r0 = static_cast<int>(v);
+        const int c1 = std::min(c0 + 1, columns - 1), r1 = std::min(r0 + 1, rows - 1);
+        const double fu = u - c0, fv = v - r0;
+        return (1.0 - fv) * ((1.0 - fu) * tile(c0, r0) + fu * tile(c1, r0)) + fv * ((1.0 - fu) * tile(c0, r1) + fu * tile(c1, r1));
+    }
+};
\ No newline at end of file
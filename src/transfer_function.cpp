@@ -0,0 +1,233 @@
+#include "transfer_function.hpp"
+#include "buffer_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Tabulate curve on [2^-lowOctaves, 1] with linearSlope below it
+PiecewiseCurve buildCurve(double (*curve)(double), int lowOctaves, double linearSlope) {
+    PiecewiseCurve table;
+    const float first = std::ldexp(1.0f, -lowOctaves);
+    std::memcpy(&table.firstBits, &first, sizeof(first));
+    table.linearSlope = static_cast<float>(linearSlope);
+
+    const size_t segments = size_t(lowOctaves) << PiecewiseCurve::kSegmentBits;
+    table.offset.resize(segments + 1);
+    table.slope.resize(segments + 1);
+    auto segmentStart = [&](size_t i) {
+        const uint32_t bits = table.firstBits + static_cast<uint32_t>(i << PiecewiseCurve::kSegmentShift);
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return static_cast<double>(x);
+    };
+    for (size_t i = 0; i < segments; ++i) {
+        const double x0 = segmentStart(i), x1 = segmentStart(i + 1);
+        const double y0 = curve(x0), y1 = curve(x1);
+        const double slope = (y1 - y0) / (x1 - x0);
+        table.slope[i] = static_cast<float>(slope);
+        table.offset[i] = static_cast<float>(y0 - slope * x0);
+    }
+    table.offset[segments] = static_cast<float>(curve(1.0));
+    table.slope[segments] = 0.0f;
+    return table;
+}
+
+template <typename Sample>
+const Sample* samplesOf(const ImageData& image) {
+    return reinterpret_cast<const Sample*>(image.data.get());
+}
+
+template <typename Sample>
+Sample* samplesOf(ImageData& image) {
+    return reinterpret_cast<Sample*>(image.data.get());
+}
+
+bool decodesSrgb(const ImageData& image, WorkingSpace space) {
+    return space == WorkingSpace::Linear && image.transfer == TransferFunction::Srgb;
+}
+
+} // namespace
+
+const char* WorkingSpaceName(WorkingSpace space) {
+    return space == WorkingSpace::Linear ? "linear" : "encoded";
+}
+
+std::optional<WorkingSpace> ParseWorkingSpace(const std::string& name) {
+    for (WorkingSpace space : { WorkingSpace::Linear, WorkingSpace::Encoded }) {
+        if (name == WorkingSpaceName(space)) {
+            return space;
+        }
+    }
+    return std::nullopt;
+}
+
+double SrgbCurve::decode(double encoded) {
+    return encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+}
+
+double SrgbCurve::encode(double linear) {
+    return linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+}
+
+const float* SrgbCurve::decodeTable8() {
+    static const std::vector<float> table = []() {
+        std::vector<float> values(256);
+        for (int i = 0; i < 256; ++i) {
+            values[i] = static_cast<float>(decode(i / 255.0));
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+const float* SrgbCurve::decodeTable16() {
+    static const std::vector<float> table = []() {
+        std::vector<float> values(65536);
+        for (int i = 0; i < 65536; ++i) {
+            values[i] = static_cast<float>(decode(i / 65535.0));
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+const PiecewiseCurve& SrgbCurve::decoder() {
+    // Linear below 0.04045 > 2^-5
+    static const PiecewiseCurve curve = buildCurve(&SrgbCurve::decode, 5, 1.0 / 12.92);
+    return curve;
+}
+
+const PiecewiseCurve& SrgbCurve::encoder() {
+    // Linear below 0.0031308 > 2^-9
+    static const PiecewiseCurve curve = buildCurve(&SrgbCurve::encode, 9, 12.92);
+    return curve;
+}
+
+void DecodeSamples(const ImageData& image, size_t first, size_t count, WorkingSpace space, float* values) {
+    const bool srgb = decodesSrgb(image, space);
+    switch (image.sampleType) {
+    case SampleType::U16: {
+        const uint16_t* in = samplesOf<uint16_t>(image) + first;
+        if (srgb) {
+            const float* table = SrgbCurve::decodeTable16();
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = table[in[i]];
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = in[i] * (1.0f / 65535.0f);
+            }
+        }
+        break;
+    }
+    case SampleType::F32: {
+        const float* in = samplesOf<float>(image) + first;
+        if (srgb) {
+            const PiecewiseCurve& decoder = SrgbCurve::decoder();
+            for (size_t i = 0; i < count; ++i) {
+                // The table covers [0, 1]; HDR values above it take the exact curve
+                const float value = in[i] > 0.0f ? in[i] : 0.0f;
+                values[i] = value <= 1.0f ? decoder.evaluate(value) : static_cast<float>(SrgbCurve::decode(value));
+            }
+        } else {
+            std::copy(in, in + count, values);
+        }
+        break;
+    }
+    case SampleType::U8:
+    default: {
+        const unsigned char* in = image.data.get() + first;
+        if (srgb) {
+            const float* table = SrgbCurve::decodeTable8();
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = table[in[i]];
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = in[i] * (1.0f / 255.0f);
+            }
+        }
+        break;
+    }
+    }
+}
+
+void EncodeSamples(const float* values, size_t count, WorkingSpace space, ImageData& image, size_t first) {
+    const bool srgb = decodesSrgb(image, space);
+    const PiecewiseCurve& encoder = SrgbCurve::encoder();
+
+    // Integer outputs clamp to [0, 1] before encoding, so only the table is needed. NaN becomes 0.
+    auto encodeClamped = [&](float value) {
+        value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+        return srgb ? encoder.evaluate(value) : value;
+    };
+
+    switch (image.sampleType) {
+    case SampleType::U16: {
+        uint16_t* out = samplesOf<uint16_t>(image) + first;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<uint16_t>(encodeClamped(values[i]) * 65535.0f + 0.5f);
+        }
+        break;
+    }
+    case SampleType::F32: {
+        float* out = samplesOf<float>(image) + first;
+        if (srgb) {
+            for (size_t i = 0; i < count; ++i) {
+                const float value = values[i] > 0.0f ? values[i] : 0.0f;
+                out[i] = value <= 1.0f ? encoder.evaluate(value) : static_cast<float>(SrgbCurve::encode(value));
+            }
+        } else {
+            std::copy(values, values + count, out);
+        }
+        break;
+    }
+    case SampleType::U8:
+    default: {
+        unsigned char* out = image.data.get() + first;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<unsigned char>(encodeClamped(values[i]) * 255.0f + 0.5f);
+        }
+        break;
+    }
+    }
+}
+
+ImageData ConvertImage(const ImageData& image, SampleType sampleType, TransferFunction transfer) {
+    if (!image.isValid()) {
+        throw std::invalid_argument("Cannot convert invalid image data");
+    }
+
+    ImageData converted = BufferPool::shared().allocateImage(image.width, image.height, image.channels, sampleType);
+    converted.transfer = transfer;
+
+    // Go through linear light only when the curves differ; otherwise just rescale
+    const WorkingSpace space = image.transfer == transfer ? WorkingSpace::Encoded : WorkingSpace::Linear;
+    constexpr size_t kChunk = 4096;
+    float values[kChunk];
+    const size_t samples = image.pixelCount() * image.channels;
+    for (size_t first = 0; first < samples; first += kChunk) {
+        const size_t count = std::min(kChunk, samples - first);
+        DecodeSamples(image, first, count, space, values);
+        EncodeSamples(values, count, space, converted, first);
+    }
+    return converted;
+}
+
+const char* SampleTypeName(SampleType type) {
+    switch (type) {
+    case SampleType::U16:
+        return "16-bit";
+    case SampleType::F32:
+        return "float";
+    case SampleType::U8:
+    default:
+        return "8-bit";
+    }
+}
+
+const char* TransferFunctionName(TransferFunction transfer) {
+    return transfer == TransferFunction::Srgb ? "sRGB" : "linear";
+}
\ No newline at end of file
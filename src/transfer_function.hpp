@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+#include "image_data.hpp"
+
+// Scale a correction works on
+enum class WorkingSpace {
+    Encoded, // Stored values as they are (gamma-encoded for sRGB images), as earlier versions did
+    Linear   // Linear light: samples are decoded by their transfer function before the correction and re-encoded after
+};
+
+const char* WorkingSpaceName(WorkingSpace space);
+std::optional<WorkingSpace> ParseWorkingSpace(const std::string& name);
+
+// Piecewise-linear approximation of a transfer curve on [0, 1] for float samples. Below the first
+// tabulated value the sRGB curves are exactly linear; above it, every octave is split into
+// 2^kSegmentBits segments indexed by the exponent and top mantissa bits of the value, so evaluating
+// the curve costs a table lookup and a multiply-add instead of a pow().
+struct PiecewiseCurve {
+    static constexpr int kSegmentBits = 8;
+    static constexpr int kSegmentShift = 23 - kSegmentBits;
+
+    uint32_t firstBits = 0;    // Float bits of the start of the tabulated range
+    float linearSlope = 0.0f;  // Slope of the linear part below it
+    // y = offset[i] + slope[i] * x on segment i; the last entry covers x = 1 exactly
+    std::vector<float> offset;
+    std::vector<float> slope;
+
+    // x must lie in [0, 1]
+    float evaluate(float x) const {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        if (bits < firstBits) {
+            return x * linearSlope;
+        }
+        const uint32_t index = (bits - firstBits) >> kSegmentShift;
+        return offset[index] + slope[index] * x;
+    }
+};
+
+// The sRGB transfer curve (IEC 61966-2-1)
+class SrgbCurve {
+public:
+    // Exact curve, for building tables and for reference paths
+    static double decode(double encoded);
+    static double encode(double linear);
+
+    // Linear light of every 8-bit and 16-bit code value
+    static const float* decodeTable8();
+    static const float* decodeTable16();
+
+    // Approximations for float values on [0, 1], within a few 1e-7 of the exact curve
+    static const PiecewiseCurve& decoder();
+    static const PiecewiseCurve& encoder();
+};
+
+// Convert count samples starting at sample first of the image to values on the 0..1 scale of the
+// working space: linear light for Linear (decoding sRGB images), the stored values otherwise
+void DecodeSamples(const ImageData& image, size_t first, size_t count, WorkingSpace space, float* values);
+
+// Store count values as samples of the image starting at sample first; integer samples are
+// clamped to their range and rounded
+void EncodeSamples(const float* values, size_t count, WorkingSpace space, ImageData& image, size_t first);
+
+// Copy of an image with another sample type and transfer function, e.g. 16-bit or float images for
+// 8-bit-only file formats. The storage comes from BufferPool::shared().
+ImageData ConvertImage(const ImageData& image, SampleType sampleType, TransferFunction transfer);
+
+const char* SampleTypeName(SampleType type);
+const char* TransferFunctionName(TransferFunction transfer);
\ No newline at end of file